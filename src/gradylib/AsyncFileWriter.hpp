@@ -0,0 +1,266 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Writing files without blocking the caller.
+ *
+ *     std::future<void> done = m.writeAsync("snapshot.bin");
+ *     ...
+ *     done.get();    // rethrows any error
+ *
+ * writeFileAsync runs a function that serializes to a std::ostream on a ThreadPool.  The stream's buffer is an
+ * AsyncFileBuffer: two large buffers, one being filled by the serializing task while a dedicated I/O thread pwrite()s
+ * the other, so serialization overlaps with the disk.  Seeking (the writers seek back to fill in offsets) hands off
+ * the current buffer and continues at the new position, since every buffer carries its own file offset.
+ *
+ * The writeAsync methods of the containers and builders and writeMappableAsync are built on it.  The container must
+ * stay alive and unmodified until the future is ready; to keep modifying it, write a copy.  The serializing task
+ * occupies a pool worker for the whole write, waiting whenever the disk falls two buffers behind.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<condition_variable>
+#include<cstring>
+#include<filesystem>
+#include<fstream>
+#include<future>
+#include<mutex>
+#include<sstream>
+#include<streambuf>
+#include<string>
+#include<thread>
+#include<utility>
+#include<vector>
+
+#include"Exception.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr size_t asyncWriteBufferSize = 8 << 20;
+
+    class AsyncFileBuffer : public std::streambuf {
+        int fd = -1;
+        std::vector<char> buffers[2];
+        int filling = 0;
+        // File offset of pbase() and the end of the furthest write
+        off_t bufferStart = 0;
+        off_t extent = 0;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        // The buffer handed to the I/O thread, if inFlight
+        bool inFlight = false;
+        int inFlightBuffer = 0;
+        size_t inFlightLength = 0;
+        off_t inFlightOffset = 0;
+        bool closing = false;
+        std::string error;
+        std::thread io;
+
+        void ioLoop() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                cv.wait(lock, [this] {
+                    return inFlight || closing;
+                });
+                if (!inFlight) {
+                    return;
+                }
+                char const * data = buffers[inFlightBuffer].data();
+                size_t length = inFlightLength;
+                off_t offset = inFlightOffset;
+                lock.unlock();
+                std::string writeError;
+                while (length > 0) {
+                    ssize_t n = pwrite(fd, data, length, offset);
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        writeError = strerror(errno);
+                        break;
+                    }
+                    data += n;
+                    length -= n;
+                    offset += n;
+                }
+                lock.lock();
+                if (!writeError.empty() && error.empty()) {
+                    error = std::move(writeError);
+                }
+                inFlight = false;
+                cv.notify_all();
+            }
+        }
+
+        // Hands the filled part of the current buffer to the I/O thread and starts filling the other one
+        bool handOff() {
+            size_t length = pptr() - pbase();
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] {
+                return !inFlight;
+            });
+            if (!error.empty()) {
+                return false;
+            }
+            if (length > 0) {
+                inFlight = true;
+                inFlightBuffer = filling;
+                inFlightLength = length;
+                inFlightOffset = bufferStart;
+                cv.notify_all();
+                filling ^= 1;
+                bufferStart += length;
+                extent = std::max(extent, bufferStart);
+            }
+            setp(buffers[filling].data(), buffers[filling].data() + buffers[filling].size());
+            return true;
+        }
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!handOff()) {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            return handOff() ? 0 : -1;
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+            off_t current = bufferStart + (pptr() - pbase());
+            if (dir == std::ios_base::cur && off == 0) {
+                // tellp
+                return current;
+            }
+            off_t target;
+            if (dir == std::ios_base::beg) {
+                target = off;
+            } else if (dir == std::ios_base::cur) {
+                target = current + off;
+            } else {
+                target = std::max(extent, current) + off;
+            }
+            if (target < 0 || !handOff()) {
+                return pos_type(off_type(-1));
+            }
+            bufferStart = target;
+            return target;
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+
+    public:
+        AsyncFileBuffer(std::filesystem::path const & path, size_t bufferSize = asyncWriteBufferSize) {
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << path << " for writing: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            buffers[0].resize(bufferSize);
+            buffers[1].resize(bufferSize);
+            setp(buffers[0].data(), buffers[0].data() + bufferSize);
+            io = std::thread([this]() {
+                ioLoop();
+            });
+        }
+
+        AsyncFileBuffer(AsyncFileBuffer const &) = delete;
+
+        AsyncFileBuffer & operator=(AsyncFileBuffer const &) = delete;
+
+        // Writes what's buffered, waits for the I/O thread and closes the file.  Throws if any write failed.
+        void finish() {
+            if (fd < 0) {
+                return;
+            }
+            handOff();
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this] {
+                    return !inFlight;
+                });
+                closing = true;
+                cv.notify_all();
+            }
+            io.join();
+            int closeResult = close(fd);
+            fd = -1;
+            if (error.empty() && closeResult != 0) {
+                error = strerror(errno);
+            }
+            if (!error.empty()) {
+                throw gradylibMakeException("Error writing file: " + error);
+            }
+        }
+
+        ~AsyncFileBuffer() {
+            try {
+                finish();
+            } catch (...) {
+            }
+        }
+    };
+}
+
+namespace gradylib {
+
+    /*
+     * Runs writer(std::ostream &) on a ThreadPool (the default pool if tp is null) with the stream writing to path
+     * through an AsyncFileBuffer.  The future holds any exception from opening, serializing or writing.
+     */
+    template<typename Writer>
+    requires std::invocable<Writer &, std::ostream &>
+    std::future<void> writeFileAsync(std::filesystem::path path, Writer && writer, ThreadPool * tp = nullptr,
+                                     size_t bufferSize = gradylib_helpers::asyncWriteBufferSize) {
+        ThreadPool & pool = tp ? *tp : gradylib_helpers::getDefaultThreadPool();
+        return pool.submit([path = std::move(path), writer = std::forward<Writer>(writer), bufferSize]() mutable {
+            gradylib_helpers::AsyncFileBuffer buffer(path, bufferSize);
+            std::ostream os(&buffer);
+            writer(os);
+            if (os.fail()) {
+                buffer.finish();
+                throw gradylibMakeException("Error serializing to " + path.string());
+            }
+            buffer.finish();
+        });
+    }
+}
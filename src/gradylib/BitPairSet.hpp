@@ -47,6 +47,8 @@ namespace gradylib {
         UnderlyingInt *underlying = nullptr;
         size_t setSize = 0;
         bool readOnly = false;
+        // The underlying array belongs to someone else, e.g. a memory mapping
+        bool borrowed = false;
 
         inline size_t getUnderlyingLength(size_t len) const {
             size_t base = len >> bitShiftForDivision;
@@ -82,8 +84,13 @@ namespace gradylib {
 
         BitPairSet() = default;
 
+        // Starts loading the word holding idx's bits, ahead of a lookup
+        void prefetch(size_t idx) const {
+            __builtin_prefetch(underlying + (idx >> bitShiftForDivision));
+        }
+
         BitPairSet(UnderlyingInt *underlying, size_t setSize)
-                : underlying(underlying), setSize(setSize), readOnly(true) {
+                : underlying(underlying), setSize(setSize), readOnly(true), borrowed(true) {
         }
 
         BitPairSet(BitPairSet const &s) {
@@ -93,14 +100,15 @@ namespace gradylib {
             setSize = s.setSize;
         }
 
-        BitPairSet(void const * memoryMapping)
+        // readOnly = false is for copy-on-write mappings, where the set is modified in place
+        BitPairSet(void const * memoryMapping, bool readOnly = true)
                 : underlying(
                 static_cast<UnderlyingInt *>(
                         const_cast<void *>(
                                 static_cast<void const *>(
                                         8 + static_cast<std::byte const *>(memoryMapping))))),
                   setSize(*static_cast<size_t const *>(memoryMapping)),
-                  readOnly(true) {
+                  readOnly(readOnly), borrowed(true) {
         }
 
         BitPairSet(std::ifstream & ifs) {
@@ -111,7 +119,7 @@ namespace gradylib {
         }
 
         ~BitPairSet() {
-            if (!readOnly) {
+            if (!borrowed) {
                 delete[] underlying;
             }
         }
@@ -122,22 +130,35 @@ namespace gradylib {
                 return *this;
             }
             size_t len = getUnderlyingLength(s.setSize);
-            underlying = new UnderlyingInt[len];
-            memcpy(underlying, s.underlying, len * sizeof(UnderlyingInt));
+            UnderlyingInt * newUnderlying = new UnderlyingInt[len];
+            memcpy(newUnderlying, s.underlying, len * sizeof(UnderlyingInt));
+            if (!borrowed) {
+                delete[] underlying;
+            }
+            underlying = newUnderlying;
             setSize = s.setSize;
+            readOnly = false;
+            borrowed = false;
             return *this;
         }
 
         BitPairSet(BitPairSet &&s)
-                : underlying(s.underlying), setSize(s.setSize), readOnly(s.readOnly) {
+                : underlying(s.underlying), setSize(s.setSize), readOnly(s.readOnly), borrowed(s.borrowed) {
             s.underlying = nullptr;
             s.setSize = 0;
         }
 
         BitPairSet &operator=(BitPairSet &&s) noexcept {
+            if (this == &s) {
+                return *this;
+            }
+            if (!borrowed) {
+                delete[] underlying;
+            }
             underlying = s.underlying;
             setSize = s.setSize;
             readOnly = s.readOnly;
+            borrowed = s.borrowed;
             s.underlying = nullptr;
             s.setSize = 0;
             return *this;
@@ -148,7 +169,7 @@ namespace gradylib {
             memset(underlying, 0, getUnderlyingLength(size) * sizeof(UnderlyingInt));
         }
 
-        void write(std::ofstream &ofs) const {
+        void write(std::ostream &ofs) const {
             ofs.write((char *) &setSize, 8);
             size_t len = getUnderlyingLength(setSize);
             ofs.write((char *) underlying, sizeof(UnderlyingInt) * len);
@@ -173,9 +194,12 @@ namespace gradylib {
             if (newSize > currentSize) {
                 memset(&newUnderlying[currentSize], 0, (newSize - currentSize) * sizeof(UnderlyingInt));
             }
-            delete[] underlying;
+            if (!borrowed) {
+                delete[] underlying;
+            }
             underlying = newUnderlying;
             setSize = size;
+            borrowed = false;
         }
 
         std::pair<bool, bool> operator[](int idx) const {
@@ -0,0 +1,142 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Cooperative cancellation for work on a ThreadPool.
+ *
+ *     CancellationToken token = CancellationToken::withTimeout(std::chrono::milliseconds(200));
+ *     auto counts = m.parallelForEach(tp, f, PartialInit{}, FinalInit{}, 0, token);
+ *     ...
+ *     token.cancel();   // or let the deadline pass
+ *     counts.get();     // throws Cancelled
+ *
+ * A token is cancelled by cancel() or once its deadline passes.  Copies share the same state.  Nothing is
+ * interrupted: parallelForEach checks the token before each partition and every cancellationCheckInterval slots and
+ * drops the partials of cancelled partitions without merging them.  Tasks of a TaskGroup made with a token, and so
+ * tasks from add and allocateOverThreads given one, are discarded without running once it's cancelled.  Long tasks
+ * should check isCancelled() themselves.
+ *
+ * A default constructed token is never cancelled and costs nothing to check.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<limits>
+#include<memory>
+
+#include"Exception.hpp"
+
+namespace gradylib_helpers {
+
+    // Slots parallelForEach scans between checks of its token
+    inline constexpr size_t cancellationCheckInterval = 4096;
+
+}
+
+namespace gradylib {
+
+    // What futures of cancelled work hold
+    class Cancelled : public Exception {
+    public:
+        Cancelled()
+            : Exception("Cancelled")
+        {
+        }
+    };
+
+    class CancellationToken {
+        struct State {
+            std::atomic<bool> cancelled{false};
+            // steady_clock nanoseconds, max for no deadline
+            std::atomic<int64_t> deadline{std::numeric_limits<int64_t>::max()};
+        };
+
+        std::shared_ptr<State> state;
+
+        static int64_t ticks(std::chrono::steady_clock::time_point t) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+    public:
+        // Never cancelled
+        CancellationToken() = default;
+
+        // A token that is cancelled only by cancel()
+        static CancellationToken create() {
+            CancellationToken token;
+            token.state = std::make_shared<State>();
+            return token;
+        }
+
+        static CancellationToken withDeadline(std::chrono::steady_clock::time_point deadline) {
+            CancellationToken token = create();
+            token.setDeadline(deadline);
+            return token;
+        }
+
+        template<typename Rep, typename Period>
+        static CancellationToken withTimeout(std::chrono::duration<Rep, Period> timeout) {
+            return withDeadline(std::chrono::steady_clock::now() + timeout);
+        }
+
+        void cancel() const {
+            if (!state) {
+                throw gradylibMakeException("Can't cancel a default constructed CancellationToken");
+            }
+            state->cancelled.store(true, std::memory_order_release);
+        }
+
+        void setDeadline(std::chrono::steady_clock::time_point deadline) const {
+            if (!state) {
+                throw gradylibMakeException("Can't set a deadline on a default constructed CancellationToken");
+            }
+            state->deadline.store(ticks(deadline), std::memory_order_release);
+        }
+
+        bool isCancelled() const {
+            if (!state) {
+                return false;
+            }
+            if (state->cancelled.load(std::memory_order_acquire)) {
+                return true;
+            }
+            int64_t deadline = state->deadline.load(std::memory_order_acquire);
+            if (deadline != std::numeric_limits<int64_t>::max() && ticks(std::chrono::steady_clock::now()) >= deadline) {
+                state->cancelled.store(true, std::memory_order_release);
+                return true;
+            }
+            return false;
+        }
+
+        void throwIfCancelled() const {
+            if (isCancelled()) {
+                throw Cancelled();
+            }
+        }
+    };
+}
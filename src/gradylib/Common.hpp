@@ -25,6 +25,8 @@ SOFTWARE.
 #pragma once
 
 #include<concepts>
+#include<cstddef>
+#include<type_traits>
 
 namespace gradylib_helpers {
     template<typename T>
@@ -47,13 +49,26 @@ namespace gradylib_helpers {
     }
 
     template<int alignment>
-    void writePad(std::ofstream & ofs) {
+    void writePad(std::ostream & ofs) {
         static std::vector<char> pad(alignment, 0);
         int64_t pos = ofs.tellp();
         int padLength = getPadLength<alignment>(pos);
         ofs.write(pad.data(), padLength);
     }
 
+    /*
+     * A value identifying a hash function, recorded in the headers of mappable files.  A reader hashing differently
+     * from the writer would silently miss keys, so loaders compare fingerprints and throw on a mismatch.
+     */
+    template<typename KeyType, typename Hash>
+    size_t hashFingerprint(Hash const & hash) {
+        if constexpr (std::is_constructible_v<KeyType, char const *>) {
+            return hash(KeyType("gradylib hash fingerprint")) ^ (hash(KeyType("")) << 1);
+        } else {
+            return hash(static_cast<KeyType>(101)) ^ (hash(static_cast<KeyType>(-3)) << 1);
+        }
+    }
+
     template<typename T>
     class MapLookup {
         T * val = nullptr;
@@ -22,95 +22,317 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+/*
+ * CompletionPool collects results from many threads for one consumer to drain.
+ *
+ *     CompletionPool<Result> results;
+ *     // on any number of threads
+ *     results.add(r);
+ *     results.addBatch(std::span<Result const>(buffer));
+ *     // on the consumer
+ *     results.drain([](Result && r) { ... }, 1000);   // at most 1000 items
+ *     for (Result & r : results) { ... }             // everything available
+ *
+ * Each thread that adds gets its own queue in the pool, a linked list of segments holding a few KB of items each.
+ * Adding is a store into the thread's current segment and a release store of the segment's count; no two threads
+ * ever write the same cache line, and there's no CAS.  Segments come from a per-thread NodeCache, and the consumer
+ * hands them back when it has drained them, so the steady state doesn't call malloc.
+ *
+ * Items added by one thread come out in the order that thread added them.  drain visits the threads' queues in
+ * turn, starting after wherever the previous drain stopped, so draining a few items at a time doesn't starve
+ * anyone.  An item is consumed when drain has called f on it or when the iterator moves past it; breaking out of a
+ * loop leaves the current item and everything after it in the pool.
+ *
+ * Draining takes a mutex that only consumers use, so several consumers are safe but they take turns.  Don't drain
+ * a pool from inside f or a loop over the same pool.
+ */
+
 #pragma once
 
+#include<algorithm>
+#include<array>
 #include<atomic>
+#include<concepts>
+#include<cstddef>
+#include<cstdint>
+#include<limits>
+#include<mutex>
+#include<new>
+#include<span>
+#include<thread>
+#include<type_traits>
 #include<utility>
 
+#include"TaskAllocation.hpp"
+
+namespace gradylib_helpers {
+
+    inline std::atomic<uint64_t> nextCompletionPoolId{1};
+
+    template<typename T>
+    struct CompletionSegment {
+        static constexpr size_t segmentBytes = 4096;
+        static constexpr size_t capacity = std::max<size_t>(1, (segmentBytes - 128) / sizeof(T));
+
+        // Written by the producer
+        alignas(64) std::atomic<size_t> published{0};
+        std::atomic<CompletionSegment *> next{nullptr};
+        alignas(64) RawStorage<sizeof(T), alignof(T)> slots[capacity];
+
+        T * slot(size_t i) {
+            return std::launder(static_cast<T *>(static_cast<void *>(&slots[i])));
+        }
+
+        static CompletionSegment * get() {
+            CompletionSegment * s = NodeCache<CompletionSegment, 8>::get();
+            s->published.store(0, std::memory_order_relaxed);
+            s->next.store(nullptr, std::memory_order_relaxed);
+            return s;
+        }
+
+        static void put(CompletionSegment * s) {
+            NodeCache<CompletionSegment, 8>::put(s);
+        }
+    };
+}
+
 namespace gradylib {
     template<typename T>
     class CompletionPool {
-        struct Node {
-            T t;
-            Node *next = nullptr;
+        using Segment = gradylib_helpers::CompletionSegment<T>;
 
-            Node(T &&t) : t(std::move(t)) {}
+        // One thread's queue
+        struct Producer {
+            std::thread::id owner;
+            // Producers form a list that only grows
+            Producer * nextProducer = nullptr;
+            // Written by the owner.  Atomic so a new thread that inherits a dead thread's id can pick up its queue.
+            alignas(64) std::atomic<Segment *> tail;
+            // Consumer only
+            alignas(64) Segment * head;
+            size_t headIndex = 0;
 
-            Node(T const &t) : t(t) {}
+            explicit Producer(std::thread::id owner)
+                : owner(owner), tail(Segment::get())
+            {
+                head = tail.load(std::memory_order_relaxed);
+            }
         };
 
-        std::atomic<Node *> head;
+        uint64_t id = gradylib_helpers::nextCompletionPoolId.fetch_add(1, std::memory_order_relaxed);
+        std::atomic<Producer *> producers{nullptr};
+        std::mutex drainMutex;
+        // Where the next drain starts.  Guarded by drainMutex.
+        Producer * cursor = nullptr;
 
-    public:
-        CompletionPool()
-                : head(nullptr) {
+        Producer & registerProducer() {
+            std::thread::id self = std::this_thread::get_id();
+            Producer * first = producers.load(std::memory_order_acquire);
+            for (Producer * p = first; p; p = p->nextProducer) {
+                if (p->owner == self) {
+                    return *p;
+                }
+            }
+            Producer * p = new Producer(self);
+            p->nextProducer = first;
+            while (!producers.compare_exchange_weak(p->nextProducer, p, std::memory_order_release, std::memory_order_relaxed)) {
+            }
+            return *p;
+        }
+
+        // The calling thread's queue, found through a small per-thread cache keyed by pool id
+        Producer & localProducer() {
+            struct Entry {
+                uint64_t poolId = 0;
+                Producer * producer = nullptr;
+            };
+            thread_local std::array<Entry, 8> entries;
+            thread_local size_t victim = 0;
+            for (Entry & e : entries) {
+                if (e.poolId == id) {
+                    return *e.producer;
+                }
+            }
+            Producer & p = registerProducer();
+            entries[victim++ % entries.size()] = Entry{id, &p};
+            return p;
         }
 
+        // Owner only.  Returns the segment to write to and how many items it holds.
+        static std::pair<Segment *, size_t> reserveSlot(Producer & p) {
+            Segment * s = p.tail.load(std::memory_order_acquire);
+            size_t count = s->published.load(std::memory_order_acquire);
+            if (count < Segment::capacity) {
+                return {s, count};
+            }
+            Segment * next = Segment::get();
+            s->next.store(next, std::memory_order_release);
+            p.tail.store(next, std::memory_order_release);
+            return {next, 0};
+        }
+
+        // Consumer only.  The next item of p, or nullptr.  Frees segments that have been drained.
+        static T * peek(Producer & p) {
+            while (true) {
+                if (p.headIndex < p.head->published.load(std::memory_order_acquire)) {
+                    return p.head->slot(p.headIndex);
+                }
+                if (p.headIndex < Segment::capacity) {
+                    return nullptr;
+                }
+                Segment * next = p.head->next.load(std::memory_order_acquire);
+                if (!next) {
+                    return nullptr;
+                }
+                Segment::put(p.head);
+                p.head = next;
+                p.headIndex = 0;
+            }
+        }
+
+        static void pop(Producer & p, T * item) {
+            item->~T();
+            ++p.headIndex;
+        }
+
+    public:
+        CompletionPool() = default;
+
+        CompletionPool(CompletionPool const &) = delete;
+
+        CompletionPool & operator=(CompletionPool const &) = delete;
+
         ~CompletionPool() {
-            Node *n = head;
-            while (n) {
-                Node *next = n->next;
-                delete n;
-                n = next;
+            Producer * p = producers.load(std::memory_order_acquire);
+            while (p) {
+                while (T * item = peek(*p)) {
+                    pop(*p, item);
+                }
+                Segment::put(p->head);
+                Producer * next = p->nextProducer;
+                delete p;
+                p = next;
             }
         }
 
         template<typename U>
         requires std::same_as<std::remove_cvref_t<U>, T> // template being used to get perfect forwarding
-        void add(U &&t) {
-            Node *n = new Node(std::forward<U>(t)); // This will be deleted in CompletionPool::iterator::operator++
-            Node *expected = n->next = head.load(std::memory_order_relaxed);
-            // head is 'acquired' in CompeltionPool::begin
-            while (!head.compare_exchange_strong(expected, n, std::memory_order_release, std::memory_order_relaxed)) {
-                n->next = expected;
+        void add(U && t) {
+            Producer & p = localProducer();
+            auto [s, count] = reserveSlot(p);
+            new (s->slot(count)) T(std::forward<U>(t));
+            // The consumer acquires this in peek
+            s->published.store(count + 1, std::memory_order_release);
+        }
+
+        // Copies items in, publishing a segment's worth at a time
+        void addBatch(std::span<T const> items) {
+            Producer & p = localProducer();
+            size_t i = 0;
+            while (i < items.size()) {
+                auto [s, count] = reserveSlot(p);
+                size_t end = std::min(Segment::capacity, count + (items.size() - i));
+                try {
+                    for (; count < end; ++count, ++i) {
+                        new (s->slot(count)) T(items[i]);
+                    }
+                } catch (...) {
+                    s->published.store(count, std::memory_order_release);
+                    throw;
+                }
+                s->published.store(count, std::memory_order_release);
             }
         }
 
         /*
-         * CompletionPool::begin will steal the work list from the pool,
-         * and operator++ on the iterator will delete the list node.
+         * Calls f(T &&) on up to maxItems available items and returns how many.  Items added while drain runs may
+         * or may not be included.
+         */
+        template<typename F>
+        requires std::invocable<F &, T &&>
+        size_t drain(F && f, size_t maxItems = std::numeric_limits<size_t>::max()) {
+            std::lock_guard lg(drainMutex);
+            Producer * first = producers.load(std::memory_order_acquire);
+            if (!first || maxItems == 0) {
+                return 0;
+            }
+            Producer * start = cursor ? cursor : first;
+            Producer * p = start;
+            size_t n = 0;
+            do {
+                while (T * item = peek(*p)) {
+                    struct Pop {
+                        Producer & p;
+                        T * item;
+
+                        ~Pop() {
+                            pop(p, item);
+                        }
+                    } popper{*p, item};
+                    f(std::move(*item));
+                    if (++n == maxItems) {
+                        break;
+                    }
+                }
+                p = p->nextProducer ? p->nextProducer : first;
+            } while (n < maxItems && p != start);
+            cursor = p;
+            return n;
+        }
+
+        /*
+         * Iterates over the available items, consuming each one as it moves past it.  Holds the drain mutex while it
+         * exists.
          */
         class iterator {
-            Node *n;
-        public:
-            explicit iterator(Node *n)
-                    : n(n) {
+            std::unique_lock<std::mutex> lock;
+            Producer * producer = nullptr;
+            T * item = nullptr;
+
+            void findItem() {
+                while (producer) {
+                    item = peek(*producer);
+                    if (item) {
+                        return;
+                    }
+                    producer = producer->nextProducer;
+                }
             }
 
-            bool operator==(iterator const &other) const {
-                return n == other.n;
+        public:
+            iterator() = default;
+
+            explicit iterator(CompletionPool * pool)
+                : lock(pool->drainMutex), producer(pool->producers.load(std::memory_order_acquire))
+            {
+                findItem();
             }
 
-            bool operator!=(iterator const &other) const {
-                return n != other.n;
+            bool operator==(iterator const & other) const {
+                return item == other.item;
             }
 
-            T &operator*() {
-                return n->t;
+            T & operator*() {
+                return *item;
             }
 
-            iterator &operator++() {
-                if (!n) {
+            iterator & operator++() {
+                if (!item) {
                     return *this;
                 }
-                auto old = n;
-                n = n->next;
-                delete old;
+                pop(*producer, item);
+                item = nullptr;
+                findItem();
                 return *this;
             }
         };
 
         iterator begin() {
-            Node * n = head.load(std::memory_order_relaxed);
-            // head is 'released' in CompeltionPool::add
-            while (!head.compare_exchange_strong(n, nullptr, std::memory_order_acquire, std::memory_order_relaxed)) {
-                continue;
-            }
-            return iterator(n);
+            return iterator(this);
         }
 
         iterator end() {
-            return iterator(nullptr);
+            return iterator();
         }
     };
 }
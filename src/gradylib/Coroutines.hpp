@@ -0,0 +1,601 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * C++20 coroutines on a ThreadPool.
+ *
+ *     Task<size_t> countMatches(ThreadPool & tp, OpenHashMap<std::string, int> const & m, int threshold) {
+ *         co_await tp.schedule();                                       // continue on a worker
+ *         auto matches = m.parallelForEachAsync(tp, [threshold](auto & out, auto const & key, int value) {
+ *             if (value > threshold) out[key] = value;
+ *         });
+ *         auto merged = co_await std::move(matches);                    // the worker runs other tasks meanwhile
+ *         co_return merged.size();
+ *     }
+ *
+ *     auto [a, b] = syncWait(whenAll(countMatches(tp, m, 10), countMatches(tp, m, 100)));
+ *
+ * Task<T> is lazy: the body starts when the task is awaited, on the awaiting thread, and when it finishes the awaiting
+ * coroutine resumes on whichever thread finished it.  co_await tp.schedule() moves a coroutine onto the pool; it
+ * goes to the back of an injection queue, so it also serves as a yield.  Exceptions propagate to the awaiter.
+ *
+ * whenAll starts each task in turn on the current thread and resumes once all have finished.  The tasks run in
+ * parallel only past their own first co_await tp.schedule().  Results come back in order, with std::monostate standing
+ * in for void.  If any task threw, the first exception in order is rethrown after all have finished.
+ *
+ * syncWait runs a task from ordinary code, blocking the calling thread until it is done.  Don't call it from a worker
+ * of the pool the task needs.
+ *
+ * AsyncFuture is a future that can be co_awaited.  The awaiting coroutine suspends, and whoever completes the
+ * AsyncPromise queues it back on the pool, so nothing runs on its behalf while it waits.  That is what lets a few
+ * threads interleave many requests each waiting on a parallelForEachAsync.  AsyncFuture::get() blocks, for ordinary
+ * code.
+ *
+ * awaitFuture is the fallback for a std::future, which can't notify anyone.  While the future isn't ready the
+ * coroutine reschedules itself behind the other queued tasks, and when nothing else is queued it waits on the future
+ * for up to a millisecond before looking again, so it keeps a worker busy polling.  Prefer an AsyncFuture where the
+ * producer offers one.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<coroutine>
+#include<cstddef>
+#include<exception>
+#include<future>
+#include<memory>
+#include<mutex>
+#include<tuple>
+#include<type_traits>
+#include<utility>
+#include<variant>
+#include<vector>
+
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+    template<typename T = void>
+    class Task;
+}
+
+namespace gradylib_helpers {
+
+    template<typename T>
+    using NonVoid = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template<typename T>
+    class CoroutineResult {
+        std::variant<std::monostate, T, std::exception_ptr> result;
+
+    public:
+        template<typename U>
+        void set(U && value) {
+            result.template emplace<1>(std::forward<U>(value));
+        }
+
+        void setException(std::exception_ptr e) {
+            result.template emplace<2>(std::move(e));
+        }
+
+        T get() {
+            if (result.index() == 2) {
+                std::rethrow_exception(std::get<2>(result));
+            }
+            return std::move(std::get<1>(result));
+        }
+    };
+
+    template<>
+    class CoroutineResult<void> {
+        std::exception_ptr exception;
+
+    public:
+        void setException(std::exception_ptr e) {
+            exception = std::move(e);
+        }
+
+        void get() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+
+    template<typename T>
+    struct PromiseResult {
+        CoroutineResult<T> result;
+
+        template<typename U = T>
+        requires std::convertible_to<U &&, T>
+        void return_value(U && value) {
+            result.set(std::forward<U>(value));
+        }
+
+        void unhandled_exception() noexcept {
+            result.setException(std::current_exception());
+        }
+    };
+
+    template<>
+    struct PromiseResult<void> {
+        CoroutineResult<void> result;
+
+        void return_void() noexcept {
+        }
+
+        void unhandled_exception() noexcept {
+            result.setException(std::current_exception());
+        }
+    };
+
+    template<typename T>
+    struct TaskPromise : PromiseResult<T> {
+        std::coroutine_handle<> continuation;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromise> h) noexcept {
+                std::coroutine_handle<> next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        gradylib::Task<T> get_return_object() noexcept;
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+    };
+
+    /*
+     * Counts down arrivals.  The last one resumes continuation, or if there is none wakes a thread blocked in
+     * wait().
+     */
+    struct Latch {
+        std::atomic<size_t> count;
+        std::coroutine_handle<> continuation;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+
+        explicit Latch(size_t count)
+            : count(count)
+        {
+        }
+
+        std::coroutine_handle<> arrive() noexcept {
+            if (count.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return std::noop_coroutine();
+            }
+            if (continuation) {
+                return continuation;
+            }
+            std::lock_guard lg(mutex);
+            done = true;
+            cv.notify_all();
+            return std::noop_coroutine();
+        }
+
+        void wait() {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] {
+                return done;
+            });
+        }
+    };
+
+    template<typename T>
+    class NotifyTask;
+
+    template<typename T>
+    struct NotifyPromise : PromiseResult<T> {
+        Latch * latch = nullptr;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<NotifyPromise> h) noexcept {
+                return h.promise().latch->arrive();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        NotifyTask<T> get_return_object() noexcept {
+            return NotifyTask<T>(std::coroutine_handle<NotifyPromise>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+    };
+
+    // Runs a Task and arrives at a Latch when it's done.  Used by whenAll and syncWait.
+    template<typename T>
+    class NotifyTask {
+        std::coroutine_handle<NotifyPromise<T>> handle;
+
+    public:
+        using promise_type = NotifyPromise<T>;
+
+        explicit NotifyTask(std::coroutine_handle<NotifyPromise<T>> handle)
+            : handle(handle)
+        {
+        }
+
+        NotifyTask(NotifyTask && t) noexcept
+            : handle(std::exchange(t.handle, nullptr))
+        {
+        }
+
+        NotifyTask & operator=(NotifyTask &&) = delete;
+
+        ~NotifyTask() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        void start(Latch & latch) {
+            handle.promise().latch = &latch;
+            handle.resume();
+        }
+
+        NonVoid<T> result() {
+            if constexpr (std::is_void_v<T>) {
+                handle.promise().result.get();
+                return {};
+            } else {
+                return handle.promise().result.get();
+            }
+        }
+    };
+
+    template<typename T>
+    NotifyTask<T> makeNotifyTask(gradylib::Task<T> task) {
+        co_return co_await std::move(task);
+    }
+
+    // Starts the children, then suspends unless they have all finished already
+    template<typename Start>
+    struct LatchAwaiter {
+        Latch & latch;
+        Start start;
+
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            latch.continuation = h;
+            start();
+            // The latch counts one more than the number of children, so no child resumes h before this
+            return latch.count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    // Shared between an AsyncPromise and its AsyncFuture
+    template<typename T>
+    struct AsyncState {
+        gradylib::ThreadPool & tp;
+        std::mutex mutex;
+        std::condition_variable cv;
+        CoroutineResult<T> result;
+        bool ready = false;
+        std::coroutine_handle<> waiter;
+
+        explicit AsyncState(gradylib::ThreadPool & tp)
+            : tp(tp)
+        {
+        }
+    };
+}
+
+namespace gradylib {
+
+    // A lazily started coroutine producing a T.  Move only; destroying an unfinished task destroys its frame.
+    template<typename T>
+    class [[nodiscard]] Task {
+        std::coroutine_handle<gradylib_helpers::TaskPromise<T>> handle;
+
+    public:
+        using promise_type = gradylib_helpers::TaskPromise<T>;
+
+        explicit Task(std::coroutine_handle<promise_type> handle)
+            : handle(handle)
+        {
+        }
+
+        Task(Task && t) noexcept
+            : handle(std::exchange(t.handle, nullptr))
+        {
+        }
+
+        Task & operator=(Task && t) noexcept {
+            if (this != &t) {
+                if (handle) {
+                    handle.destroy();
+                }
+                handle = std::exchange(t.handle, nullptr);
+            }
+            return *this;
+        }
+
+        Task(Task const &) = delete;
+
+        Task & operator=(Task const &) = delete;
+
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        auto operator co_await() && noexcept {
+            struct Awaiter {
+                std::coroutine_handle<promise_type> handle;
+
+                bool await_ready() noexcept {
+                    return handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+
+                T await_resume() {
+                    return handle.promise().result.get();
+                }
+            };
+            return Awaiter{handle};
+        }
+    };
+
+    template<typename... Ts>
+    Task<std::tuple<gradylib_helpers::NonVoid<Ts>...>> whenAll(Task<Ts>... tasks) {
+        std::tuple<gradylib_helpers::NotifyTask<Ts>...> children(gradylib_helpers::makeNotifyTask(std::move(tasks))...);
+        gradylib_helpers::Latch latch(sizeof...(Ts) + 1);
+        auto start = [&]() {
+            std::apply([&](auto &... child) {
+                (child.start(latch), ...);
+            }, children);
+        };
+        co_await gradylib_helpers::LatchAwaiter<decltype(start)>{latch, start};
+        // Braces so the results are collected, and the first exception rethrown, in order
+        co_return std::apply([](auto &... child) {
+            return std::tuple<gradylib_helpers::NonVoid<Ts>...>{child.result()...};
+        }, children);
+    }
+
+    template<typename T>
+    Task<std::vector<gradylib_helpers::NonVoid<T>>> whenAll(std::vector<Task<T>> tasks) {
+        std::vector<gradylib_helpers::NotifyTask<T>> children;
+        children.reserve(tasks.size());
+        for (auto & task : tasks) {
+            children.push_back(gradylib_helpers::makeNotifyTask(std::move(task)));
+        }
+        gradylib_helpers::Latch latch(children.size() + 1);
+        auto start = [&]() {
+            for (auto & child : children) {
+                child.start(latch);
+            }
+        };
+        co_await gradylib_helpers::LatchAwaiter<decltype(start)>{latch, start};
+        std::vector<gradylib_helpers::NonVoid<T>> results;
+        results.reserve(children.size());
+        for (auto & child : children) {
+            results.push_back(child.result());
+        }
+        co_return results;
+    }
+
+    // Runs task to completion, blocking the calling thread
+    template<typename T>
+    T syncWait(Task<T> task) {
+        gradylib_helpers::Latch latch(1);
+        auto child = gradylib_helpers::makeNotifyTask(std::move(task));
+        child.start(latch);
+        latch.wait();
+        if constexpr (std::is_void_v<T>) {
+            child.result();
+        } else {
+            return child.result();
+        }
+    }
+
+    /*
+     * The result of an AsyncPromise.  co_await it from a coroutine, or call get() to block.  Either consumes the
+     * result, so do one of them once.
+     */
+    template<typename T>
+    class [[nodiscard]] AsyncFuture {
+        std::shared_ptr<gradylib_helpers::AsyncState<T>> state;
+
+    public:
+        explicit AsyncFuture(std::shared_ptr<gradylib_helpers::AsyncState<T>> state)
+            : state(std::move(state))
+        {
+        }
+
+        bool isReady() const {
+            std::lock_guard lg(state->mutex);
+            return state->ready;
+        }
+
+        T get() {
+            {
+                std::unique_lock lock(state->mutex);
+                state->cv.wait(lock, [this] {
+                    return state->ready;
+                });
+            }
+            return state->result.get();
+        }
+
+        auto operator co_await() && noexcept {
+            struct Awaiter {
+                std::shared_ptr<gradylib_helpers::AsyncState<T>> state;
+
+                bool await_ready() {
+                    std::lock_guard lg(state->mutex);
+                    return state->ready;
+                }
+
+                bool await_suspend(std::coroutine_handle<> h) {
+                    std::lock_guard lg(state->mutex);
+                    if (state->ready) {
+                        return false;
+                    }
+                    state->waiter = h;
+                    return true;
+                }
+
+                T await_resume() {
+                    return state->result.get();
+                }
+            };
+            return Awaiter{state};
+        }
+    };
+
+    /*
+     * Completed like a std::promise.  Completing it wakes get() and queues a coroutine awaiting the future on tp.
+     * Destroying it uncompleted completes it with std::future_errc::broken_promise.
+     */
+    template<typename T>
+    class AsyncPromise {
+        std::shared_ptr<gradylib_helpers::AsyncState<T>> state;
+        bool completed = false;
+
+        template<typename Set>
+        void complete(Set && set) {
+            if (completed) {
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            }
+            completed = true;
+            std::coroutine_handle<> waiter;
+            {
+                std::lock_guard lg(state->mutex);
+                set(state->result);
+                state->ready = true;
+                waiter = std::exchange(state->waiter, nullptr);
+                state->cv.notify_all();
+            }
+            if (waiter) {
+                state->tp.add([waiter]() {
+                    waiter.resume();
+                });
+            }
+        }
+
+    public:
+        explicit AsyncPromise(ThreadPool & tp)
+            : state(std::make_shared<gradylib_helpers::AsyncState<T>>(tp))
+        {
+        }
+
+        AsyncPromise(AsyncPromise && p) noexcept
+            : state(std::move(p.state)), completed(p.completed)
+        {
+        }
+
+        AsyncPromise & operator=(AsyncPromise &&) = delete;
+
+        AsyncPromise(AsyncPromise const &) = delete;
+
+        AsyncPromise & operator=(AsyncPromise const &) = delete;
+
+        ~AsyncPromise() {
+            if (state && !completed) {
+                set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        AsyncFuture<T> get_future() {
+            return AsyncFuture<T>(state);
+        }
+
+        template<typename U = T>
+        requires (!std::is_void_v<T> && std::convertible_to<U &&, T>)
+        void set_value(U && value) {
+            complete([&value](gradylib_helpers::CoroutineResult<T> & result) {
+                result.set(std::forward<U>(value));
+            });
+        }
+
+        void set_value() requires std::is_void_v<T> {
+            complete([](gradylib_helpers::CoroutineResult<T> &) {
+            });
+        }
+
+        void set_exception(std::exception_ptr e) {
+            complete([&e](gradylib_helpers::CoroutineResult<T> & result) {
+                result.setException(std::move(e));
+            });
+        }
+    };
+
+    template<typename T>
+    Task<T> awaitFuture(ThreadPool & tp, std::future<T> future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (tp.isEmpty()) {
+                future.wait_for(std::chrono::milliseconds(1));
+            }
+            co_await tp.schedule();
+        }
+        co_return future.get();
+    }
+}
+
+namespace gradylib_helpers {
+
+    template<typename T>
+    gradylib::Task<T> TaskPromise<T>::get_return_object() noexcept {
+        return gradylib::Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+    }
+}
@@ -0,0 +1,501 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * DurableOpenHashMapTC is an OpenHashMapTC whose mutations are appended to a write-ahead log so that a crash loses
+ * at most the last group of uncommitted operations, without rewriting the whole table on every save.
+ *
+ *     DurableOpenHashMapTC<int64_t, double> m("state_dir");
+ *     m.put(1, 2.5);
+ *     m.erase(7);
+ *     m.sync();        // everything above is now on disk
+ *     m.checkpoint();  // fold the log into a new checkpoint file
+ *
+ * The directory holds checkpoint.bin, written with OpenHashMapTC::write, and log segments wal.<n>.  Opening the
+ * directory maps the checkpoint copy on write and replays the segments in order.
+ *
+ * Group commit: operations are applied to the map and appended to an in-memory batch.  The batch is written with
+ * one write call (and, if enabled, one fdatasync) when it reaches groupCommitOps operations, every
+ * groupCommitInterval on a background thread, or on sync().  Writers keep going while a batch is being synced.
+ *
+ * Log format: a sequence of batches, each
+ *     uint64 magic, uint64 operation count, uint64 payload bytes, uint64 checksum of payload
+ * followed by the payload: per operation a uint8 opcode, the Key bytes, and for puts the Value bytes.  Replay stops
+ * at the first torn or corrupt batch and truncates the log there.
+ *
+ * checkpoint() copies the map (a memcpy for trivially copyable types), starts a new log segment, and writes the
+ * copy out without holding up writers.  Once the new checkpoint is renamed into place the older segments are
+ * deleted.  Replaying a segment that's already in the checkpoint is harmless because replay is idempotent.
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<cstring>
+#include<filesystem>
+#include<mutex>
+#include<optional>
+#include<shared_mutex>
+#include<sstream>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include"Exception.hpp"
+#include"MappedFile.hpp"
+#include"OpenHashMapTC.hpp"
+
+namespace gradylib {
+
+    struct WalOptions {
+        // Write the pending batch once it holds this many operations
+        size_t groupCommitOps = 4096;
+        // Background flush interval.  Zero disables the background thread; batches are then written only when full
+        // or on sync().
+        std::chrono::milliseconds groupCommitInterval{10};
+        // fdatasync after each batch.  Without it a batch survives a process crash but not a machine crash.
+        bool fsync = true;
+        // Checkpoint automatically from the background thread after this many logged operations.  Zero means only
+        // explicit checkpoint() calls.
+        size_t checkpointOps = 0;
+        int alignment = alignof(void*);
+    };
+}
+
+namespace gradylib_helpers {
+
+    inline constexpr uint64_t walBatchMagic = 0x4c41575944415247ULL;
+
+    inline uint64_t walChecksum(char const * data, size_t size) {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    inline void walSyncDescriptor(int fd) {
+#ifdef __linux__
+        int rc = fdatasync(fd);
+#else
+        int rc = fsync(fd);
+#endif
+        if (rc != 0) {
+            std::ostringstream sstr;
+            sstr << "fsync failed: " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+    }
+
+    inline void walWriteAll(int fd, char const * data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::ostringstream sstr;
+                sstr << "write to log failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            data += n;
+            size -= n;
+        }
+    }
+
+    inline void walSyncDirectory(std::filesystem::path const & dir) {
+        int fd = open(dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    class DurableOpenHashMapTC {
+        enum Opcode : uint8_t {
+            Put = 0,
+            Erase = 1
+        };
+
+        std::filesystem::path directory;
+        WalOptions options;
+
+        OpenHashMapTC<Key, Value, HashFunction> map;
+        std::shared_mutex mutable mapMutex;
+
+        // Guarded by mapMutex
+        std::string pending;
+        size_t pendingOps = 0;
+        size_t loggedOps = 0;
+        int logFd = -1;
+        uint64_t logSegment = 0;
+
+        // Held while a batch is written so batches reach the log in order
+        std::mutex flushMutex;
+        // Batches have been written to logFd since the last fsync.  Guarded by flushMutex.
+        bool unsynced = false;
+        std::mutex checkpointMutex;
+
+        std::thread flusher;
+        std::mutex flusherMutex;
+        std::condition_variable flusherConditionVariable;
+        bool stop = false;
+
+        std::filesystem::path checkpointPath() const {
+            return directory / "checkpoint.bin";
+        }
+
+        std::filesystem::path segmentPath(uint64_t segment) const {
+            return directory / ("wal." + std::to_string(segment));
+        }
+
+        std::vector<uint64_t> listSegments() const {
+            std::vector<uint64_t> segments;
+            for (auto const & entry : std::filesystem::directory_iterator(directory)) {
+                std::string name = entry.path().filename().string();
+                if (name.rfind("wal.", 0) != 0 || name.size() == 4) {
+                    continue;
+                }
+                if (!std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                    continue;
+                }
+                segments.push_back(std::stoull(name.substr(4)));
+            }
+            std::sort(segments.begin(), segments.end());
+            return segments;
+        }
+
+        int openSegment(uint64_t segment) {
+            int fd = open(segmentPath(segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open log " << segmentPath(segment) << ": " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            return fd;
+        }
+
+        // Apply the complete batches in a segment and cut off anything after the last one
+        void replaySegment(uint64_t segment) {
+            std::filesystem::path path = segmentPath(segment);
+            if (std::filesystem::file_size(path) == 0) {
+                return;
+            }
+            size_t good = 0;
+            {
+                MappedFile log(path);
+                char const * data = static_cast<char const *>(log.data());
+                size_t size = log.size();
+                constexpr size_t headerSize = 4 * sizeof(uint64_t);
+                while (size - good >= headerSize) {
+                    uint64_t header[4];
+                    memcpy(header, data + good, headerSize);
+                    auto [magic, count, payloadSize, checksum] = header;
+                    if (magic != gradylib_helpers::walBatchMagic || payloadSize > size - good - headerSize) {
+                        break;
+                    }
+                    char const * payload = data + good + headerSize;
+                    if (gradylib_helpers::walChecksum(payload, payloadSize) != checksum) {
+                        break;
+                    }
+                    char const * end = payload + payloadSize;
+                    for (uint64_t i = 0; i < count && payload < end; ++i) {
+                        uint8_t op = static_cast<uint8_t>(*payload++);
+                        Key key;
+                        memcpy(&key, payload, sizeof(Key));
+                        payload += sizeof(Key);
+                        if (op == Put) {
+                            Value value;
+                            memcpy(&value, payload, sizeof(Value));
+                            payload += sizeof(Value);
+                            map.put(key, value);
+                        } else {
+                            map.erase(key);
+                        }
+                        ++loggedOps;
+                    }
+                    good += headerSize + payloadSize;
+                }
+                if (good == size) {
+                    return;
+                }
+            }
+            std::filesystem::resize_file(path, good);
+        }
+
+        void appendRecord(Opcode op, Key const & key, Value const * value) {
+            pending.push_back(static_cast<char>(op));
+            pending.append(static_cast<char const *>(static_cast<void const *>(&key)), sizeof(Key));
+            if (value) {
+                pending.append(static_cast<char const *>(static_cast<void const *>(value)), sizeof(Value));
+            }
+            ++pendingOps;
+        }
+
+        static void writeBatch(int fd, std::string const & payload, size_t count) {
+            uint64_t header[4] = {gradylib_helpers::walBatchMagic, count, payload.size(),
+                                  gradylib_helpers::walChecksum(payload.data(), payload.size())};
+            std::string batch;
+            batch.reserve(sizeof(header) + payload.size());
+            batch.append(static_cast<char const *>(static_cast<void const *>(header)), sizeof(header));
+            batch.append(payload);
+            off_t start = lseek(fd, 0, SEEK_END);
+            try {
+                gradylib_helpers::walWriteAll(fd, batch.data(), batch.size());
+            } catch (...) {
+                // Don't leave a torn batch in front of the ones written after a retry
+                if (start >= 0) {
+                    ftruncate(fd, start);
+                }
+                throw;
+            }
+        }
+
+        void flush(bool doSync) {
+            std::lock_guard fl(flushMutex);
+            std::string batch;
+            size_t count;
+            int fd;
+            {
+                std::unique_lock lock(mapMutex);
+                batch.swap(pending);
+                count = pendingOps;
+                pendingOps = 0;
+                fd = logFd;
+            }
+            if (count > 0) {
+                try {
+                    writeBatch(fd, batch, count);
+                } catch (...) {
+                    std::unique_lock lock(mapMutex);
+                    pending.insert(0, batch);
+                    pendingOps += count;
+                    throw;
+                }
+                unsynced = true;
+            }
+            if (doSync && unsynced) {
+                gradylib_helpers::walSyncDescriptor(fd);
+                unsynced = false;
+            }
+        }
+
+        void flusherLoop() {
+            std::unique_lock lock(flusherMutex);
+            while (!stop) {
+                flusherConditionVariable.wait_for(lock, options.groupCommitInterval, [this] { return stop; });
+                if (stop) {
+                    break;
+                }
+                lock.unlock();
+                try {
+                    flush(options.fsync);
+                    if (options.checkpointOps > 0) {
+                        size_t logged;
+                        {
+                            std::shared_lock mapLock(mapMutex);
+                            logged = loggedOps;
+                        }
+                        if (logged >= options.checkpointOps) {
+                            checkpoint();
+                        }
+                    }
+                } catch (...) {
+                    // Retried on the next interval.  Unflushed operations stay in pending, and sync() or
+                    // checkpoint() called directly will throw the error.
+                }
+                lock.lock();
+            }
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        explicit DurableOpenHashMapTC(std::filesystem::path directory, WalOptions options = WalOptions{})
+            : directory(directory), options(options)
+        {
+            std::filesystem::create_directories(directory);
+            if (std::filesystem::exists(checkpointPath())) {
+                map = OpenHashMapTC<Key, Value, HashFunction>(checkpointPath(), MappingMode::CopyOnWrite);
+            }
+            std::vector<uint64_t> segments = listSegments();
+            for (uint64_t segment : segments) {
+                replaySegment(segment);
+            }
+            logSegment = segments.empty() ? 0 : segments.back();
+            logFd = openSegment(logSegment);
+            if (options.groupCommitInterval.count() > 0) {
+                flusher = std::thread([this] { flusherLoop(); });
+            }
+        }
+
+        DurableOpenHashMapTC(DurableOpenHashMapTC const &) = delete;
+
+        DurableOpenHashMapTC & operator=(DurableOpenHashMapTC const &) = delete;
+
+        ~DurableOpenHashMapTC() {
+            if (flusher.joinable()) {
+                {
+                    std::lock_guard lg(flusherMutex);
+                    stop = true;
+                }
+                flusherConditionVariable.notify_one();
+                flusher.join();
+            }
+            try {
+                flush(options.fsync);
+            } catch (...) {
+            }
+            close(logFd);
+        }
+
+        void put(Key const & key, Value const & value) {
+            bool full;
+            {
+                std::unique_lock lock(mapMutex);
+                map.put(key, value);
+                appendRecord(Put, key, &value);
+                ++loggedOps;
+                full = pendingOps >= options.groupCommitOps;
+            }
+            if (full) {
+                flush(options.fsync);
+            }
+        }
+
+        void erase(Key const & key) {
+            bool full;
+            {
+                std::unique_lock lock(mapMutex);
+                map.erase(key);
+                appendRecord(Erase, key, nullptr);
+                ++loggedOps;
+                full = pendingOps >= options.groupCommitOps;
+            }
+            if (full) {
+                flush(options.fsync);
+            }
+        }
+
+        std::optional<Value> get(Key const & key) const {
+            std::shared_lock lock(mapMutex);
+            auto lookup = map.get(key);
+            if (!lookup.has_value()) {
+                return std::nullopt;
+            }
+            return lookup.value();
+        }
+
+        bool contains(Key const & key) const {
+            std::shared_lock lock(mapMutex);
+            return map.contains(key);
+        }
+
+        Value at(Key const & key) const {
+            std::shared_lock lock(mapMutex);
+            return map.at(key);
+        }
+
+        size_t size() const {
+            std::shared_lock lock(mapMutex);
+            return map.size();
+        }
+
+        // Write and fsync everything put or erased so far
+        void sync() {
+            flush(true);
+        }
+
+        void checkpoint() {
+            std::lock_guard cl(checkpointMutex);
+            std::optional<OpenHashMapTC<Key, Value, HashFunction>> snapshot;
+            uint64_t oldSegment;
+            {
+                std::lock_guard fl(flushMutex);
+                std::string batch;
+                size_t count;
+                int oldFd;
+                {
+                    std::unique_lock lock(mapMutex);
+                    snapshot.emplace(map);
+                    batch.swap(pending);
+                    count = pendingOps;
+                    pendingOps = 0;
+                    loggedOps = 0;
+                    oldFd = logFd;
+                    oldSegment = logSegment;
+                    logFd = openSegment(oldSegment + 1);
+                    logSegment = oldSegment + 1;
+                }
+                // The old segment must be complete on disk before anything depends on the new checkpoint
+                try {
+                    if (count > 0) {
+                        writeBatch(oldFd, batch, count);
+                    }
+                    gradylib_helpers::walSyncDescriptor(oldFd);
+                } catch (...) {
+                    close(oldFd);
+                    std::unique_lock lock(mapMutex);
+                    pending.insert(0, batch);
+                    pendingOps += count;
+                    throw;
+                }
+                close(oldFd);
+                unsynced = false;
+            }
+            std::filesystem::path tmpPath = checkpointPath();
+            tmpPath += ".tmp";
+            snapshot->write(tmpPath.string(), options.alignment);
+            int fd = open(tmpPath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << tmpPath << ": " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            fsync(fd);
+            close(fd);
+            std::filesystem::rename(tmpPath, checkpointPath());
+            gradylib_helpers::walSyncDirectory(directory);
+            for (uint64_t segment : listSegments()) {
+                if (segment <= oldSegment) {
+                    std::filesystem::remove(segmentPath(segment));
+                }
+            }
+        }
+    };
+}
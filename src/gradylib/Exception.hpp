@@ -6,33 +6,59 @@
 
 #include<cxxabi.h>
 
+#include<atomic>
 #include<exception>
+#include<memory>
+#include<mutex>
 #include<source_location>
 #include<sstream>
 #include<string>
 
-#ifdef __APPLE__
+/*
+ * gradylib::Exception carries a stack trace of where it was thrown.  Only the raw return addresses are captured when
+ * the exception is constructed.  Symbolizing, demangling and formatting the message happen on the first call to
+ * what(), so exceptions that are caught and handled without being printed never pay for them.
+ *
+ * Define GRADYLIB_NO_STACKTRACE to compile trace capture out entirely, or call
+ * gradylib::Exception::setStackTraceCapture(false) to turn it off at runtime.
+ */
+
+namespace gradylib_helpers {
+    inline std::atomic<bool> GRADY_LIB_CAPTURE_STACKTRACE{true};
+}
+
+#if defined(__APPLE__) && !defined(GRADYLIB_NO_STACKTRACE)
 
 #include<execinfo.h>
 
+#include<vector>
+
 namespace gradylib {
     class Exception : public std::exception {
-        std::string message;
-    public:
-        Exception(std::string message)
-                : message(message) {
-        }
-
-        Exception(std::string message, std::source_location sourceLocation) {
+        struct Details {
+            std::string error;
+            std::source_location sourceLocation;
+            bool hasSourceLocation = false;
+            std::vector<void *> callstack;
+            std::once_flag formatted;
+            std::string message;
+        };
+        // Shared so copying the exception while it's in flight doesn't copy the trace
+        std::shared_ptr<Details> details;
+
+        static void format(Details & d) {
+            if (!d.hasSourceLocation) {
+                d.message = d.error;
+                return;
+            }
             std::ostringstream ostr;
-            ostr << "Exception at " << sourceLocation.file_name() << "(" << sourceLocation.line() <<
-                 ") in function: " << sourceLocation.function_name() << "\n";
-            ostr << "Exception message: " << message << "\n";
+            ostr << "Exception at " << d.sourceLocation.file_name() << "(" << d.sourceLocation.line() <<
+                 ") in function: " << d.sourceLocation.function_name() << "\n";
+            ostr << "Exception message: " << d.error << "\n";
             ostr << "Stacktrace:\n";
-            void *callstack[128];
-            int frames = backtrace(callstack, 128);
-            char **syms = backtrace_symbols(callstack, frames);
-            for (int i = 0; i < frames; ++i) {
+            int frames = d.callstack.size();
+            char **syms = frames > 0 ? backtrace_symbols(d.callstack.data(), frames) : nullptr;
+            for (int i = 0; syms && i < frames; ++i) {
                 int status = 0;
                 std::string frameLine(syms[i]);
                 char *demangledName{};
@@ -64,11 +90,39 @@ namespace gradylib {
                 }
             }
             free(syms);
-            Exception::message = ostr.str();
+            d.message = ostr.str();
+        }
+
+    public:
+        Exception(std::string message)
+            : details(std::make_shared<Details>())
+        {
+            details->error = std::move(message);
         }
 
-        char const *what() const noexcept {
-            return message.c_str();
+        Exception(std::string message, std::source_location sourceLocation)
+            : Exception(std::move(message))
+        {
+            details->sourceLocation = sourceLocation;
+            details->hasSourceLocation = true;
+            if (gradylib_helpers::GRADY_LIB_CAPTURE_STACKTRACE.load(std::memory_order_relaxed)) {
+                void *callstack[128];
+                int frames = backtrace(callstack, 128);
+                details->callstack.assign(callstack, callstack + frames);
+            }
+        }
+
+        static void setStackTraceCapture(bool capture) {
+            gradylib_helpers::GRADY_LIB_CAPTURE_STACKTRACE.store(capture, std::memory_order_relaxed);
+        }
+
+        char const *what() const noexcept override {
+            try {
+                std::call_once(details->formatted, format, *details);
+            } catch (...) {
+                return details->error.c_str();
+            }
+            return details->message.c_str();
         }
     };
 }
@@ -77,30 +131,69 @@ namespace gradylib {
 
 #else
 
+#ifndef GRADYLIB_NO_STACKTRACE
 #include<stacktrace>
+#endif
 
 namespace gradylib {
     class Exception : public std::exception {
-        std::string message;
-    public:
+        struct Details {
+            std::string error;
+#ifndef GRADYLIB_NO_STACKTRACE
+            std::stacktrace stackTrace;
+#endif
+            std::once_flag formatted;
+            std::string message;
+        };
+        // Shared so copying the exception while it's in flight doesn't copy the trace
+        std::shared_ptr<Details> details;
 
-        Exception(std::string error, std::basic_stacktrace<std::allocator<std::stacktrace_entry>> const st = std::basic_stacktrace<std::allocator<std::stacktrace_entry>>::current()) {
+        static void format(Details & d) {
             std::ostringstream sstr;
-            if(error.empty()) {
-                sstr << "No error message for Exception\n" << st;
+            if (d.error.empty()) {
+                sstr << "No error message for Exception\n";
             } else {
-                sstr << error << "\n" << st;
+                sstr << d.error << "\n";
             }
-            message = sstr.str();
+#ifndef GRADYLIB_NO_STACKTRACE
+            sstr << d.stackTrace;
+#endif
+            d.message = sstr.str();
         }
 
-        Exception(std::basic_stacktrace<std::allocator<std::stacktrace_entry>> const st = std::basic_stacktrace<std::allocator<std::stacktrace_entry>>::current())
-            : Exception("", st)
+    public:
+        // Captures the stack trace unless capture is disabled
+        Exception(std::string error = std::string())
+            : details(std::make_shared<Details>())
         {
+            details->error = std::move(error);
+#ifndef GRADYLIB_NO_STACKTRACE
+            if (gradylib_helpers::GRADY_LIB_CAPTURE_STACKTRACE.load(std::memory_order_relaxed)) {
+                details->stackTrace = std::stacktrace::current();
+            }
+#endif
+        }
+
+#ifndef GRADYLIB_NO_STACKTRACE
+        Exception(std::string error, std::stacktrace st)
+            : details(std::make_shared<Details>())
+        {
+            details->error = std::move(error);
+            details->stackTrace = std::move(st);
+        }
+#endif
+
+        static void setStackTraceCapture(bool capture) {
+            gradylib_helpers::GRADY_LIB_CAPTURE_STACKTRACE.store(capture, std::memory_order_relaxed);
         }
 
         char const * what() const noexcept override {
-            return message.c_str();
+            try {
+                std::call_once(details->formatted, format, *details);
+            } catch (...) {
+                return details->error.c_str();
+            }
+            return details->message.c_str();
         }
     };
 }
@@ -108,4 +201,3 @@ namespace gradylib {
 #define gradylibMakeException(str) gradylib::Exception(str)
 
 #endif
-
@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A front coded string dictionary, the string section of the files written by writeMappableCompressed.
+ *
+ * The strings are sorted, deduplicated and grouped in blocks.  The first string of a block is stored whole; each
+ * following one stores the length of the prefix it shares with its predecessor and the remaining suffix.  Vocabularies
+ * of URLs or paths typically shrink 3-5x.  A string is addressed by its id, its position in sorted order.
+ *
+ * Layout, starting 8 byte aligned:
+ *     uint64 count, uint64 blockSize, uint64 numBlocks
+ *     uint64 blockOffsets[numBlocks]   (relative to the start of the block data)
+ *     block data: varint length + bytes for the block head, then varint shared + varint suffix length + suffix bytes
+ *     padding to 8 bytes
+ *
+ * Decoding a string costs at most blockSize - 1 suffix copies.  Block heads decode to a view of the mapping with no
+ * copy at all.  Looking up the id of a string is a binary search over block heads followed by a scan of one block.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<cstdint>
+#include<limits>
+#include<optional>
+#include<ostream>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<vector>
+
+#include"BitPairSet.hpp"
+#include"Common.hpp"
+#include"Exception.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr uint32_t noStringId = std::numeric_limits<uint32_t>::max();
+
+    // Leading words of the writeMappableCompressed formats
+    inline constexpr uint64_t compressedS2IMagic = 0x3149325343464c47ULL; // "GLFCS2I1"
+    inline constexpr uint64_t compressedI2SMagic = 0x3153324943464c47ULL; // "GLFCI2S1"
+
+    inline void appendVarint(std::string & out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<char>(v));
+    }
+
+    inline uint64_t readVarint(unsigned char const *& p) {
+        uint64_t v = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            v |= static_cast<uint64_t>(*p & 0x7f) << shift;
+            shift += 7;
+            ++p;
+        }
+        v |= static_cast<uint64_t>(*p) << shift;
+        ++p;
+        return v;
+    }
+
+    /*
+     * Build the dictionary for the strings in the set slots of a hash table.  Returns the id of each slot's string,
+     * noStringId for slots that aren't set.  dictionary receives the sorted unique strings.
+     */
+    inline std::vector<uint32_t> buildFrontCodedDictionary(std::vector<std::string> const & strings,
+                                                           gradylib::BitPairSet const & setFlags,
+                                                           std::vector<std::string_view> & dictionary) {
+        dictionary.clear();
+        for (size_t i = 0; i < strings.size(); ++i) {
+            if (setFlags.isFirstSet(i)) {
+                dictionary.push_back(strings[i]);
+            }
+        }
+        std::sort(dictionary.begin(), dictionary.end());
+        dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+        if (dictionary.size() >= noStringId) {
+            throw gradylibMakeException("Too many distinct strings for a front coded dictionary");
+        }
+        std::vector<uint32_t> ids(strings.size(), noStringId);
+        for (size_t i = 0; i < strings.size(); ++i) {
+            if (setFlags.isFirstSet(i)) {
+                ids[i] = std::lower_bound(dictionary.begin(), dictionary.end(), std::string_view(strings[i])) - dictionary.begin();
+            }
+        }
+        return ids;
+    }
+
+    // sorted must be sorted and free of duplicates
+    inline void writeFrontCoded(std::ostream & ofs, std::vector<std::string_view> const & sorted, size_t blockSize = 16) {
+        uint64_t count = sorted.size();
+        uint64_t numBlocks = (count + blockSize - 1) / blockSize;
+        std::vector<uint64_t> blockOffsets;
+        blockOffsets.reserve(numBlocks);
+        std::string data;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            std::string_view s = sorted[i];
+            if (i % blockSize == 0) {
+                blockOffsets.push_back(data.size());
+                appendVarint(data, s.size());
+                data.append(s);
+            } else {
+                std::string_view prev = sorted[i - 1];
+                size_t shared = std::mismatch(s.begin(), s.begin() + std::min(s.size(), prev.size()), prev.begin()).first - s.begin();
+                appendVarint(data, shared);
+                appendVarint(data, s.size() - shared);
+                data.append(s.substr(shared));
+            }
+        }
+        uint64_t blockSize64 = blockSize;
+        ofs.write(charCast(&count), 8);
+        ofs.write(charCast(&blockSize64), 8);
+        ofs.write(charCast(&numBlocks), 8);
+        ofs.write(charCast(blockOffsets.data()), 8 * numBlocks);
+        ofs.write(data.data(), data.size());
+        writePad<8>(ofs);
+    }
+
+    class FrontCodedStrings {
+        uint64_t count = 0;
+        uint64_t blockSize = 1;
+        uint64_t numBlocks = 0;
+        uint64_t const * blockOffsets = nullptr;
+        unsigned char const * data = nullptr;
+
+        std::string_view blockHead(size_t block, unsigned char const *& p) const {
+            p = data + blockOffsets[block];
+            size_t len = readVarint(p);
+            std::string_view head(static_cast<char const *>(static_cast<void const *>(p)), len);
+            p += len;
+            return head;
+        }
+
+        static void decodeNext(unsigned char const *& p, std::string & buffer) {
+            size_t shared = readVarint(p);
+            size_t suffixLength = readVarint(p);
+            buffer.resize(shared);
+            buffer.append(static_cast<char const *>(static_cast<void const *>(p)), suffixLength);
+            p += suffixLength;
+        }
+
+    public:
+        FrontCodedStrings() = default;
+
+        explicit FrontCodedStrings(void const * startPtr) {
+            uint64_t const * header = static_cast<uint64_t const *>(startPtr);
+            count = header[0];
+            blockSize = header[1];
+            numBlocks = header[2];
+            blockOffsets = header + 3;
+            data = static_cast<unsigned char const *>(static_cast<void const *>(blockOffsets + numBlocks));
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        // The returned view points either into the mapping or into buffer
+        std::string_view get(uint32_t id, std::string & buffer) const {
+            unsigned char const * p;
+            std::string_view head = blockHead(id / blockSize, p);
+            size_t steps = id % blockSize;
+            if (steps == 0) {
+                return head;
+            }
+            buffer.assign(head);
+            for (size_t i = 0; i < steps; ++i) {
+                decodeNext(p, buffer);
+            }
+            return buffer;
+        }
+
+        std::optional<uint32_t> find(std::string_view key, std::string & buffer) const {
+            unsigned char const * p;
+            // Find the first block whose head is greater than key
+            size_t lo = 0;
+            size_t hi = numBlocks;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (blockHead(mid, p) <= key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo == 0) {
+                return std::nullopt;
+            }
+            size_t block = lo - 1;
+            std::string_view head = blockHead(block, p);
+            uint32_t id = block * blockSize;
+            if (head == key) {
+                return id;
+            }
+            buffer.assign(head);
+            size_t blockCount = std::min<uint64_t>(blockSize, count - id);
+            for (size_t i = 1; i < blockCount; ++i) {
+                decodeNext(p, buffer);
+                int cmp = std::string_view(buffer).compare(key);
+                if (cmp == 0) {
+                    return id + i;
+                }
+                if (cmp > 0) {
+                    break;
+                }
+            }
+            return std::nullopt;
+        }
+    };
+}
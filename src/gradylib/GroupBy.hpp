@@ -0,0 +1,287 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Radix partitioned group by.
+ *
+ *     GroupBy<OpenHashMapTC<int64_t, int64_t>> counts(tp, [](int64_t & count, auto const &) { ++count; });
+ *     counts.add(batch.begin(), batch.end());      // any number of times
+ *     PartitionedMap<OpenHashMapTC<int64_t, int64_t>> result = std::move(counts).finish();
+ *
+ *     auto sums = groupBy<OpenHashMap<std::string, double>>(tp, records, [](double & sum, double v) { sum += v; });
+ *
+ * Records are anything that unpacks into [key, value]: pairs, tuples or two member structs.  The aggregate is called
+ * as aggregate(map[key], value), so the first record of a key sees a default constructed value.
+ *
+ * The key space is split into 2^radixBits partitions by the top bits of a multiplicative mix of the map's hash, and
+ * each partition has its own map.  add() processes its input in windows of windowSize records: the pool counts the
+ * records of each chunk per partition, scatters pointers to them into partition order, and then aggregates each
+ * partition into its map in its own task.  No two tasks touch the same map, so there are no locks, and since the
+ * partitions hold disjoint keys the result is their concatenation with no merge.  Memory is one map's worth of
+ * entries plus a pointer per record of a window, where parallelForEach style partials need one full map per thread.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<bit>
+#include<concepts>
+#include<cstddef>
+#include<cstdint>
+#include<iterator>
+#include<ranges>
+#include<utility>
+#include<vector>
+
+#include"Exception.hpp"
+#include"ParallelTraversals.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    struct GroupByOptions {
+        // 0 picks enough partitions for a few per worker
+        int radixBits = 0;
+        // Records scattered per round.  Bounds the temporary memory at a pointer and a partition id per record.
+        size_t windowSize = 1 << 22;
+    };
+
+    /*
+     * The result of a GroupBy: one map per partition, each holding a disjoint set of keys.  Lookups go straight to the
+     * key's partition; iteration walks the partitions one after the other.
+     */
+    template<typename Map>
+    class PartitionedMap {
+        using Key = typename Map::key_type;
+        using Value = typename Map::mapped_type;
+
+        std::vector<Map> maps;
+        int radixBits;
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        PartitionedMap(std::vector<Map> && maps, int radixBits)
+            : maps(std::move(maps)), radixBits(radixBits)
+        {
+        }
+
+        static size_t partitionOf(size_t hash, int radixBits) {
+            if (radixBits == 0) {
+                return 0;
+            }
+            // The maps use hash % size for the slot, so take the partition from the other end of a mixed hash
+            return static_cast<size_t>(static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> (64 - radixBits);
+        }
+
+        size_t numPartitions() const {
+            return maps.size();
+        }
+
+        Map const & partition(size_t idx) const {
+            return maps[idx];
+        }
+
+        size_t size() const {
+            size_t ret = 0;
+            for (auto const & m : maps) {
+                ret += m.size();
+            }
+            return ret;
+        }
+
+        // Returns nullptr if key isn't in the map
+        template<typename KeyType>
+        Value const * find(KeyType const & key) const {
+            size_t hash = maps[0].hashKey(key);
+            return maps[partitionOf(hash, radixBits)].find(key, hash);
+        }
+
+        template<typename KeyType>
+        bool contains(KeyType const & key) const {
+            return find(key) != nullptr;
+        }
+
+        template<typename KeyType>
+        Value const & at(KeyType const & key) const {
+            Value const * value = find(key);
+            if (!value) {
+                throw gradylibMakeException("PartitionedMap doesn't contain key");
+            }
+            return *value;
+        }
+
+        class const_iterator {
+            PartitionedMap const * container;
+            size_t partitionIdx;
+            typename Map::const_iterator iter;
+
+            // Move past the end of empty partitions
+            void settle() {
+                while (partitionIdx + 1 < container->maps.size() && iter == container->maps[partitionIdx].end()) {
+                    ++partitionIdx;
+                    iter = container->maps[partitionIdx].begin();
+                }
+            }
+
+        public:
+            const_iterator(PartitionedMap const * container, size_t partitionIdx, typename Map::const_iterator iter)
+                : container(container), partitionIdx(partitionIdx), iter(iter)
+            {
+                settle();
+            }
+
+            const_iterator & operator++() {
+                ++iter;
+                settle();
+                return *this;
+            }
+
+            auto operator*() const {
+                return *iter;
+            }
+
+            bool operator==(const_iterator const & other) const {
+                return partitionIdx == other.partitionIdx && iter == other.iter;
+            }
+        };
+
+        const_iterator begin() const {
+            return const_iterator(this, 0, maps[0].begin());
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, maps.size() - 1, maps.back().end());
+        }
+    };
+
+    template<typename Map, typename Aggregate>
+    class GroupBy {
+        using Key = typename Map::key_type;
+        using Value = typename Map::mapped_type;
+
+        ThreadPool & tp;
+        Aggregate aggregate;
+        GroupByOptions options;
+        int radixBits;
+        std::vector<Map> maps;
+        // Scratch reused by every window
+        std::vector<uint16_t> partitionIds;
+        std::vector<size_t> counts;
+        std::vector<size_t> cursors;
+
+        template<typename It>
+        void addWindow(It first, size_t n) {
+            using Record = std::iter_value_t<It>;
+            size_t numPartitions = maps.size();
+            size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), 0, 0);
+            size_t numChunks = (n + chunk - 1) / chunk;
+            partitionIds.resize(n);
+            // counts[c * numPartitions + p] is the number of chunk c's records in partition p
+            counts.assign(numChunks * numPartitions, 0);
+            parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+                size_t * chunkCounts = &counts[c * numPartitions];
+                size_t stop = std::min(n, (c + 1) * chunk);
+                for (size_t i = c * chunk; i < stop; ++i) {
+                    auto const & [key, value] = first[i];
+                    uint16_t p = PartitionedMap<Map>::partitionOf(maps[0].hashKey(key), radixBits);
+                    partitionIds[i] = p;
+                    ++chunkCounts[p];
+                }
+            }, 1);
+            // Partition major order, so each partition's records are contiguous with the chunks in input order
+            cursors.resize(numChunks * numPartitions);
+            size_t total = 0;
+            for (size_t p = 0; p < numPartitions; ++p) {
+                for (size_t c = 0; c < numChunks; ++c) {
+                    cursors[c * numPartitions + p] = total;
+                    total += counts[c * numPartitions + p];
+                }
+            }
+            std::vector<Record const *> scattered(n);
+            parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+                size_t * next = &cursors[c * numPartitions];
+                size_t stop = std::min(n, (c + 1) * chunk);
+                for (size_t i = c * chunk; i < stop; ++i) {
+                    scattered[next[partitionIds[i]]++] = &first[i];
+                }
+            }, 1);
+            parallelFor(tp, size_t(0), numPartitions, [&](size_t p) {
+                // After the scatter each chunk's cursor for p sits at the start of the next chunk's records
+                size_t begin = p == 0 ? 0 : cursors[(numChunks - 1) * numPartitions + p - 1];
+                size_t end = cursors[(numChunks - 1) * numPartitions + p];
+                Map & m = maps[p];
+                for (size_t i = begin; i < end; ++i) {
+                    auto const & [key, value] = *scattered[i];
+                    aggregate(m[key], value);
+                }
+            }, 1);
+        }
+
+    public:
+        GroupBy(ThreadPool & tp, Aggregate aggregate, GroupByOptions options = GroupByOptions{})
+            : tp(tp), aggregate(std::move(aggregate)), options(options), radixBits(options.radixBits)
+        {
+            if (radixBits == 0) {
+                radixBits = std::bit_width(static_cast<size_t>(4 * tp.size() - 1));
+            }
+            if (radixBits < 0 || radixBits > 16) {
+                throw gradylibMakeException("GroupBy radixBits must be between 0 and 16");
+            }
+            if (options.windowSize == 0) {
+                throw gradylibMakeException("GroupBy windowSize must be positive");
+            }
+            maps.resize(size_t(1) << radixBits);
+        }
+
+        // Aggregates the records in [first, last).  Blocks until they're all in.
+        template<std::random_access_iterator It>
+        void add(It first, It last) {
+            while (first != last) {
+                size_t n = std::min<size_t>(last - first, options.windowSize);
+                addWindow(first, n);
+                first += n;
+            }
+        }
+
+        PartitionedMap<Map> finish() && {
+            return PartitionedMap<Map>(std::move(maps), radixBits);
+        }
+    };
+
+    template<typename Map, std::ranges::random_access_range Records, typename Aggregate>
+    PartitionedMap<Map> groupBy(ThreadPool & tp, Records const & records, Aggregate && aggregate,
+                                GroupByOptions options = GroupByOptions{}) {
+        GroupBy<Map, std::decay_t<Aggregate>> g(tp, std::forward<Aggregate>(aggregate), options);
+        g.add(std::ranges::begin(records), std::ranges::end(records));
+        return std::move(g).finish();
+    }
+
+    template<typename Map, std::ranges::random_access_range Records, typename Aggregate>
+    PartitionedMap<Map> groupBy(Records const & records, Aggregate && aggregate, GroupByOptions options = GroupByOptions{}) {
+        return groupBy<Map>(gradylib_helpers::getDefaultThreadPool(), records, std::forward<Aggregate>(aggregate), options);
+    }
+}
@@ -0,0 +1,221 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * hashJoin calls a function for every key present in two maps, accumulating into per thread partials that are merged
+ * with mergePartials, as parallelForEach does.
+ *
+ *     MMapS2IOpenHashMap<int> vocab("vocab.bin");
+ *     OpenHashMap<std::string, double> weights = ...;
+ *     std::future<OpenHashMap<int, double>> joined = hashJoin<OpenHashMap<int, double>>(tp, vocab, weights,
+ *         [](OpenHashMap<int, double> & out, std::string_view key, int idx, double weight) {
+ *             out[idx] = weight;
+ *         });
+ *
+ * The smaller map is split into ranges of slots, one task per thread placed as parallelForEach places them.  Each
+ * task probes the larger map in batches: it hashes a batch of keys and prefetches the slot each will land on, then
+ * looks them up, so the cache misses of a batch overlap instead of being taken one at a time.  The callback always
+ * gets the left map's value before the right map's, whichever side was iterated.
+ *
+ * Either side can be an OpenHashMap, OpenHashMapTC, MMapS2IOpenHashMap, MMapI2SOpenHashMap or MMapI2HRSOpenHashMap.
+ * The compressed maps can't be iterated by slot so they are only ever probed; one of the two maps must be one of the
+ * others.  The key passed to the callback has the iterated map's key type, e.g. a std::string_view for an
+ * MMapS2IOpenHashMap.  Views into a mapping are only valid while the map is alive.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<array>
+#include<concepts>
+#include<cstddef>
+#include<future>
+#include<memory>
+#include<mutex>
+#include<type_traits>
+#include<utility>
+
+#include"Common.hpp"
+#include"ParallelTraversals.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    // Keys looked up together by one pass of prefetches
+    inline constexpr size_t joinProbeBatch = 32;
+
+    // Maps that can be split into ranges of slots
+    template<typename Map>
+    concept JoinIterable = requires(Map const & m) {
+        { m.numSlots() } -> std::same_as<size_t>;
+        { m.size() } -> std::same_as<size_t>;
+    };
+
+    // Maps that can look up the keys of Other
+    template<typename Map, typename Other>
+    concept JoinProbeable = requires(Map const & m, typename Other::key_type const & key, size_t hash) {
+        { m.hashKey(key) } -> std::same_as<size_t>;
+        m.prefetch(hash);
+        m.find(key, hash);
+    };
+
+    // Whether hashJoin can iterate Iterated and probe Probed
+    template<typename Iterated, typename Probed>
+    concept JoinableAs = JoinIterable<Iterated> && JoinProbeable<Probed, Iterated>;
+
+    // find returns either a pointer or an optional; both are empty on a miss and dereference to the value
+    template<typename Found>
+    bool joinMatched(Found const & found) {
+        if constexpr (std::is_pointer_v<Found>) {
+            return found != nullptr;
+        } else {
+            return found.has_value();
+        }
+    }
+
+    /*
+     * Calls f(partial, key, iteratedValue, probedValue) for the keys in slots [start, stop) of iterated that are
+     * also in probed.
+     */
+    template<typename ReturnValue, typename Iterated, typename Probed, typename Callable>
+    void joinRange(ReturnValue & partial, Iterated const & iterated, Probed const & probed,
+                   size_t start, size_t stop, Callable & f) {
+        while (start < stop) {
+            size_t batchStop = std::min(stop, start + joinProbeBatch);
+            std::array<size_t, joinProbeBatch> hashes;
+            size_t n = 0;
+            iterated.forEachInSlots(start, batchStop, [&](auto && key, auto &&) {
+                hashes[n] = probed.hashKey(key);
+                probed.prefetch(hashes[n]);
+                ++n;
+            });
+            n = 0;
+            iterated.forEachInSlots(start, batchStop, [&](auto && key, auto && value) {
+                auto found = probed.find(key, hashes[n++]);
+                if (joinMatched(found)) {
+                    f(partial, key, value, *found);
+                }
+            });
+            start = batchStop;
+        }
+    }
+}
+
+namespace gradylib {
+
+    template<gradylib_helpers::Mergeable ReturnValue,
+            typename Left,
+            typename Right,
+            typename Callable,
+            typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+            typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+    requires (gradylib_helpers::JoinableAs<Left, Right> || gradylib_helpers::JoinableAs<Right, Left>) &&
+             std::is_copy_constructible_v<Callable> &&
+             std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+             std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+    std::future<ReturnValue> hashJoin(ThreadPool & tp,
+                                      Left const & left,
+                                      Right const & right,
+                                      Callable && f,
+                                      PartialInitializer && partialInitializer = PartialInitializer{},
+                                      FinalInitializer && finalInitializer = FinalInitializer{}) {
+        namespace gh = gradylib_helpers;
+        struct Result {
+            ReturnValue final;
+            std::mutex finalMutex;
+            std::promise<ReturnValue> promise;
+            size_t remainingThreads;
+
+            Result(ReturnValue && final, size_t remainingThreads)
+                : final(std::move(final)), remainingThreads(remainingThreads)
+            {
+            }
+        };
+
+        // Splits iterated's slots among the threads.  swapped means iterated is the right hand map.
+        auto run = [&]<bool swapped>(auto const & iterated, auto const & probed) {
+            size_t numSlots = iterated.numSlots();
+            size_t numThreads = std::max<size_t>(1, std::min<size_t>(tp.size(), numSlots));
+            std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), numThreads);
+            size_t start = 0;
+            for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                size_t stop = start + numSlots / numThreads + (threadIdx < numSlots % numThreads ? 1 : 0);
+                tp.addOnNode(tp.nodeForPart(threadIdx, numThreads),
+                             [start, stop, f, result, &iterated, &probed, partial=partialInitializer(threadIdx, numThreads)]() mutable {
+                    if constexpr (swapped) {
+                        auto callback = [&f](ReturnValue & out, auto && key, auto && rightValue, auto && leftValue) {
+                            f(out, key, leftValue, rightValue);
+                        };
+                        gh::joinRange(partial, iterated, probed, start, stop, callback);
+                    } else {
+                        gh::joinRange(partial, iterated, probed, start, stop, f);
+                    }
+                    std::lock_guard lg(result->finalMutex);
+                    mergePartials(result->final, partial);
+                    // The lock_guard is protecting remainingThreads
+                    if (result->remainingThreads == 1) {
+                        result->promise.set_value(std::move(result->final));
+                    }
+                    --result->remainingThreads;
+                });
+                start = stop;
+            }
+            return result->promise.get_future();
+        };
+
+        if constexpr (gh::JoinableAs<Left, Right> && gh::JoinableAs<Right, Left>) {
+            // Iterate the smaller map and probe the larger
+            if (right.size() < left.size()) {
+                return run.template operator()<true>(right, left);
+            }
+            return run.template operator()<false>(left, right);
+        } else if constexpr (gh::JoinableAs<Left, Right>) {
+            return run.template operator()<false>(left, right);
+        } else {
+            return run.template operator()<true>(right, left);
+        }
+    }
+
+    // This overload of hashJoin uses the default thread pool.
+    template<gradylib_helpers::Mergeable ReturnValue,
+            typename Left,
+            typename Right,
+            typename Callable,
+            typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+            typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+    requires (gradylib_helpers::JoinableAs<Left, Right> || gradylib_helpers::JoinableAs<Right, Left>) &&
+             std::is_copy_constructible_v<Callable> &&
+             std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+             std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+    std::future<ReturnValue> hashJoin(Left const & left,
+                                      Right const & right,
+                                      Callable && f,
+                                      PartialInitializer && partialInitializer = PartialInitializer{},
+                                      FinalInitializer && finalInitializer = FinalInitializer{}) {
+        return hashJoin<ReturnValue>(gradylib_helpers::getDefaultThreadPool(), left, right, std::forward<Callable>(f),
+                                     std::forward<PartialInitializer>(partialInitializer),
+                                     std::forward<FinalInitializer>(finalInitializer));
+    }
+}
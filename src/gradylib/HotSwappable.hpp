@@ -0,0 +1,174 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * HotSwappable holds a read only container (typically one of the mmap'd maps) that can be replaced while other
+ * threads are reading it.
+ *
+ *     HotSwappable<MMapS2IOpenHashMap<int>> vocab("vocab.bin");
+ *     // reader
+ *     auto guard = vocab.read();
+ *     int idx = (*guard)["token"];
+ *     // writer
+ *     vocab.swap("vocab_v2.bin");
+ *
+ * A read guard costs one atomic increment and one decrement on a counter that is, in the common case, private to
+ * the reading thread's cache line.  swap constructs the new container, publishes it with one atomic exchange, and
+ * then waits until every reader that might hold the old container has released its guard before destroying it
+ * (and so unmapping its file).  This is the two phase epoch flip used by userspace RCU.  Readers never block.
+ *
+ * Guards must not outlive the HotSwappable, and a thread must not call swap while holding a guard.
+ */
+
+#pragma once
+
+#include<array>
+#include<atomic>
+#include<concepts>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<utility>
+
+namespace gradylib {
+
+    template<typename MapType>
+    class HotSwappable {
+        static constexpr size_t numSlots = 64;
+
+        struct alignas(64) ReaderSlot {
+            std::atomic<int64_t> counts[2] = {0, 0};
+        };
+
+        std::atomic<MapType *> current;
+        std::atomic<uint64_t> epoch{0};
+        std::array<ReaderSlot, numSlots> mutable slots;
+        std::mutex writerMutex;
+
+        static size_t threadSlot() {
+            static std::atomic<size_t> nextSlot{0};
+            thread_local size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % numSlots;
+            return slot;
+        }
+
+        void waitForReaders(int parity) {
+            for (ReaderSlot & slot : slots) {
+                while (slot.counts[parity].load(std::memory_order_seq_cst) != 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // After this returns no reader can still hold a pointer loaded before the last exchange of current.
+        void synchronize() {
+            for (int phase = 0; phase < 2; ++phase) {
+                uint64_t oldEpoch = epoch.fetch_add(1, std::memory_order_seq_cst);
+                waitForReaders(oldEpoch & 1);
+            }
+        }
+
+    public:
+
+        class ReadGuard {
+            std::atomic<int64_t> * count;
+            MapType const * map;
+
+        public:
+            ReadGuard(std::atomic<int64_t> * count, MapType const * map)
+                : count(count), map(map)
+            {
+            }
+
+            ReadGuard(ReadGuard const &) = delete;
+
+            ReadGuard & operator=(ReadGuard const &) = delete;
+
+            ReadGuard(ReadGuard && g) noexcept
+                : count(g.count), map(g.map)
+            {
+                g.count = nullptr;
+                g.map = nullptr;
+            }
+
+            ReadGuard & operator=(ReadGuard &&) = delete;
+
+            ~ReadGuard() {
+                if (count) {
+                    count->fetch_sub(1, std::memory_order_release);
+                }
+            }
+
+            MapType const & operator*() const {
+                return *map;
+            }
+
+            MapType const * operator->() const {
+                return map;
+            }
+        };
+
+        template<typename... Args>
+        requires std::constructible_from<MapType, Args...>
+        explicit HotSwappable(Args &&... args)
+            : current(new MapType(std::forward<Args>(args)...))
+        {
+        }
+
+        explicit HotSwappable(std::unique_ptr<MapType> map)
+            : current(map.release())
+        {
+        }
+
+        HotSwappable(HotSwappable const &) = delete;
+
+        HotSwappable & operator=(HotSwappable const &) = delete;
+
+        ~HotSwappable() {
+            delete current.load(std::memory_order_relaxed);
+        }
+
+        ReadGuard read() const {
+            std::atomic<int64_t> * count = &slots[threadSlot()].counts[epoch.load(std::memory_order_relaxed) & 1];
+            // seq_cst so the increment is ordered before the load of current; synchronize depends on it
+            count->fetch_add(1, std::memory_order_seq_cst);
+            return ReadGuard(count, current.load(std::memory_order_seq_cst));
+        }
+
+        // Replace the container with one built from args (e.g. a path).  Construction happens before any
+        // synchronization so a slow load doesn't delay readers or other writers.
+        template<typename... Args>
+        requires std::constructible_from<MapType, Args...>
+        void swap(Args &&... args) {
+            swap(std::make_unique<MapType>(std::forward<Args>(args)...));
+        }
+
+        void swap(std::unique_ptr<MapType> newMap) {
+            std::lock_guard lg(writerMutex);
+            MapType * old = current.exchange(newMap.release(), std::memory_order_seq_cst);
+            synchronize();
+            delete old;
+        }
+    };
+}
@@ -31,11 +31,14 @@ SOFTWARE.
 
 #include<filesystem>
 #include<fstream>
+#include<optional>
 #include<sstream>
 #include<string>
 #include<string_view>
 #include<type_traits>
 
+#include"AsyncFileWriter.hpp"
+#include"MappedFile.hpp"
 #include"OpenHashMap.hpp"
 #include"OpenHashMapTC.hpp"
 
@@ -45,45 +48,51 @@ namespace gradylib {
     requires std::is_integral_v<IndexType> && std::is_integral_v<IntermediateIndexType>
     class MMapI2HRSOpenHashMap {
         OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction> intMap;
-        void const * stringMapping;
-        int fd = -1;
-        void * memoryMapping = nullptr;
-        size_t mappingSize = 0;
+        void const * stringMapping = nullptr;
+        MappedFile mappedFile;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const *ptr = static_cast<std::byte const *>(startPtr);
+            std::byte const *base = ptr;
+            size_t intMapOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            stringMapping = ptr;
+            intMap = OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>(static_cast<void const *>(base + intMapOffset));
+        }
+
+        std::string_view stringAt(IntermediateIndexType offset) const {
+            std::byte const * ptr = static_cast<std::byte const *>(stringMapping) + offset;
+            int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
+            ptr += 4;
+            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), len);
+        }
+
     public:
         typedef IndexType key_type;
         typedef std::string mapped_type;
 
-        explicit MMapI2HRSOpenHashMap(std::filesystem::path filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream sstr;
-                sstr << "Error opening file " << filename;
-                throw gradylibMakeException(sstr.str());
-            }
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                close(fd);
-                memoryMapping = nullptr;
-                std::ostringstream sstr;
-                sstr << "memory map failed: " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            size_t intMapOffset = *static_cast<size_t*>(static_cast<void*>(ptr));
-            ptr += 8;
-            stringMapping = ptr;
-            intMap = OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>(base + intMapOffset);
+        explicit MMapI2HRSOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
         }
 
-        ~MMapI2HRSOpenHashMap() {
-            if (memoryMapping) {
-                munmap(memoryMapping, mappingSize);
-                close(fd);
-            }
+        explicit MMapI2HRSOpenHashMap(char const * filename)
+            : MMapI2HRSOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of Builder::write.  The region is not copied or owned.
+        explicit MMapI2HRSOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit MMapI2HRSOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
         }
 
         bool contains(IndexType idx) const {
@@ -91,16 +100,50 @@ namespace gradylib {
         }
 
         std::string_view at(IndexType idx) const {
-            if (!contains(idx)) {
+            std::optional<std::string_view> value = find(idx);
+            if (!value.has_value()) {
                 std::ostringstream sstr;
                 sstr << "Map doesn't contain " << idx;
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte const * base = static_cast<std::byte const *>(static_cast<void const *>(stringMapping));
-            std::byte const * ptr = base + intMap.at(idx);
-            int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
-            ptr += 4;
-            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), len);
+            return *value;
+        }
+
+        std::optional<std::string_view> find(IndexType idx) const {
+            return find(idx, intMap.hashKey(idx));
+        }
+
+        // The hash this map uses for idx, for passing to find when looking the same key up in several maps
+        size_t hashKey(IndexType idx) const {
+            return intMap.hashKey(idx);
+        }
+
+        // hash must be hashKey(idx)
+        std::optional<std::string_view> find(IndexType idx, size_t hash) const {
+            IntermediateIndexType const * offset = intMap.find(idx, hash);
+            if (!offset) {
+                return std::nullopt;
+            }
+            return stringAt(*offset);
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            intMap.prefetch(hash);
+        }
+
+        // The length of the arrays backing the map, the range of slots forEachInSlots takes
+        size_t numSlots() const {
+            return intMap.numSlots();
+        }
+
+        // Calls f(key, value) for the entries in slots [start, stop)
+        template<typename Callable>
+        requires std::invocable<Callable &, IndexType, std::string_view>
+        void forEachInSlots(size_t start, size_t stop, Callable && f) const {
+            intMap.forEachInSlots(start, stop, [this, &f](IndexType key, IntermediateIndexType offset) {
+                f(key, stringAt(offset));
+            });
         }
 
         size_t size() const {
@@ -133,12 +176,13 @@ namespace gradylib {
             }
 
             std::string_view at(IndexType idx) const {
-                if (!contains(idx)) {
+                IntermediateIndexType const * strIdx = intMap.find(idx);
+                if (!strIdx) {
                     std::ostringstream sstr;
                     sstr << "Map doesn't contain " << idx;
                     throw gradylibMakeException(sstr.str());
                 }
-                return strings.at(intMap.at(idx));
+                return strings[*strIdx];
             }
 
             void reserve(size_t size) {
@@ -158,6 +202,11 @@ namespace gradylib {
                     sstr << "Problem opening file " << filename;
                     throw gradylibMakeException(sstr.str());
                 }
+                write(ofs, alignment);
+            }
+
+            void write(std::ostream & ofs, int alignment = alignof(void*)) {
+                size_t startFileOffset = ofs.tellp();
                 size_t intMapOffset = 0;
                 ofs.write(static_cast<char*>(static_cast<void*>(&intMapOffset)), 8);
                 OpenHashMapTC<IntermediateIndexType, IntermediateIndexType> stringOffsetMap;
@@ -182,16 +231,25 @@ namespace gradylib {
                     char t = 0;
                     ofs.write(&t, 1);
                 }
-                intMapOffset = ofs.tellp();
+                intMapOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
                 intMap.write(ofs, alignment);
+                auto endPos = ofs.tellp();
 
-                ofs.seekp(0, std::ios::beg);
+                ofs.seekp(startFileOffset, std::ios::beg);
                 ofs.write(static_cast<char*>(static_cast<void*>(&intMapOffset)), 8);
+                ofs.seekp(endPos);
 
                 intMap.clear();
                 stringMap.clear();
                 strings.clear();
             }
+
+            // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+            std::future<void> writeAsync(std::filesystem::path filename, int alignment = alignof(void*), ThreadPool * tp = nullptr) {
+                return writeFileAsync(std::move(filename), [this, alignment](std::ostream & os) {
+                    write(os, alignment);
+                }, tp);
+            }
         };
 
         class const_iterator {
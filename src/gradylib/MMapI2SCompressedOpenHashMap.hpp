@@ -0,0 +1,242 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<optional>
+#include<string>
+#include<string_view>
+
+#include"AltIntHash.hpp"
+#include"BitPairSet.hpp"
+#include"Common.hpp"
+#include"FrontCodedStrings.hpp"
+#include"MappedFile.hpp"
+#include"OpenHashMap.hpp"
+
+namespace gradylib {
+
+    /*
+     * The variant of MMapI2SOpenHashMap for files written by writeMappableCompressed.
+     *
+     * Values are decoded from the front coded dictionary.  at(key, buffer) decodes into a caller provided buffer;
+     * at(key) and operator[] decode into a per-thread scratch buffer, so the returned view is only good until the
+     * next lookup on the same thread.  Values that start a dictionary block are returned as views of the mapping.
+     */
+    template<typename IndexType, template<typename> typename HashFunction = gradylib::AltHash>
+    class MMapI2SCompressedOpenHashMap {
+        IndexType const * keys = nullptr;
+        uint32_t const * valueIds = nullptr;
+        gradylib_helpers::FrontCodedStrings dictionary;
+        BitPairSet setFlags;
+        size_t mapSize = 0;
+        size_t keySize = 0;
+        MappedFile mappedFile;
+        HashFunction<IndexType> hashFunction = HashFunction<IndexType>{};
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        static std::string & scratch() {
+            thread_local std::string buffer;
+            return buffer;
+        }
+
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const * base = static_cast<std::byte const *>(startPtr);
+            uint64_t const * header = static_cast<uint64_t const *>(startPtr);
+            if (header[0] != gradylib_helpers::compressedI2SMagic) {
+                throw gradylibMakeException("Not a compressed integer to string map file");
+            }
+            if (header[3] != gradylib_helpers::hashFingerprint<IndexType>(hashFunction)) {
+                throw gradylibMakeException("MMapI2SCompressedOpenHashMap hash function doesn't match the one the file was written with");
+            }
+            mapSize = header[1];
+            keySize = header[2];
+            keys = static_cast<IndexType const *>(static_cast<void const *>(header + 7));
+            valueIds = static_cast<uint32_t const *>(static_cast<void const *>(base + header[4]));
+            dictionary = gradylib_helpers::FrontCodedStrings(base + header[5]);
+            setFlags = BitPairSet(static_cast<void const *>(base + header[6]));
+        }
+
+        // Returns keySize if the key isn't in the map
+        size_t findSlot(IndexType key, size_t hash) const {
+            if (keySize == 0) {
+                return keySize;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                IndexType k = keys[idx];
+                if (isSet && k == key) {
+                    return idx;
+                }
+                if (wasSet && k == key) {
+                    return keySize;
+                }
+                ++idx;
+                idx = idx == keySize ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return keySize;
+        }
+
+    public:
+        typedef IndexType key_type;
+        typedef std::string mapped_type;
+
+        MMapI2SCompressedOpenHashMap() = default;
+
+        MMapI2SCompressedOpenHashMap(MMapI2SCompressedOpenHashMap const &) = delete;
+
+        MMapI2SCompressedOpenHashMap &operator=(MMapI2SCompressedOpenHashMap const &) = delete;
+
+        MMapI2SCompressedOpenHashMap(MMapI2SCompressedOpenHashMap &&m) noexcept
+                : keys(m.keys), valueIds(m.valueIds), dictionary(m.dictionary), setFlags(std::move(m.setFlags)),
+                  mapSize(m.mapSize), keySize(m.keySize), mappedFile(std::move(m.mappedFile)) {
+            m.keys = nullptr;
+            m.valueIds = nullptr;
+            m.mapSize = 0;
+            m.keySize = 0;
+        }
+
+        MMapI2SCompressedOpenHashMap &operator=(MMapI2SCompressedOpenHashMap &&m) noexcept {
+            keys = m.keys;
+            valueIds = m.valueIds;
+            dictionary = m.dictionary;
+            setFlags = std::move(m.setFlags);
+            mapSize = m.mapSize;
+            keySize = m.keySize;
+            mappedFile = std::move(m.mappedFile);
+            m.keys = nullptr;
+            m.valueIds = nullptr;
+            m.mapSize = 0;
+            m.keySize = 0;
+            return *this;
+        }
+
+        explicit MMapI2SCompressedOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
+        }
+
+        explicit MMapI2SCompressedOpenHashMap(char const * filename)
+            : MMapI2SCompressedOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of writeMappableCompressed.  The region is not copied or owned.
+        explicit MMapI2SCompressedOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        explicit MMapI2SCompressedOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
+        }
+
+        std::string_view at(IndexType key, std::string & buffer) const {
+            std::optional<std::string_view> value = find(key, buffer);
+            if (!value.has_value()) {
+                std::ostringstream sstr;
+                sstr << key << " not found in map";
+                throw gradylibMakeException(sstr.str());
+            }
+            return *value;
+        }
+
+        std::string_view at(IndexType key) const {
+            return at(key, scratch());
+        }
+
+        std::string_view operator[](IndexType key) const {
+            return at(key, scratch());
+        }
+
+        bool contains(IndexType key) const {
+            return findSlot(key, hashFunction(key)) != keySize;
+        }
+
+        // The returned view points into the mapping or into buffer
+        std::optional<std::string_view> find(IndexType key, std::string & buffer) const {
+            return find(key, hashFunction(key), buffer);
+        }
+
+        // Decodes into the per-thread scratch buffer, like at(key)
+        std::optional<std::string_view> find(IndexType key) const {
+            return find(key, hashFunction(key), scratch());
+        }
+
+        // The hash this map uses for key, for passing to find when looking the same key up in several maps
+        size_t hashKey(IndexType key) const {
+            return hashFunction(key);
+        }
+
+        // hash must be hashKey(key).  The returned view points into the mapping or into buffer.
+        std::optional<std::string_view> find(IndexType key, size_t hash, std::string & buffer) const {
+            size_t idx = findSlot(key, hash);
+            if (idx == keySize) {
+                return std::nullopt;
+            }
+            return dictionary.get(valueIds[idx], buffer);
+        }
+
+        // Decodes into the per-thread scratch buffer, like at(key)
+        std::optional<std::string_view> find(IndexType key, size_t hash) const {
+            return find(key, hash, scratch());
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            if (keySize == 0) {
+                return;
+            }
+            size_t idx = hash % keySize;
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keys[idx]);
+            __builtin_prefetch(&valueIds[idx]);
+        }
+
+        size_t size() const {
+            return mapSize;
+        }
+
+        OpenHashMap<IndexType, std::string, HashFunction> clone() const {
+            OpenHashMap<IndexType, std::string, HashFunction> ret;
+            ret.reserve(size());
+            std::string buffer;
+            for (size_t i = 0; i < keySize; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    ret.put(keys[i], std::string(dictionary.get(valueIds[i], buffer)));
+                }
+            }
+            return ret;
+        }
+    };
+}
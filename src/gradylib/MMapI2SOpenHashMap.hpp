@@ -30,11 +30,14 @@ SOFTWARE.
 
 #include<filesystem>
 #include<iostream>
+#include<optional>
 #include<string>
 #include<string_view>
 
 #include"AltIntHash.hpp"
 #include"BitPairSet.hpp"
+#include"Common.hpp"
+#include"MappedFile.hpp"
 #include"OpenHashMap.hpp"
 
 namespace gradylib {
@@ -50,9 +53,7 @@ namespace gradylib {
         BitPairSet setFlags;
         size_t mapSize = 0;
         size_t keySize = 0;
-        int fd = -1;
-        void * memoryMapping = nullptr;
-        size_t mappingSize = 0;
+        MappedFile mappedFile;
         HashFunction<IndexType> hashFunction = HashFunction<IndexType>{};
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
@@ -62,6 +63,28 @@ namespace gradylib {
             return std::string_view(p, len);
         }
 
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const *ptr = static_cast<std::byte const *>(startPtr);
+            std::byte const *base = ptr;
+            mapSize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            keySize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            size_t fingerprint = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            if (fingerprint != gradylib_helpers::hashFingerprint<IndexType>(hashFunction)) {
+                throw gradylibMakeException("MMapI2SOpenHashMap hash function doesn't match the one the file was written with");
+            }
+            size_t bitPairSetOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            valueOffsets = static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8 * keySize;
+            keys = static_cast<IndexType const *>(static_cast<void const *>(ptr));
+            ptr += sizeof(IndexType) * keySize;
+            values = static_cast<void const *>(ptr);
+            setFlags = BitPairSet(static_cast<void const *>(base + bitPairSetOffset));
+        }
+
     public:
         typedef IndexType key_type;
         typedef std::string mapped_type;
@@ -73,22 +96,16 @@ namespace gradylib {
         MMapI2SOpenHashMap &operator=(MMapI2SOpenHashMap const &) = delete;
 
         MMapI2SOpenHashMap(MMapI2SOpenHashMap &&m) noexcept
-                : setFlags(std::move(m.setFlags)) {
+                : setFlags(std::move(m.setFlags)), mappedFile(std::move(m.mappedFile)) {
             valueOffsets = m.valueOffsets;
             keys = m.keys;
             values = m.values;
             mapSize = m.mapSize;
             keySize = m.keySize;
-            fd = m.fd;
-            memoryMapping = m.memoryMapping;
-            mappingSize = m.mappingSize;
             m.keys = nullptr;
             m.values = nullptr;
             m.mapSize = 0;
             m.keySize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
         }
 
         MMapI2SOpenHashMap &operator=(MMapI2SOpenHashMap &&m) noexcept {
@@ -98,71 +115,70 @@ namespace gradylib {
             setFlags = std::move(m.setFlags);
             mapSize = m.mapSize;
             keySize = m.keySize;
-            fd = m.fd;
-            memoryMapping = m.memoryMapping;
-            mappingSize = m.mappingSize;
+            mappedFile = std::move(m.mappedFile);
             m.keys = nullptr;
             m.values = nullptr;
             m.mapSize = 0;
             m.keySize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
             return *this;
         }
 
-        explicit MMapI2SOpenHashMap(std::filesystem::path filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream sstr;
-                sstr << "Couldn't open " << filename << " in MMapI2SOpenHashMap";
-                throw gradylibMakeException(sstr.str());
-            }
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                close(fd);
-                memoryMapping = nullptr;
-                std::ostringstream sstr;
-                sstr << "mmap failed " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            valueOffsets = static_cast<size_t*>(static_cast<void *>(ptr));
-            ptr += 8 * keySize;
-            keys = static_cast<IndexType *>(static_cast<void *>(ptr));
-            ptr += sizeof(IndexType) * keySize;
-            values = static_cast<void *>(ptr);
-            setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+        explicit MMapI2SOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
         }
 
-        ~MMapI2SOpenHashMap() {
-            if (memoryMapping) {
-                munmap(memoryMapping, mappingSize);
-                close(fd);
-            }
+        explicit MMapI2SOpenHashMap(char const * filename)
+            : MMapI2SOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of writeMappable.  The region is not copied or owned.
+        explicit MMapI2SOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit MMapI2SOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
         }
 
         std::string_view operator[](IndexType key) const {
-            if (keySize == 0) {
+            std::optional<std::string_view> value = find(key);
+            if (!value.has_value()) {
                 std::ostringstream sstr;
                 sstr << key << " not found in map";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash;
-            size_t idx;
-            size_t startIdx;
+            return *value;
+        }
 
-            hash = hashFunction(key);
-            idx = hash % keySize;
-            startIdx = idx;
+        bool contains(IndexType key) const {
+            return find(key).has_value();
+        }
+
+        std::optional<std::string_view> find(IndexType key) const {
+            return find(key, hashFunction(key));
+        }
+
+        /*
+         * The hash this map uses for key.  When the same key is looked up in several maps sharing a hash function,
+         * compute it once and pass it to find.
+         */
+        size_t hashKey(IndexType key) const {
+            return hashFunction(key);
+        }
+
+        // hash must be hashKey(key)
+        std::optional<std::string_view> find(IndexType key, size_t hash) const {
+            if (keySize == 0) {
+                return std::nullopt;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 IndexType k = keys[idx];
                 if (isSet && k == key) {
@@ -170,43 +186,40 @@ namespace gradylib {
                     return getValue(valuePtr);
                 }
                 if (wasSet && k == key) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
+                    return std::nullopt;
                 }
                 ++idx;
                 idx = idx == keySize ? 0 : idx;
-                if (startIdx == idx) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
+                if (startIdx == idx) break;
             }
-            std::ostringstream sstr;
-            sstr << key << " not found in map";
-            throw gradylibMakeException(sstr.str());
+            return std::nullopt;
         }
 
-        bool contains(IndexType key) const {
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
             if (keySize == 0) {
-                return false;
+                return;
             }
-            size_t hash = hashFunction(key);
             size_t idx = hash % keySize;
-            size_t startIdx = idx;
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                IndexType k = keys[idx];
-                if (isSet && k == key) {
-                    return true;
-                }
-                if (wasSet && k == key) {
-                    return false;
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keys[idx]);
+            __builtin_prefetch(&valueOffsets[idx]);
+        }
+
+        // The length of the arrays backing the map, the range of slots forEachInSlots takes
+        size_t numSlots() const {
+            return keySize;
+        }
+
+        // Calls f(key, value) for the entries in slots [start, stop)
+        template<typename Callable>
+        requires std::invocable<Callable &, IndexType, std::string_view>
+        void forEachInSlots(size_t start, size_t stop, Callable && f) const {
+            for (size_t i = start; i < stop; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    f(keys[i], getValue(static_cast<std::byte const *>(values) + valueOffsets[i]));
                 }
-                ++idx;
-                idx = idx == keySize ? 0 : idx;
-                if (startIdx == idx) break;
             }
-            return false;
         }
 
         size_t size() const {
@@ -0,0 +1,222 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<functional>
+#include<optional>
+#include<string>
+#include<string_view>
+
+#include"AltIntHash.hpp"
+#include"BitPairSet.hpp"
+#include"Common.hpp"
+#include"FrontCodedStrings.hpp"
+#include"MappedFile.hpp"
+#include"OpenHashMap.hpp"
+
+namespace gradylib {
+
+    /*
+     * The variant of MMapS2IOpenHashMap for files written by writeMappableCompressed.
+     *
+     * A lookup first finds the key's id in the front coded dictionary (a binary search over block heads and a scan
+     * of one block), then probes the hash table comparing 4 byte ids instead of strings.  Keys that aren't in the map
+     * are usually rejected by the dictionary search alone.
+     */
+    template<typename IndexType, template<typename> typename HashFunction = gradylib::AltHash>
+    class MMapS2ICompressedOpenHashMap {
+        uint32_t const * keyIds = nullptr;
+        IndexType const * values = nullptr;
+        gradylib_helpers::FrontCodedStrings dictionary;
+        BitPairSet setFlags;
+        size_t mapSize = 0;
+        size_t keySize = 0;
+        MappedFile mappedFile;
+        HashFunction<std::string_view> hashFunction = HashFunction<std::string_view>{};
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        static std::string & scratch() {
+            thread_local std::string buffer;
+            return buffer;
+        }
+
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const * base = static_cast<std::byte const *>(startPtr);
+            uint64_t const * header = static_cast<uint64_t const *>(startPtr);
+            if (header[0] != gradylib_helpers::compressedS2IMagic) {
+                throw gradylibMakeException("Not a compressed string to integer map file");
+            }
+            if (header[3] != gradylib_helpers::hashFingerprint<std::string_view>(hashFunction)) {
+                throw gradylibMakeException("MMapS2ICompressedOpenHashMap hash function doesn't match the one the file was written with");
+            }
+            mapSize = header[1];
+            keySize = header[2];
+            keyIds = static_cast<uint32_t const *>(static_cast<void const *>(header + 7));
+            values = static_cast<IndexType const *>(static_cast<void const *>(base + header[4]));
+            dictionary = gradylib_helpers::FrontCodedStrings(base + header[5]);
+            setFlags = BitPairSet(static_cast<void const *>(base + header[6]));
+        }
+
+        // Returns keySize if the key isn't in the map
+        size_t findSlot(std::string_view key, size_t hash) const {
+            if (keySize == 0) {
+                return keySize;
+            }
+            std::optional<uint32_t> id = dictionary.find(key, scratch());
+            if (!id.has_value()) {
+                return keySize;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                if (isSet && keyIds[idx] == *id) {
+                    return idx;
+                }
+                ++idx;
+                idx = idx == keySize ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return keySize;
+        }
+
+    public:
+        typedef std::string key_type;
+        typedef IndexType mapped_type;
+
+        MMapS2ICompressedOpenHashMap() = default;
+
+        MMapS2ICompressedOpenHashMap(MMapS2ICompressedOpenHashMap const &) = delete;
+
+        MMapS2ICompressedOpenHashMap &operator=(MMapS2ICompressedOpenHashMap const &) = delete;
+
+        MMapS2ICompressedOpenHashMap(MMapS2ICompressedOpenHashMap &&m) noexcept
+                : keyIds(m.keyIds), values(m.values), dictionary(m.dictionary), setFlags(std::move(m.setFlags)),
+                  mapSize(m.mapSize), keySize(m.keySize), mappedFile(std::move(m.mappedFile)) {
+            m.keyIds = nullptr;
+            m.values = nullptr;
+            m.mapSize = 0;
+            m.keySize = 0;
+        }
+
+        MMapS2ICompressedOpenHashMap &operator=(MMapS2ICompressedOpenHashMap &&m) noexcept {
+            keyIds = m.keyIds;
+            values = m.values;
+            dictionary = m.dictionary;
+            setFlags = std::move(m.setFlags);
+            mapSize = m.mapSize;
+            keySize = m.keySize;
+            mappedFile = std::move(m.mappedFile);
+            m.keyIds = nullptr;
+            m.values = nullptr;
+            m.mapSize = 0;
+            m.keySize = 0;
+            return *this;
+        }
+
+        explicit MMapS2ICompressedOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
+        }
+
+        explicit MMapS2ICompressedOpenHashMap(char const * filename)
+            : MMapS2ICompressedOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of writeMappableCompressed.  The region is not copied or owned.
+        explicit MMapS2ICompressedOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        explicit MMapS2ICompressedOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
+        }
+
+        IndexType operator[](std::string_view key) const {
+            IndexType const * value = find(key);
+            if (!value) {
+                std::ostringstream sstr;
+                sstr << key << " not found in map";
+                throw gradylibMakeException(sstr.str());
+            }
+            return *value;
+        }
+
+        bool contains(std::string_view key) const {
+            return findSlot(key, hashFunction(key)) != keySize;
+        }
+
+        // Returns nullptr if key isn't in the map
+        IndexType const * find(std::string_view key) const {
+            return find(key, hashFunction(key));
+        }
+
+        // The hash this map uses for key, for passing to find when looking the same key up in several maps
+        size_t hashKey(std::string_view key) const {
+            return hashFunction(key);
+        }
+
+        // hash must be hashKey(key).  Returns nullptr if key isn't in the map.
+        IndexType const * find(std::string_view key, size_t hash) const {
+            size_t idx = findSlot(key, hash);
+            return idx == keySize ? nullptr : &values[idx];
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            if (keySize == 0) {
+                return;
+            }
+            size_t idx = hash % keySize;
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keyIds[idx]);
+            __builtin_prefetch(&values[idx]);
+        }
+
+        size_t size() const {
+            return mapSize;
+        }
+
+        OpenHashMap<std::string, IndexType, HashFunction> clone() const {
+            OpenHashMap<std::string, IndexType, HashFunction> ret;
+            ret.reserve(size());
+            std::string buffer;
+            for (size_t i = 0; i < keySize; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    ret.put(std::string(dictionary.get(keyIds[i], buffer)), values[i]);
+                }
+            }
+            return ret;
+        }
+    };
+}
@@ -33,15 +33,20 @@ SOFTWARE.
 #include<string>
 #include<string_view>
 
+#include"AltIntHash.hpp"
 #include"BitPairSet.hpp"
+#include"Common.hpp"
+#include"MappedFile.hpp"
 #include"OpenHashMap.hpp"
 
 namespace gradylib {
 
     /*
-     * This is a readonly data structure for quickly loading an OpenHashMap<std::string, IndexType> from disk
+     * This is a readonly data structure for quickly loading an OpenHashMap<std::string, IndexType, HashFunction> from
+     * disk.  HashFunction<std::string_view> must agree with the HashFunction<std::string> the file was written with;
+     * the writer records a fingerprint of the hash and loading throws if it doesn't match.
      */
-    template<typename IndexType>
+    template<typename IndexType, template<typename> typename HashFunction = gradylib::AltHash>
     class MMapS2IOpenHashMap {
         int64_t const *keyOffsets = nullptr;
         void const * keys = nullptr;
@@ -49,9 +54,8 @@ namespace gradylib {
         BitPairSet setFlags;
         size_t mapSize = 0;
         size_t keySize = 0;
-        int fd = -1;
-        void * memoryMapping = nullptr;
-        size_t mappingSize = 0;
+        MappedFile mappedFile;
+        HashFunction<std::string_view> hashFunction = HashFunction<std::string_view>{};
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
         std::string_view getKey(std::byte const * ptr) const {
@@ -65,6 +69,29 @@ namespace gradylib {
             return keyPtr + 4 + len + gradylib_helpers::getPadLength<4>(len);
         }
 
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const *ptr = static_cast<std::byte const *>(startPtr);
+            std::byte const *base = ptr;
+            mapSize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            keySize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            size_t fingerprint = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            if (fingerprint != gradylib_helpers::hashFingerprint<std::string_view>(hashFunction)) {
+                throw gradylibMakeException("MMapS2IOpenHashMap hash function doesn't match the one the file was written with");
+            }
+            size_t valueOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            size_t bitPairSetOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            keyOffsets = static_cast<int64_t const *>(static_cast<void const *>(ptr));
+            ptr += 8 * keySize;
+            keys = static_cast<void const *>(ptr);
+            values = static_cast<IndexType const *>(static_cast<void const *>(base + valueOffset));
+            setFlags = BitPairSet(static_cast<void const *>(base + bitPairSetOffset));
+        }
+
     public:
         typedef std::string key_type;
         typedef IndexType mapped_type;
@@ -76,142 +103,103 @@ namespace gradylib {
         MMapS2IOpenHashMap &operator=(MMapS2IOpenHashMap const &) = delete;
 
         MMapS2IOpenHashMap(MMapS2IOpenHashMap &&m) noexcept
-                : setFlags(std::move(m.setFlags)) {
+                : setFlags(std::move(m.setFlags)), mappedFile(std::move(m.mappedFile)) {
             keyOffsets = m.keyOffsets;
             keys = m.keys;
             values = m.values;
             mapSize = m.mapSize;
             keySize = m.keySize;
-            fd = m.fd;
-            memoryMapping = m.memoryMapping;
-            mappingSize = m.mappingSize;
             m.keyOffsets = nullptr;
             m.keys = nullptr;
             m.values = nullptr;
             m.mapSize = 0;
             m.keySize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
         }
 
         MMapS2IOpenHashMap &operator=(MMapS2IOpenHashMap &&m) noexcept {
+            if (this == &m) {
+                return *this;
+            }
             keyOffsets = m.keyOffsets;
             keys = m.keys;
             values = m.values;
             setFlags = std::move(m.setFlags);
             mapSize = m.mapSize;
             keySize = m.keySize;
-            fd = m.fd;
-            memoryMapping = m.memoryMapping;
-            mappingSize = m.mappingSize;
+            mappedFile = std::move(m.mappedFile);
             m.keyOffsets = nullptr;
             m.keys = nullptr;
             m.values = nullptr;
             m.mapSize = 0;
             m.keySize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
             return *this;
         }
 
-        explicit MMapS2IOpenHashMap(std::filesystem::path filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream sstr;
-                sstr << "Couldn't open " << filename << " in MMapS2IOpenHashMap";
-                throw gradylibMakeException(sstr.str());
-            }
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                close(fd);
-                memoryMapping = nullptr;
-                std::ostringstream sstr;
-                sstr << "mmap failed " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t valueOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keyOffsets = static_cast<int64_t *>(static_cast<void *>(ptr));
-            ptr += 8 * keySize;
-            keys = static_cast<void *>(static_cast<void *>(ptr));
-            values = static_cast<IndexType *>(static_cast<void *>(base + valueOffset));
-            setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+        explicit MMapS2IOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
         }
 
-        ~MMapS2IOpenHashMap() {
-            if (memoryMapping) {
-                munmap(memoryMapping, mappingSize);
-                close(fd);
-            }
+        explicit MMapS2IOpenHashMap(char const * filename)
+            : MMapS2IOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of writeMappable.  The region is not copied or owned.
+        explicit MMapS2IOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit MMapS2IOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
         }
 
         IndexType operator[](std::string_view key) const {
-            if (keySize == 0) {
+            IndexType const * value = find(key);
+            if (!value) {
                 std::ostringstream sstr;
                 sstr << key << " not found in map";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash;
-            size_t idx;
-            size_t startIdx;
-
-            hash = std::hash<std::string_view>{}(key);
-            idx = hash % keySize;
-            startIdx = idx;
-            std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[idx];
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                std::string_view k = getKey(keyPtr);
-                if (isSet && k == key) {
-                    return values[idx];
-                }
-                if (wasSet && k == key) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
-                keyPtr = incKeyPtr(keyPtr);
-                ++idx;
-                if (idx == keySize) {
-                    idx = 0;
-                    keyPtr = static_cast<std::byte const *>(keys);
-                }
-                if (startIdx == idx) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
-            }
-            std::ostringstream sstr;
-            sstr << key << " not found in map";
-            throw gradylibMakeException(sstr.str());
+            return *value;
         }
 
         bool contains(std::string_view key) const {
+            return find(key) != nullptr;
+        }
+
+        // Returns nullptr if key isn't in the map
+        IndexType const * find(std::string_view key) const {
+            return find(key, hashFunction(key));
+        }
+
+        /*
+         * The hash this map uses for key.  When the same key is looked up in several maps sharing a hash function,
+         * compute it once and pass it to find.
+         */
+        size_t hashKey(std::string_view key) const {
+            return hashFunction(key);
+        }
+
+        // hash must be hashKey(key).  Returns nullptr if key isn't in the map.
+        IndexType const * find(std::string_view key, size_t hash) const {
             if (keySize == 0) {
-                return false;
+                return nullptr;
             }
-            size_t hash = std::hash<std::string_view>{}(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
             std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[idx];
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 std::string_view k = getKey(keyPtr);
                 if (isSet && k == key) {
-                    return true;
+                    return &values[idx];
                 }
                 if (wasSet && k == key) {
-                    return false;
+                    return nullptr;
                 }
                 keyPtr = incKeyPtr(keyPtr);
                 ++idx;
@@ -221,7 +209,34 @@ namespace gradylib {
                 }
                 if (startIdx == idx) break;
             }
-            return false;
+            return nullptr;
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            if (keySize == 0) {
+                return;
+            }
+            size_t idx = hash % keySize;
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keyOffsets[idx]);
+            __builtin_prefetch(&values[idx]);
+        }
+
+        // The length of the arrays backing the map, the range of slots forEachInSlots takes
+        size_t numSlots() const {
+            return keySize;
+        }
+
+        // Calls f(key, value) for the entries in slots [start, stop)
+        template<typename Callable>
+        requires std::invocable<Callable &, std::string_view, IndexType const &>
+        void forEachInSlots(size_t start, size_t stop, Callable && f) const {
+            for (size_t i = start; i < stop; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    f(getKey(static_cast<std::byte const *>(keys) + keyOffsets[i]), values[i]);
+                }
+            }
         }
 
         size_t size() const {
@@ -285,8 +300,8 @@ namespace gradylib {
             return const_iterator(keySize, this);
         }
 
-        OpenHashMap<std::string, IndexType> clone() const {
-            OpenHashMap<std::string, IndexType> ret;
+        OpenHashMap<std::string, IndexType, HashFunction> clone() const {
+            OpenHashMap<std::string, IndexType, HashFunction> ret;
             ret.reserve(size());
             for (auto && [sview, idx] : *this) {
                 ret.put(sview, idx);
@@ -294,23 +309,23 @@ namespace gradylib {
             return ret;
         }
 
-        template<typename>
+        template<typename, template<typename> typename>
         friend void GRADY_LIB_MOCK_MMapS2IOpenHashMap_MMAP();
 
-        template<typename>
+        template<typename, template<typename> typename>
         friend void GRADY_LIB_DEFAULT_MMapS2IOpenHashMap_MMAP();
     };
 
-    template<typename IndexType>
+    template<typename IndexType, template<typename> typename HashFunction = gradylib::AltHash>
     void GRADY_LIB_MOCK_MMapS2IOpenHashMap_MMAP() {
-        MMapS2IOpenHashMap<IndexType>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+        MMapS2IOpenHashMap<IndexType, HashFunction>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
             return MAP_FAILED;
         };
     }
 
-    template<typename IndexType>
+    template<typename IndexType, template<typename> typename HashFunction = gradylib::AltHash>
     void GRADY_LIB_DEFAULT_MMapS2IOpenHashMap_MMAP() {
-        MMapS2IOpenHashMap<IndexType>::mmapFunc = mmap;
+        MMapS2IOpenHashMap<IndexType, HashFunction>::mmapFunc = mmap;
     }
 }
 
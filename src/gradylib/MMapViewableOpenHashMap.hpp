@@ -31,22 +31,26 @@ SOFTWARE.
 #include<filesystem>
 #include<functional>
 #include<fstream>
+#include<optional>
 #include<string>
 #include<utility>
 
 #include"AltIntHash.hpp"
+#include"AsyncFileWriter.hpp"
+#include"MappedFile.hpp"
 #include"OpenHashMap.hpp"
 #include"OpenHashMapTC.hpp"
 
 namespace gradylib {
 
-    template<typename ValueType>
-    concept serializable_global = requires (std::ofstream & os, ValueType const & v) {
+    // Stream is what the value is serialized to: an ofstream by write(filename), an ostream by writeAsync
+    template<typename ValueType, typename Stream = std::ofstream>
+    concept serializable_global = requires (Stream & os, ValueType const & v) {
         serialize(os, v);
     };
 
-    template<typename ValueType>
-    concept serializable_method = requires (std::ofstream & os, ValueType const & v) {
+    template<typename ValueType, typename Stream = std::ofstream>
+    concept serializable_method = requires (Stream & os, ValueType const & v) {
         { v.serialize(os) } -> std::same_as<void>;
     };
 
@@ -68,35 +72,48 @@ namespace gradylib {
     class MMapViewableOpenHashMap {
         OpenHashMapTC<Key, int64_t, HashFunction> valueOffsets;
         std::byte const * valuePtr = nullptr;
-        int fd = -1;
-        size_t mappingSize = 0;
-        void const * memoryMapping = nullptr;
+        MappedFile mappedFile;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
-    public:
+        void setFromMemoryMapping(void const * startPtr) {
+            std::byte const * base = static_cast<std::byte const *>(startPtr);
+            size_t mapOffset = *static_cast<size_t const *>(static_cast<void const *>(base));
+            valuePtr = base + 8;
+            valueOffsets = OpenHashMapTC<Key, int64_t, HashFunction>(static_cast<void const *>(base + mapOffset));
+        }
 
-        MMapViewableOpenHashMap(std::filesystem::path filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream sstr;
-                sstr << "Error opening file " << filename;
-                throw gradylibMakeException(sstr.str());
+        static decltype(auto) makeValueView(std::byte const * ptr) {
+            if constexpr (viewable_global<Value>) {
+                Value const * typePtr = nullptr;
+                return makeView(ptr, typePtr);
+            } else {
+                return Value::makeView(ptr);
             }
+        }
 
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                close(fd);
-                memoryMapping = nullptr;
-                std::ostringstream sstr;
-                sstr << "memory map failed: " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
+    public:
 
-            std::byte const * base = static_cast<std::byte const *>(memoryMapping);
-            size_t mapOffset = *static_cast<size_t const *>(static_cast<void const *>(base));
-            valuePtr = base + 8;
-            valueOffsets = OpenHashMapTC<Key, int64_t, HashFunction>(static_cast<void const *>(base + mapOffset));
+        MMapViewableOpenHashMap(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
+        }
+
+        explicit MMapViewableOpenHashMap(char const * filename)
+            : MMapViewableOpenHashMap(std::filesystem::path(filename))
+        {
+        }
+
+        // Load from a region of memory holding the output of Builder::write.  The region is not copied or owned.
+        explicit MMapViewableOpenHashMap(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit MMapViewableOpenHashMap(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data());
         }
 
         bool contains(Key const & key) const {
@@ -108,25 +125,33 @@ namespace gradylib {
         }
 
         decltype(auto) at(Key const & key) const {
-            if (!valueOffsets.contains(key)) {
+            int64_t const * offset = valueOffsets.find(key);
+            if (!offset) {
                 std::ostringstream sstr;
                 sstr << "Map doesn't contain key";
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte const * ptr = valuePtr + valueOffsets.at(key);
-            if constexpr (viewable_global<Value>) {
-                Value const * typePtr = nullptr;
-                return makeView(ptr, typePtr);
-            } else {
-                return Value::makeView(ptr);
-            }
+            return makeValueView(valuePtr + *offset);
         }
 
-        ~MMapViewableOpenHashMap() {
-            if (memoryMapping) {
-                munmap(const_cast<void *>(memoryMapping), mappingSize);
-                close(fd);
+        // Returns an empty optional if key isn't in the map
+        auto find(Key const & key) const {
+            return find(key, valueOffsets.hashKey(key));
+        }
+
+        // The hash this map uses for key, for passing to find when looking the same key up in several maps
+        size_t hashKey(Key const & key) const {
+            return valueOffsets.hashKey(key);
+        }
+
+        // hash must be hashKey(key).  Returns an empty optional if key isn't in the map.
+        auto find(Key const & key, size_t hash) const {
+            using View = std::remove_cvref_t<decltype(makeValueView(valuePtr))>;
+            int64_t const * offset = valueOffsets.find(key, hash);
+            if (!offset) {
+                return std::optional<View>();
             }
+            return std::optional<View>(makeValueView(valuePtr + *offset));
         }
 
         class const_iterator {
@@ -210,8 +235,32 @@ namespace gradylib {
             }
 
             void write(std::filesystem::path filename, int alignment = alignof(void*)) {
+                std::ofstream ofs(filename, std::ios::binary);
+                if (ofs.fail()) {
+                    std::ostringstream sstr;
+                    sstr << "Unable to open file for writing " << filename;
+                    throw gradylibMakeException(sstr.str());
+                }
+                write(ofs, alignment);
+            }
 
-                auto writePad = [pad=std::vector<char>(alignment, 0)](std::ofstream & ofs, int alignment) {
+            /*
+             * Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+             * Values are serialized to a std::ostream, so their serialize must accept one.
+             */
+            std::future<void> writeAsync(std::filesystem::path filename, int alignment = alignof(void*), ThreadPool * tp = nullptr)
+            requires (serializable_global<Value, std::ostream> || serializable_method<Value, std::ostream>) {
+                return writeFileAsync(std::move(filename), [this, alignment](std::ostream & os) {
+                    write(os, alignment);
+                }, tp);
+            }
+
+            // The map is written at the start of ofs
+            template<typename Stream>
+            requires std::derived_from<Stream, std::ostream> &&
+                     (serializable_global<Value, Stream> || serializable_method<Value, Stream>)
+            void write(Stream & ofs, int alignment = alignof(void*)) {
+                auto writePad = [pad=std::vector<char>(alignment, 0)](Stream & ofs, int alignment) {
                     int64_t pos = ofs.tellp();
                     int padLength = alignment - pos % alignment;
                     if (padLength == alignment) {
@@ -220,13 +269,6 @@ namespace gradylib {
                     ofs.write(pad.data(), padLength);
                 };
 
-                std::ofstream ofs(filename, std::ios::binary);
-                if (ofs.fail()) {
-                    std::ostringstream sstr;
-                    sstr << "Unable to open file for writing " << filename;
-                    throw gradylibMakeException(sstr.str());
-                }
-
                 int64_t mapOffset = 0;
                 ofs.write(static_cast<char *>(static_cast<void*>(&mapOffset)), 8);
 
@@ -235,7 +277,7 @@ namespace gradylib {
                 auto valueStartOffset = ofs.tellp();
                 for (auto const & [key, value] : m) {
                     valueOffsets[key] = ofs.tellp() - valueStartOffset;
-                    if constexpr (serializable_global<Value>) {
+                    if constexpr (serializable_global<Value, Stream>) {
                         serialize(ofs, value);
                     } else {
                         value.serialize(ofs);
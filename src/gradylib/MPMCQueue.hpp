@@ -0,0 +1,138 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A bounded lock free multi producer multi consumer queue (Vyukov's array queue).
+ *
+ * Each slot carries a sequence number saying whether it is ready for the producer or the consumer of a given lap
+ * around the ring, so tryPush and tryPop are each one CAS on a shared index plus a store to the slot.  Neither ever
+ * blocks: tryPush returns false when the queue is full and tryPop returns false when it is empty.  The capacity is
+ * rounded up to a power of two.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<new>
+#include<utility>
+
+namespace gradylib {
+
+    template<typename T>
+    class MPMCQueue {
+        struct alignas(64) Slot {
+            std::atomic<size_t> sequence;
+            alignas(T) unsigned char storage[sizeof(T)];
+
+            T * value() {
+                return std::launder(reinterpret_cast<T *>(storage));
+            }
+        };
+
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<size_t> enqueuePos{0};
+        alignas(64) std::atomic<size_t> dequeuePos{0};
+
+    public:
+        explicit MPMCQueue(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) {
+                size *= 2;
+            }
+            mask = size - 1;
+            slots.reset(new Slot[size]);
+            for (size_t i = 0; i < size; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MPMCQueue(MPMCQueue const &) = delete;
+
+        MPMCQueue & operator=(MPMCQueue const &) = delete;
+
+        ~MPMCQueue() {
+            size_t end = enqueuePos.load(std::memory_order_relaxed);
+            for (size_t pos = dequeuePos.load(std::memory_order_relaxed); pos != end; ++pos) {
+                slots[pos & mask].value()->~T();
+            }
+        }
+
+        size_t capacity() const {
+            return mask + 1;
+        }
+
+        template<typename U>
+        bool tryPush(U && u) {
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Slot & slot = slots[pos & mask];
+                size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        new (slot.storage) T(std::forward<U>(u));
+                        slot.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool tryPop(T & t) {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Slot & slot = slots[pos & mask];
+                size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        t = std::move(*slot.value());
+                        slot.value()->~T();
+                        slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Only a snapshot when other threads are pushing or popping
+        size_t sizeApprox() const {
+            size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+            size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+    };
+}
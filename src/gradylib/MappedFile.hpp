@@ -0,0 +1,192 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * MappedFile owns a memory mapping of a whole file.  The file descriptor is closed as soon as the mapping exists, so
+ * holding thousands of MappedFiles doesn't hold thousands of descriptors.
+ *
+ * MappingMode::CopyOnWrite maps the file MAP_PRIVATE and writable.  Pages are shared with the page cache until they
+ * are written, at which point the kernel copies just that page.  Writes never reach the file.
+ *
+ * The mmap'able containers use this to load from a path.  They also have constructors taking a void const * to an
+ * existing region (a section of a larger mapping, a buffer received from another process, etc.) which don't own
+ * the memory at all.  The region must stay valid and 8 byte aligned for the lifetime of the container.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<cstddef>
+#include<cstring>
+#include<filesystem>
+#include<sstream>
+
+#include"Exception.hpp"
+
+namespace gradylib {
+
+    using MMapFunction = void * (*)(void *, size_t, int, int, int, off_t);
+
+    enum class MappingMode {
+        ReadOnly,
+        CopyOnWrite
+    };
+
+    class MappedFile {
+        void * memoryMapping = nullptr;
+        size_t mappingSize = 0;
+        // data() and size() skip this many bytes at the start of the mapping
+        size_t dataOffset = 0;
+        MappingMode mode = MappingMode::ReadOnly;
+
+        void map(int fd, MMapFunction mmapFunc) {
+            struct stat statBuf;
+            if (fstat(fd, &statBuf) != 0) {
+                std::ostringstream sstr;
+                sstr << "fstat failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            if (static_cast<size_t>(statBuf.st_size) < dataOffset) {
+                throw gradylibMakeException("File is smaller than the offset of its data");
+            }
+            mappingSize = statBuf.st_size;
+            if (mode == MappingMode::CopyOnWrite) {
+                memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            } else {
+                memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            if (memoryMapping == MAP_FAILED) {
+                memoryMapping = nullptr;
+                mappingSize = 0;
+                std::ostringstream sstr;
+                sstr << "memory map failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(std::filesystem::path const & filename, MMapFunction mmapFunc = mmap)
+            : MappedFile(filename, MappingMode::ReadOnly, mmapFunc)
+        {
+        }
+
+        MappedFile(std::filesystem::path const & filename, MappingMode mode, MMapFunction mmapFunc = mmap)
+            : mode(mode)
+        {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                map(fd, mmapFunc);
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+        }
+
+        // Maps the whole of an already open descriptor, e.g. a memfd.  The caller keeps ownership of fd.
+        explicit MappedFile(int fd, MMapFunction mmapFunc = mmap)
+            : MappedFile(fd, MappingMode::ReadOnly, mmapFunc)
+        {
+        }
+
+        MappedFile(int fd, MappingMode mode, MMapFunction mmapFunc = mmap)
+            : mode(mode)
+        {
+            map(fd, mmapFunc);
+        }
+
+        // Maps the whole of fd, but data() and size() cover only the bytes from offset on, e.g. past a header
+        MappedFile(int fd, size_t offset, MMapFunction mmapFunc = mmap)
+            : dataOffset(offset)
+        {
+            map(fd, mmapFunc);
+        }
+
+        MappedFile(MappedFile const &) = delete;
+
+        MappedFile & operator=(MappedFile const &) = delete;
+
+        MappedFile(MappedFile && m) noexcept
+            : memoryMapping(m.memoryMapping), mappingSize(m.mappingSize), dataOffset(m.dataOffset), mode(m.mode)
+        {
+            m.memoryMapping = nullptr;
+            m.mappingSize = 0;
+            m.dataOffset = 0;
+        }
+
+        MappedFile & operator=(MappedFile && m) noexcept {
+            if (this == &m) {
+                return *this;
+            }
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+            }
+            memoryMapping = m.memoryMapping;
+            mappingSize = m.mappingSize;
+            dataOffset = m.dataOffset;
+            mode = m.mode;
+            m.memoryMapping = nullptr;
+            m.mappingSize = 0;
+            m.dataOffset = 0;
+            return *this;
+        }
+
+        ~MappedFile() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+            }
+        }
+
+        void const * data() const {
+            if (!memoryMapping) {
+                return nullptr;
+            }
+            return static_cast<std::byte const *>(memoryMapping) + dataOffset;
+        }
+
+        size_t size() const {
+            return mappingSize - dataOffset;
+        }
+
+        bool empty() const {
+            return memoryMapping == nullptr;
+        }
+
+        bool isCopyOnWrite() const {
+            return mode == MappingMode::CopyOnWrite;
+        }
+    };
+}
@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * NUMA topology, read from /sys/devices/system/node, and thread pinning.
+ *
+ *     ThreadPool tp(NumaTopology::discover());    // one worker per cpu, pinned, with node local queues
+ *
+ * Each node lists the cpus local to it.  Nodes without cpus (memory only nodes) are left out.  Where the sysfs
+ * directory doesn't exist, e.g. on macOS, discover() returns a single node holding every cpu.  Pinning is only
+ * implemented on Linux; elsewhere pinCurrentThread returns false and threads float as usual.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<charconv>
+#include<filesystem>
+#include<fstream>
+#include<string>
+#include<string_view>
+#include<thread>
+#include<vector>
+
+#ifdef __linux__
+#include<pthread.h>
+#include<sched.h>
+#endif
+
+namespace gradylib_helpers {
+
+    // Parses the kernel's cpu list format, e.g. "0-3,8-11".  Malformed pieces are skipped.
+    inline std::vector<int> parseCpuList(std::string_view list) {
+        std::vector<int> cpus;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view piece = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            while (!piece.empty() && (piece.back() == '\n' || piece.back() == ' ')) {
+                piece.remove_suffix(1);
+            }
+            int first = 0;
+            auto [firstEnd, firstErr] = std::from_chars(piece.data(), piece.data() + piece.size(), first);
+            if (firstErr != std::errc()) {
+                continue;
+            }
+            int last = first;
+            if (firstEnd != piece.data() + piece.size() && *firstEnd == '-') {
+                auto [lastEnd, lastErr] = std::from_chars(firstEnd + 1, piece.data() + piece.size(), last);
+                if (lastErr != std::errc() || last < first) {
+                    continue;
+                }
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // Restricts the calling thread to one cpu.  Returns false if that isn't possible.
+    inline bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+namespace gradylib {
+
+    struct NumaNode {
+        int id = 0;
+        std::vector<int> cpus;
+    };
+
+    class NumaTopology {
+        std::vector<NumaNode> nodeList;
+
+    public:
+        // A single node holding every cpu
+        NumaTopology() {
+            NumaNode node;
+            int numCpus = std::max<int>(1, std::thread::hardware_concurrency());
+            for (int cpu = 0; cpu < numCpus; ++cpu) {
+                node.cpus.push_back(cpu);
+            }
+            nodeList.push_back(std::move(node));
+        }
+
+        // An empty list gives the single node topology
+        explicit NumaTopology(std::vector<NumaNode> nodes)
+            : nodeList(std::move(nodes))
+        {
+            if (nodeList.empty()) {
+                *this = NumaTopology();
+            }
+        }
+
+        static NumaTopology discover(std::filesystem::path const & sysfsNodeDir = "/sys/devices/system/node") {
+            std::vector<NumaNode> nodes;
+            std::error_code ec;
+            for (auto const & entry : std::filesystem::directory_iterator(sysfsNodeDir, ec)) {
+                std::string name = entry.path().filename().string();
+                if (name.size() <= 4 || name.compare(0, 4, "node") != 0) {
+                    continue;
+                }
+                NumaNode node;
+                auto [end, err] = std::from_chars(name.data() + 4, name.data() + name.size(), node.id);
+                if (err != std::errc() || end != name.data() + name.size()) {
+                    continue;
+                }
+                std::ifstream ifs(entry.path() / "cpulist");
+                std::string list;
+                std::getline(ifs, list);
+                node.cpus = gradylib_helpers::parseCpuList(list);
+                if (!node.cpus.empty()) {
+                    nodes.push_back(std::move(node));
+                }
+            }
+            std::sort(nodes.begin(), nodes.end(), [](NumaNode const & a, NumaNode const & b) {
+                return a.id < b.id;
+            });
+            return NumaTopology(std::move(nodes));
+        }
+
+        size_t size() const {
+            return nodeList.size();
+        }
+
+        NumaNode const & operator[](size_t i) const {
+            return nodeList[i];
+        }
+
+        std::vector<NumaNode> const & nodes() const {
+            return nodeList;
+        }
+
+        size_t numCpus() const {
+            size_t n = 0;
+            for (auto const & node : nodeList) {
+                n += node.cpus.size();
+            }
+            return n;
+        }
+    };
+}
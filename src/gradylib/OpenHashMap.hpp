@@ -32,8 +32,11 @@ SOFTWARE.
 #include<vector>
 
 #include"AltIntHash.hpp"
+#include"AsyncFileWriter.hpp"
 #include"Common.hpp"
 #include"BitPairSet.hpp"
+#include"Coroutines.hpp"
+#include"FrontCodedStrings.hpp"
 #include"ThreadPool.hpp"
 #include"ParallelTraversals.hpp"
 
@@ -53,6 +56,7 @@ SOFTWARE.
  *  - get
  *  - parallelForEach
  *  - writeMappable (for integer -> string or string -> integer maps)
+ *  - writeMappableCompressed (the same, with a front coded string section)
  */
 
 namespace gradylib {
@@ -121,6 +125,78 @@ namespace gradylib {
             std::swap(setFlags, newSetFlags);
         }
 
+        // Runs parallelForEach, completing promise (a std::promise or an AsyncPromise) with the merged result
+        template<typename ReturnValue, typename Promise, typename Callable, typename PartialInitializer, typename FinalInitializer>
+        auto startParallelForEach(ThreadPool & tp,
+                                  Promise && promise,
+                                  Callable && f,
+                                  PartialInitializer && partialInitializer,
+                                  FinalInitializer && finalInitializer,
+                                  size_t numThreads,
+                                  CancellationToken token) const {
+            if (numThreads == 0) {
+                numThreads = tp.size();
+            }
+            numThreads = std::min(numThreads, size());
+            struct Result {
+                ReturnValue final;
+                std::mutex finalMutex;
+                Promise promise;
+                size_t remainingThreads;
+                bool cancelled = false;
+
+                Result(ReturnValue && final, Promise && promise, size_t remainingThreads)
+                    : final(std::move(final)), promise(std::move(promise)), remainingThreads(remainingThreads)
+                {
+                }
+            };
+            std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), std::move(promise), numThreads);
+            if (numThreads == 0) {
+                // An empty map has no partitions to complete the promise
+                if (token.isCancelled()) {
+                    result->promise.set_exception(std::make_exception_ptr(Cancelled()));
+                } else {
+                    result->promise.set_value(std::move(result->final));
+                }
+            }
+            size_t start = 0;
+            for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                // The parallelization scheme is to simply partition the arrays backing the map into equal sizes
+                size_t stop = start + keys.size() / numThreads + (threadIdx < keys.size() % numThreads ? 1 : 0);
+                // On a NUMA pool each range goes to the node that firstTouch would have placed it on
+                tp.addOnNode(tp.nodeForPart(threadIdx, numThreads),
+                             [start, stop, f, result, token, this, partial=partialInitializer(threadIdx, numThreads)]() mutable {
+                    bool cancelled = token.isCancelled();
+                    for (size_t chunkStart = start; chunkStart < stop && !cancelled; chunkStart += gradylib_helpers::cancellationCheckInterval) {
+                        size_t chunkStop = std::min(stop, chunkStart + gradylib_helpers::cancellationCheckInterval);
+                        for (size_t j = chunkStart; j < chunkStop; ++j) {
+                            if (setFlags.isFirstSet(j)) {
+                                f(partial, keys[j], values[j]);
+                            }
+                        }
+                        cancelled = token.isCancelled();
+                    }
+                    std::lock_guard lg(result->finalMutex);
+                    if (cancelled) {
+                        result->cancelled = true;
+                    } else if (!result->cancelled) {
+                        mergePartials(result->final, partial);
+                    }
+                    // The lock_guard is protecting remainingThreads
+                    if (result->remainingThreads == 1) {
+                        if (result->cancelled) {
+                            result->promise.set_exception(std::make_exception_ptr(Cancelled()));
+                        } else {
+                            result->promise.set_value(std::move(result->final));
+                        }
+                    }
+                    --result->remainingThreads;
+                });
+                start = stop;
+            }
+            return result->promise.get_future();
+        }
+
     public:
         typedef Key key_type;
         typedef Value mapped_type;
@@ -310,6 +386,80 @@ namespace gradylib {
             return false;
         }
 
+        /*
+         * The hash this map uses for key.  When the same key is looked up in several maps sharing a hash function,
+         * compute it once and pass it to find.
+         */
+        template<typename KeyType>
+        requires (std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 std::is_constructible_v<Key, KeyType>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        size_t hashKey(KeyType const &key) const {
+            if constexpr (std::same_as<Key, std::string> && std::same_as<std::remove_cvref_t<KeyType>, std::string_view>) {
+                return HashFunction<std::string_view>{}(key);
+            } else {
+                return hashFunction(key);
+            }
+        }
+
+        // Returns nullptr if key isn't in the map
+        template<typename KeyType>
+        requires (std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 std::is_constructible_v<Key, KeyType>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        Value const * find(KeyType const &key) const {
+            return find(key, hashKey(key));
+        }
+
+        // hash must be hashKey(key).  Returns nullptr if key isn't in the map.
+        template<typename KeyType>
+        requires (std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 std::is_constructible_v<Key, KeyType>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        Value const * find(KeyType const &key, size_t hash) const {
+            if (keys.size() == 0) {
+                return nullptr;
+            }
+            size_t idx = hash % keys.size();
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                if (keys[idx] == key) {
+                    return isSet ? &values[idx] : nullptr;
+                }
+                ++idx;
+                idx = idx == keys.size() ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return nullptr;
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            if (keys.size() == 0) {
+                return;
+            }
+            size_t idx = hash % keys.size();
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keys[idx]);
+            __builtin_prefetch(&values[idx]);
+        }
+
+        // The length of the arrays backing the map, the range of slots forEachInSlots takes
+        size_t numSlots() const {
+            return keys.size();
+        }
+
+        // Calls f(key, value) for the entries in slots [start, stop)
+        template<typename Callable>
+        requires std::invocable<Callable &, Key const &, Value const &>
+        void forEachInSlots(size_t start, size_t stop, Callable && f) const {
+            for (size_t i = start; i < stop; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    f(keys[i], values[i]);
+                }
+            }
+        }
+
         template<typename KeyType>
         requires (std::is_constructible_v<Key, KeyType> ||
                   std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
@@ -649,7 +799,8 @@ namespace gradylib {
         std::future<ReturnValue> parallelForEach(Callable && f,
                                                  PartialInitializer && partialInitializer = PartialInitializer{},
                                                  FinalInitializer && finalInitializer = FinalInitializer{},
-                                                 size_t numThreads = 0) const {
+                                                 size_t numThreads = 0,
+                                                 CancellationToken token = CancellationToken()) const {
             // If the default thread pool hasn't been created yet then create it now.
             if (!gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL) {
                 std::lock_guard lg(gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL_MUTEX);
@@ -661,10 +812,14 @@ namespace gradylib {
                                    std::forward<Callable>(f),
                                    std::forward<PartialInitializer>(partialInitializer),
                                    std::forward<FinalInitializer>(finalInitializer),
-                                   numThreads);
+                                   numThreads,
+                                   std::move(token));
         }
 
-        // This overload of parallelForEachTakes a thread pool argument
+        /*
+         * This overload of parallelForEachTakes a thread pool argument.  If token is cancelled, partitions stop at their
+         * next check, their partials are dropped without merging, and the future holds Cancelled.
+         */
         template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<Key, Value, HashFunction>,
                 typename Callable,
                 typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
@@ -677,69 +832,75 @@ namespace gradylib {
                                                  Callable && f,
                                                  PartialInitializer && partialInitializer = PartialInitializer{},
                                                  FinalInitializer && finalInitializer = FinalInitializer{},
-                                                 size_t numThreads = 0) const {
-            if (numThreads == 0) {
-                numThreads = tp.size();
-            }
-            numThreads = std::min(numThreads, size());
-            struct Result {
-                ReturnValue final;
-                std::mutex finalMutex;
-                std::promise<ReturnValue> promise;
-                size_t remainingThreads;
+                                                 size_t numThreads = 0,
+                                                 CancellationToken token = CancellationToken()) const {
+            return startParallelForEach<ReturnValue>(tp,
+                                                     std::promise<ReturnValue>(),
+                                                     std::forward<Callable>(f),
+                                                     std::forward<PartialInitializer>(partialInitializer),
+                                                     std::forward<FinalInitializer>(finalInitializer),
+                                                     numThreads,
+                                                     std::move(token));
+        }
 
-                Result(ReturnValue && final, size_t remainingThreads)
-                    : final(std::move(final)), remainingThreads(remainingThreads)
-                {
-                }
-            };
-            std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), numThreads);
-            size_t start = 0;
-            for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
-                // The parallelization scheme is to simply partition the arrays backing the map into equal sizes
-                size_t stop = start + keys.size() / numThreads + (threadIdx < keys.size() % numThreads ? 1 : 0);
-                tp.add([start, stop, f, result, this, partial=partialInitializer(threadIdx, numThreads)]() mutable {
-                    for (size_t j = start; j < stop; ++j) {
-                        if (setFlags.isFirstSet(j)) {
-                            f(partial, keys[j], values[j]);
-                        }
-                    }
-                    std::lock_guard lg(result->finalMutex);
-                    mergePartials(result->final, partial);
-                    // The lock_guard is protecting remainingThreads
-                    if (result->remainingThreads == 1) {
-                        result->promise.set_value(std::move(result->final));
-                    }
-                    --result->remainingThreads;
-                });
-                start = stop;
-            }
-            return result->promise.get_future();
+        /*
+         * parallelForEach for coroutines: co_await the result and the coroutine is resumed on tp when the last
+         * partition finishes, rather than polling a std::future.  See Coroutines.hpp.
+         */
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<Key, Value, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, Key const &, Value const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        AsyncFuture<ReturnValue> parallelForEachAsync(ThreadPool & tp,
+                                                      Callable && f,
+                                                      PartialInitializer && partialInitializer = PartialInitializer{},
+                                                      FinalInitializer && finalInitializer = FinalInitializer{},
+                                                      size_t numThreads = 0,
+                                                      CancellationToken token = CancellationToken()) const {
+            return startParallelForEach<ReturnValue>(tp,
+                                                     AsyncPromise<ReturnValue>(tp),
+                                                     std::forward<Callable>(f),
+                                                     std::forward<PartialInitializer>(partialInitializer),
+                                                     std::forward<FinalInitializer>(finalInitializer),
+                                                     numThreads,
+                                                     std::move(token));
         }
 
-        template<typename IndexType>
-        friend void writeMappable(std::string filename, OpenHashMap<std::string, IndexType> const & m);
+        template<typename IndexType, template<typename> typename HashFunc>
+        friend void writeMappable(std::ostream & ofs, OpenHashMap<std::string, IndexType, HashFunc> const & m);
 
         template<typename IndexType, template<typename> typename HashFunc>
-        friend void writeMappable(std::string filename, OpenHashMap<IndexType, std::string, HashFunc> const & m);
+        friend void writeMappable(std::ostream & ofs, OpenHashMap<IndexType, std::string, HashFunc> const & m);
 
         template<typename IndexType, template<typename> typename HashFunc>
-        friend void GRADY_LIB_MOCK_OpenHashMap_SET_SECOND_BITS(OpenHashMap<std::string, IndexType, HashFunc> &);
-    };
+        friend void writeMappableCompressed(std::ostream & ofs, OpenHashMap<std::string, IndexType, HashFunc> const & m);
 
+        template<typename IndexType, template<typename> typename HashFunc>
+        friend void writeMappableCompressed(std::ostream & ofs, OpenHashMap<IndexType, std::string, HashFunc> const & m);
 
-    template<typename IndexType>
-    void writeMappable(std::string filename, OpenHashMap<std::string, IndexType> const & m) {
-        std::ofstream ofs(filename);
-        if (ofs.fail()) {
-            std::ostringstream sstr;
-            sstr << "Couldn't open file " << filename << " in writeMappable.";
-            throw gradylibMakeException(sstr.str());
-        }
-        size_t mapSize = m.mapSize;
+        template<typename IndexType, template<typename> typename HashFunc>
+        friend void GRADY_LIB_MOCK_OpenHashMap_SET_SECOND_BITS(OpenHashMap<std::string, IndexType, HashFunc> &);
+    };
+}
+
+namespace gradylib_helpers {
+
+    /*
+     * Writes the string -> integer layout MMapS2IOpenHashMap loads.  keyAt(i) gives the key in slot i as something
+     * with data() and length(), so the slots can be written from an OpenHashMap or from string_views into other
+     * storage.  Unused slots are written as empty keys.
+     */
+    template<typename IndexType, typename KeyAt>
+    void writeMappableS2I(std::ostream & ofs, size_t mapSize, size_t keySize, size_t fingerprint, KeyAt && keyAt,
+                          IndexType const * values, gradylib::BitPairSet const & setFlags) {
+        size_t const startFileOffset = ofs.tellp();
         ofs.write(static_cast<char*>(static_cast<void*>(&mapSize)), 8);
-        size_t keySize = m.keys.size();
         ofs.write(static_cast<char*>(static_cast<void*>(&keySize)), 8);
+        ofs.write(static_cast<char*>(static_cast<void*>(&fingerprint)), 8);
         // We will come back to this position in the file and write the true Value array start position once we know it
         size_t valueOffset = 0;
         auto const valueOffsetWritePos = ofs.tellp();
@@ -752,49 +913,80 @@ namespace gradylib {
         size_t keyOffset = 0;
         // This loop will compute the length of each key structure in bytes and use that to compute the offset in bytes
         // to each key given some arbitrary base pointer.  The offset is written to the file.
-        for (size_t i = 0; i < m.keys.size(); ++i) {
+        for (size_t i = 0; i < keySize; ++i) {
             ofs.write(static_cast<char*>(static_cast<void*>(&keyOffset)), 8);
-            int32_t strLen = m.keys[i].length();
-            int32_t strSize = 4 + strLen + gradylib_helpers::getPadLength<4>(strLen);
+            int32_t strLen = keyAt(i).length();
+            int32_t strSize = 4 + strLen + getPadLength<4>(strLen);
             keyOffset += strSize;
         }
         // This loop will write the actual key structures
-        for (size_t i = 0; i < m.keys.size(); ++i) {
-            int32_t len = m.keys[i].length();
+        for (size_t i = 0; i < keySize; ++i) {
+            auto const & key = keyAt(i);
+            int32_t len = key.length();
             ofs.write(static_cast<char*>(static_cast<void*>(&len)), 4);
-            ofs.write(m.keys[i].data(), len);
-            gradylib_helpers::writePad<4>(ofs);
+            ofs.write(key.data(), len);
+            writePad<4>(ofs);
         }
 
         // Write the values
-        gradylib_helpers::writePad<8>(ofs);
-        valueOffset = ofs.tellp();
-        ofs.write(static_cast<char*>(const_cast<void*>(static_cast<void const *>(m.values.data()))), sizeof(IndexType) * keySize);
+        writePad<8>(ofs);
+        valueOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        ofs.write(static_cast<char*>(const_cast<void*>(static_cast<void const *>(values))), sizeof(IndexType) * keySize);
 
         // Write the BitPairSet
-        gradylib_helpers::writePad<8>(ofs);
-        bitPairSetOffset = ofs.tellp();
-        m.setFlags.write(ofs);
+        writePad<8>(ofs);
+        bitPairSetOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        setFlags.write(ofs);
+        auto const endPos = ofs.tellp();
 
         // Go back to the Value array and BitPairSet offset locations and write the offsets
         ofs.seekp(valueOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&valueOffset)), 8);
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.seekp(endPos);
     }
+}
 
+namespace gradylib {
+
+    // The stream overloads of writeMappable expect the stream position to be 8 byte aligned
     template<typename IndexType, template<typename> typename HashFunction>
-    void writeMappable(std::string filename, OpenHashMap<IndexType, std::string, HashFunction> const & m) {
+    void writeMappable(std::ostream & ofs, OpenHashMap<std::string, IndexType, HashFunction> const & m) {
+        gradylib_helpers::writeMappableS2I(ofs, m.mapSize, m.keys.size(),
+                                           gradylib_helpers::hashFingerprint<std::string>(m.hashFunction),
+                                           [&m](size_t i) -> std::string const & { return m.keys[i]; },
+                                           m.values.data(), m.setFlags);
+    }
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappable(std::string filename, OpenHashMap<std::string, IndexType, HashFunction> const & m) {
         std::ofstream ofs(filename);
         if (ofs.fail()) {
             std::ostringstream sstr;
             sstr << "Couldn't open file " << filename << " in writeMappable.";
             throw gradylibMakeException(sstr.str());
         }
+        writeMappable(ofs, m);
+    }
+
+    // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+    template<typename IndexType, template<typename> typename HashFunction>
+    std::future<void> writeMappableAsync(std::filesystem::path filename, OpenHashMap<std::string, IndexType, HashFunction> const & m, ThreadPool * tp = nullptr) {
+        return writeFileAsync(std::move(filename), [&m](std::ostream & os) {
+            writeMappable(os, m);
+        }, tp);
+    }
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappable(std::ostream & ofs, OpenHashMap<IndexType, std::string, HashFunction> const & m) {
+        size_t const startFileOffset = ofs.tellp();
         size_t mapSize = m.mapSize;
         ofs.write(static_cast<char*>(static_cast<void*>(&mapSize)), 8);
         size_t keySize = m.keys.size();
         ofs.write(static_cast<char*>(static_cast<void*>(&keySize)), 8);
+        size_t fingerprint = gradylib_helpers::hashFingerprint<IndexType>(m.hashFunction);
+        ofs.write(static_cast<char*>(static_cast<void*>(&fingerprint)), 8);
         // We will come back to this position in the file and write the true BitPairSet start position once we know it
         size_t bitPairSetOffset = 0;
         auto const bitPairSetOffsetWritePos = ofs.tellp();
@@ -820,12 +1012,143 @@ namespace gradylib {
 
         // Write the BitPairSet to the file
         gradylib_helpers::writePad<8>(ofs);
-        bitPairSetOffset = ofs.tellp();
+        bitPairSetOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
         m.setFlags.write(ofs);
+        auto const endPos = ofs.tellp();
 
         // Go back to the BitPairSet start position offset and write it
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.seekp(endPos);
+    }
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappable(std::string filename, OpenHashMap<IndexType, std::string, HashFunction> const & m) {
+        std::ofstream ofs(filename);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open file " << filename << " in writeMappable.";
+            throw gradylibMakeException(sstr.str());
+        }
+        writeMappable(ofs, m);
+    }
+
+    // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+    template<typename IndexType, template<typename> typename HashFunction>
+    std::future<void> writeMappableAsync(std::filesystem::path filename, OpenHashMap<IndexType, std::string, HashFunction> const & m, ThreadPool * tp = nullptr) {
+        return writeFileAsync(std::move(filename), [&m](std::ostream & os) {
+            writeMappable(os, m);
+        }, tp);
+    }
+
+    /*
+     * writeMappableCompressed writes the same hash table as writeMappable but replaces the string section with a
+     * front coded dictionary (see FrontCodedStrings.hpp) and a uint32 string id per slot.  Load string -> integer
+     * files with MMapS2ICompressedOpenHashMap and integer -> string files with MMapI2SCompressedOpenHashMap.
+     *
+     * string -> integer layout:
+     *     uint64 magic, mapSize, keySize, hashFingerprint, valueOffset, dictionaryOffset, bitPairSetOffset
+     *     uint32 keyIds[keySize], pad to 8
+     *     IndexType values[keySize], pad to 8
+     *     dictionary
+     *     BitPairSet
+     */
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappableCompressed(std::ostream & ofs, OpenHashMap<std::string, IndexType, HashFunction> const & m) {
+        size_t const startFileOffset = ofs.tellp();
+        std::vector<std::string_view> dictionary;
+        std::vector<uint32_t> keyIds = gradylib_helpers::buildFrontCodedDictionary(m.keys, m.setFlags, dictionary);
+        uint64_t header[7] = {gradylib_helpers::compressedS2IMagic, m.mapSize, m.keys.size(),
+                              gradylib_helpers::hashFingerprint<std::string>(m.hashFunction), 0, 0, 0};
+        ofs.write(gradylib_helpers::charCast(header), sizeof(header));
+        ofs.write(gradylib_helpers::charCast(keyIds.data()), sizeof(uint32_t) * keyIds.size());
+        gradylib_helpers::writePad<8>(ofs);
+        header[4] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        ofs.write(gradylib_helpers::charCast(m.values.data()), sizeof(IndexType) * m.values.size());
+        gradylib_helpers::writePad<8>(ofs);
+        header[5] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        gradylib_helpers::writeFrontCoded(ofs, dictionary);
+        header[6] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        m.setFlags.write(ofs);
+        auto const endPos = ofs.tellp();
+
+        // Go back and fill in the section offsets
+        ofs.seekp(startFileOffset, std::ios::beg);
+        ofs.write(gradylib_helpers::charCast(header), sizeof(header));
+        ofs.seekp(endPos);
+    }
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappableCompressed(std::string filename, OpenHashMap<std::string, IndexType, HashFunction> const & m) {
+        std::ofstream ofs(filename);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open file " << filename << " in writeMappableCompressed.";
+            throw gradylibMakeException(sstr.str());
+        }
+        writeMappableCompressed(ofs, m);
+    }
+
+    // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+    template<typename IndexType, template<typename> typename HashFunction>
+    std::future<void> writeMappableCompressedAsync(std::filesystem::path filename, OpenHashMap<std::string, IndexType, HashFunction> const & m, ThreadPool * tp = nullptr) {
+        return writeFileAsync(std::move(filename), [&m](std::ostream & os) {
+            writeMappableCompressed(os, m);
+        }, tp);
+    }
+
+    /*
+     * integer -> string layout:
+     *     uint64 magic, mapSize, keySize, hashFingerprint, valueIdOffset, dictionaryOffset, bitPairSetOffset
+     *     IndexType keys[keySize], pad to 8
+     *     uint32 valueIds[keySize], pad to 8
+     *     dictionary
+     *     BitPairSet
+     *
+     * Values are deduplicated, so redundant values cost 4 bytes per key.
+     */
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappableCompressed(std::ostream & ofs, OpenHashMap<IndexType, std::string, HashFunction> const & m) {
+        size_t const startFileOffset = ofs.tellp();
+        std::vector<std::string_view> dictionary;
+        std::vector<uint32_t> valueIds = gradylib_helpers::buildFrontCodedDictionary(m.values, m.setFlags, dictionary);
+        uint64_t header[7] = {gradylib_helpers::compressedI2SMagic, m.mapSize, m.keys.size(),
+                              gradylib_helpers::hashFingerprint<IndexType>(m.hashFunction), 0, 0, 0};
+        ofs.write(gradylib_helpers::charCast(header), sizeof(header));
+        ofs.write(gradylib_helpers::charCast(m.keys.data()), sizeof(IndexType) * m.keys.size());
+        gradylib_helpers::writePad<8>(ofs);
+        header[4] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        ofs.write(gradylib_helpers::charCast(valueIds.data()), sizeof(uint32_t) * valueIds.size());
+        gradylib_helpers::writePad<8>(ofs);
+        header[5] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        gradylib_helpers::writeFrontCoded(ofs, dictionary);
+        header[6] = static_cast<size_t>(ofs.tellp()) - startFileOffset;
+        m.setFlags.write(ofs);
+        auto const endPos = ofs.tellp();
+
+        // Go back and fill in the section offsets
+        ofs.seekp(startFileOffset, std::ios::beg);
+        ofs.write(gradylib_helpers::charCast(header), sizeof(header));
+        ofs.seekp(endPos);
+    }
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappableCompressed(std::string filename, OpenHashMap<IndexType, std::string, HashFunction> const & m) {
+        std::ofstream ofs(filename);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open file " << filename << " in writeMappableCompressed.";
+            throw gradylibMakeException(sstr.str());
+        }
+        writeMappableCompressed(ofs, m);
+    }
+
+    // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+    template<typename IndexType, template<typename> typename HashFunction>
+    std::future<void> writeMappableCompressedAsync(std::filesystem::path filename, OpenHashMap<IndexType, std::string, HashFunction> const & m, ThreadPool * tp = nullptr) {
+        return writeFileAsync(std::move(filename), [&m](std::ostream & os) {
+            writeMappableCompressed(os, m);
+        }, tp);
     }
 
     // The following is for testing.
@@ -35,8 +35,11 @@ SOFTWARE.
 #include<vector>
 
 #include"AltIntHash.hpp"
+#include"AsyncFileWriter.hpp"
 #include"BitPairSet.hpp"
 #include"Common.hpp"
+#include"MappedFile.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -52,15 +55,17 @@ namespace gradylib {
         size_t keySize = 0;
         double loadFactor = 0.8;
         double growthFactor = 1.2;
-        int fd = -1;
-        void const * memoryMapping = nullptr;
-        size_t mappingSize = 0;
+        MappedFile mappedFile;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
         BitPairSet setFlags;
         bool readOnly = false;
+        // keys and values point into a mapping rather than the heap.  With a copy on write mapping the map is
+        // modified in place until the first rehash, which moves everything to the heap and drops the mapping.
+        bool mappedArrays = false;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
-        void rehash(size_t size = 0) {
+        // With a pool the new arrays are first touched on the nodes that will scan them
+        void rehash(size_t size = 0, ThreadPool * tp = nullptr) {
             size_t newSize;
             if (size > 0) {
                 if (size < mapSize) {
@@ -70,8 +75,8 @@ namespace gradylib {
             } else {
                 newSize = std::max<size_t>(keySize + 1, std::max<size_t>(1, keySize) * growthFactor);
             }
-            Key * newKeys = new Key[newSize];
-            Value * newValues = new Value[newSize]{};
+            Key * newKeys = tp ? gradylib_helpers::allocateFirstTouched<Key>(*tp, newSize) : new Key[newSize];
+            Value * newValues = tp ? gradylib_helpers::allocateFirstTouched<Value>(*tp, newSize) : new Value[newSize]{};
             BitPairSet newSetFlags(newSize);
             for (size_t i = 0; i < keySize; ++i) {
                 if (!setFlags.isFirstSet(i)) {
@@ -88,16 +93,23 @@ namespace gradylib {
                 newKeys[idx] = k;
                 newValues[idx] = values[i];
             }
-            delete [] keys;
+            if (!mappedArrays) {
+                delete [] keys;
+                delete [] values;
+            }
             keys = newKeys;
             keySize = newSize;
-            delete [] values;
             values = newValues;
             std::swap(setFlags, newSetFlags);
+            if (mappedArrays) {
+                mappedArrays = false;
+                mappedFile = MappedFile();
+            }
         }
 
-        void setFromMemoryMapping(void const * startPtr) {
-            readOnly = true;
+        void setFromMemoryMapping(void const * startPtr, bool copyOnWrite = false) {
+            readOnly = !copyOnWrite;
+            mappedArrays = true;
             std::byte const *ptr = static_cast<std::byte const *>(startPtr);
             std::byte const *base = ptr;
             mapSize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
@@ -116,7 +128,7 @@ namespace gradylib {
             ptr = base + valueOffset;
             values = static_cast<Value *>(const_cast<void *>(static_cast<void const *>(ptr)));
             ptr = base + bitPairSetOffset;
-            setFlags = BitPairSet(ptr);
+            setFlags = BitPairSet(ptr, readOnly);
         }
 
     public:
@@ -141,18 +153,16 @@ namespace gradylib {
 
         OpenHashMapTC(OpenHashMapTC && m) noexcept
             : keys(m.keys), values(m.values), keySize(m.keySize), mapSize(m.mapSize),
-            loadFactor(m.loadFactor), growthFactor(m.growthFactor), fd(m.fd),
-            memoryMapping(m.memoryMapping), mappingSize(m.mappingSize), setFlags(std::move(m.setFlags)),
-            readOnly(m.readOnly)
+            loadFactor(m.loadFactor), growthFactor(m.growthFactor),
+            mappedFile(std::move(m.mappedFile)), setFlags(std::move(m.setFlags)),
+            readOnly(m.readOnly), mappedArrays(m.mappedArrays)
         {
             m.keys = nullptr;
             m.values = nullptr;
             m.keySize = 0;
             m.mapSize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
             m.readOnly = false;
+            m.mappedArrays = false;
         }
 
         OpenHashMapTC & operator=(OpenHashMapTC const & m) {
@@ -161,9 +171,17 @@ namespace gradylib {
             }
             BitPairSet tmpSetFlags = m.setFlags;
             std::unique_ptr<Key[]> tmpKeys(new Key[m.keySize]);
-            values = new Value[m.keySize];
+            std::unique_ptr<Value[]> tmpValues(new Value[m.keySize]);
+            if (!mappedArrays) {
+                delete [] keys;
+                delete [] values;
+            }
+            values = tmpValues.release();
             keys = tmpKeys.release();
             std::swap(setFlags, tmpSetFlags);
+            mappedFile = MappedFile();
+            readOnly = false;
+            mappedArrays = false;
             keySize = m.keySize;
             mapSize = m.mapSize;
             loadFactor = m.loadFactor;
@@ -177,53 +195,51 @@ namespace gradylib {
             if (this == &m) {
                 return *this;
             }
+            if (!mappedArrays) {
+                delete [] keys;
+                delete [] values;
+            }
             keys = m.keys;
             values = m.values;
             keySize = m.keySize;
             mapSize = m.mapSize;
             loadFactor = m.loadFactor;
             growthFactor = m.growthFactor;
-            fd = m.fd;
-            memoryMapping = m.memoryMapping;
-            mappingSize = m.mappingSize;
+            mappedFile = std::move(m.mappedFile);
             setFlags = std::move(m.setFlags);
             readOnly = m.readOnly;
+            mappedArrays = m.mappedArrays;
             m.keys = nullptr;
             m.values = nullptr;
             m.keySize = 0;
             m.mapSize = 0;
-            m.fd = -1;
-            m.memoryMapping = nullptr;
-            m.mappingSize = 0;
             m.readOnly = false;
+            m.mappedArrays = false;
             return *this;
         }
 
         ~OpenHashMapTC() {
-            if (memoryMapping) {
-                munmap(const_cast<void *>(memoryMapping), mappingSize);
-                close(fd);
-            } else if (!readOnly) {
+            if (!mappedArrays) {
                 delete [] keys;
                 delete [] values;
             }
         }
 
-        explicit OpenHashMapTC(std::filesystem::path filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream ostr;
-                ostr << "Error opening file " << filename;
-                throw gradylibMakeException(ostr.str());
-            }
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                std::ostringstream sstr;
-                sstr << "memory map failed: " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
-            setFromMemoryMapping(memoryMapping);
+        explicit OpenHashMapTC(std::filesystem::path filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
+        }
+
+        /*
+         * MappingMode::CopyOnWrite gives a mutable map that starts out sharing the file's pages.  Inserts, erases
+         * and value updates touch only the pages they land on; the file itself is never modified.  Growing past
+         * the load factor (or reserve) rehashes onto the heap.
+         */
+        OpenHashMapTC(std::filesystem::path filename, MappingMode mode)
+            : mappedFile(filename, mode, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data(), mappedFile.isCopyOnWrite());
         }
 
         explicit OpenHashMapTC(std::ifstream & ifs) {
@@ -253,6 +269,13 @@ namespace gradylib {
             setFromMemoryMapping(startPtr);
         }
 
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit OpenHashMapTC(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data(), this->mappedFile.isCopyOnWrite());
+        }
+
         Value &operator[](Key const &key) {
             if (readOnly) {
                 std::ostringstream sstr;
@@ -417,6 +440,67 @@ namespace gradylib {
             return p->get(key).makeConst();
         }
 
+        // Returns nullptr if key isn't in the map
+        Value const * find(Key const &key) const {
+            return find(key, hashFunction(key));
+        }
+
+        /*
+         * The hash this map uses for key.  When the same key is looked up in several maps sharing a hash function,
+         * compute it once and pass it to find.
+         */
+        size_t hashKey(Key const &key) const {
+            return hashFunction(key);
+        }
+
+        // hash must be hashKey(key).  Returns nullptr if key isn't in the map.
+        Value const * find(Key const &key, size_t hash) const {
+            if (keySize == 0) {
+                return nullptr;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                if (isSet && keys[idx] == key) {
+                    return &values[idx];
+                }
+                if (wasSet && keys[idx] == key) {
+                    return nullptr;
+                }
+                ++idx;
+                idx = idx == keySize ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return nullptr;
+        }
+
+        // Starts loading the slot a lookup with this hash probes first.  See hashJoin in HashJoin.hpp.
+        void prefetch(size_t hash) const {
+            if (keySize == 0) {
+                return;
+            }
+            size_t idx = hash % keySize;
+            setFlags.prefetch(idx);
+            __builtin_prefetch(&keys[idx]);
+            __builtin_prefetch(&values[idx]);
+        }
+
+        // The length of the arrays backing the map, the range of slots forEachInSlots takes
+        size_t numSlots() const {
+            return keySize;
+        }
+
+        // Calls f(key, value) for the entries in slots [start, stop)
+        template<typename Callable>
+        requires std::invocable<Callable &, Key const &, Value const &>
+        void forEachInSlots(size_t start, size_t stop, Callable && f) const {
+            for (size_t i = start; i < stop; ++i) {
+                if (setFlags.isFirstSet(i)) {
+                    f(keys[i], values[i]);
+                }
+            }
+        }
+
         bool contains(Key const &key) const {
             if (mapSize == 0) {
                 return false;
@@ -444,6 +528,9 @@ namespace gradylib {
                 sstr << "Cannot modify mmap";
                 throw gradylibMakeException(sstr.str());
             }
+            if (keySize == 0) {
+                return;
+            }
             size_t hash = hashFunction(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
@@ -471,6 +558,17 @@ namespace gradylib {
             rehash(size);
         }
 
+        // For large tables on a NUMA pool: the new arrays' pages are placed on the nodes that parallelFor and
+        // allocateOverThreads will hand their ranges to
+        void reserve(size_t size, ThreadPool & tp) {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify mmap";
+                throw gradylibMakeException(sstr.str());
+            }
+            rehash(size, &tp);
+        }
+
         class iterator {
             size_t idx;
             OpenHashMapTC *container;
@@ -609,7 +707,7 @@ namespace gradylib {
             write(ofs, alignment);
         }
 
-        void write(std::ofstream & ofs, int alignment = alignof(void*)) const {
+        void write(std::ostream & ofs, int alignment = alignof(void*)) const {
             size_t startFileOffset = ofs.tellp();
             size_t t;
             t = mapSize;
@@ -641,12 +739,21 @@ namespace gradylib {
             }
             bitPairSetOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
             setFlags.write(ofs);
+            auto endPos = ofs.tellp();
 
             ofs.seekp(valueOffsetPos);
             ofs.write(static_cast<char*>(static_cast<void*>(&valuesOffset)), 8);
 
             ofs.seekp(bitPairSetOffsetPos);
             ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+            ofs.seekp(endPos);
+        }
+
+        // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+        std::future<void> writeAsync(std::filesystem::path filename, int alignment = alignof(void*), ThreadPool * tp = nullptr) const {
+            return writeFileAsync(std::move(filename), [this, alignment](std::ostream & os) {
+                write(os, alignment);
+            }, tp);
         }
 
         template<typename, typename, template<typename> typename>
@@ -33,6 +33,7 @@ SOFTWARE.
 
 #include"Common.hpp"
 #include"BitPairSet.hpp"
+#include"Coroutines.hpp"
 #include"ThreadPool.hpp"
 #include"ParallelTraversals.hpp"
 
@@ -44,8 +45,8 @@ namespace gradylib {
 
     template<typename Key, template<typename> typename HashFunction>
     void mergePartials(OpenHashSet<Key, HashFunction> & m1, OpenHashSet<Key, HashFunction> const & m2) {
-        for (auto const & [key] : m2) {
-            m1.inset(key);
+        for (auto const & key : m2) {
+            m1.insert(key);
         }
     }
 
@@ -92,6 +93,76 @@ namespace gradylib {
             std::swap(setFlags, newSetFlags);
         }
 
+        // Runs parallelForEach, completing promise (a std::promise or an AsyncPromise) with the merged result
+        template<typename ReturnValue, typename Promise, typename Callable, typename PartialInitializer, typename FinalInitializer>
+        auto startParallelForEach(ThreadPool & tp,
+                                  Promise && promise,
+                                  Callable && f,
+                                  PartialInitializer && partialInitializer,
+                                  FinalInitializer && finalInitializer,
+                                  size_t numThreads,
+                                  CancellationToken token) const {
+            if (numThreads == 0) {
+                numThreads = tp.size();
+            }
+            numThreads = std::min(numThreads, size());
+            struct Result {
+                ReturnValue final;
+                std::mutex finalMutex;
+                Promise promise;
+                size_t remainingThreads;
+                bool cancelled = false;
+
+                Result(ReturnValue && final, Promise && promise, size_t remainingThreads)
+                        : final(std::move(final)), promise(std::move(promise)), remainingThreads(remainingThreads)
+                {
+                }
+            };
+            std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), std::move(promise), numThreads);
+            if (numThreads == 0) {
+                // An empty set has no partitions to complete the promise
+                if (token.isCancelled()) {
+                    result->promise.set_exception(std::make_exception_ptr(Cancelled()));
+                } else {
+                    result->promise.set_value(std::move(result->final));
+                }
+            }
+            size_t start = 0;
+            for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                size_t stop = start + keys.size() / numThreads + (threadIdx < keys.size() % numThreads ? 1 : 0);
+                // On a NUMA pool each range goes to the node that firstTouch would have placed it on
+                tp.addOnNode(tp.nodeForPart(threadIdx, numThreads),
+                             [start, stop, f, result, token, this, partial=partialInitializer(threadIdx, numThreads)]() mutable {
+                    bool cancelled = token.isCancelled();
+                    for (size_t chunkStart = start; chunkStart < stop && !cancelled; chunkStart += gradylib_helpers::cancellationCheckInterval) {
+                        size_t chunkStop = std::min(stop, chunkStart + gradylib_helpers::cancellationCheckInterval);
+                        for (size_t j = chunkStart; j < chunkStop; ++j) {
+                            if (setFlags.isFirstSet(j)) {
+                                f(partial, keys[j]);
+                            }
+                        }
+                        cancelled = token.isCancelled();
+                    }
+                    std::lock_guard lg(result->finalMutex);
+                    if (cancelled) {
+                        result->cancelled = true;
+                    } else if (!result->cancelled) {
+                        mergePartials(result->final, partial);
+                    }
+                    if (result->remainingThreads == 1) {
+                        if (result->cancelled) {
+                            result->promise.set_exception(std::make_exception_ptr(Cancelled()));
+                        } else {
+                            result->promise.set_value(std::move(result->final));
+                        }
+                    }
+                    --result->remainingThreads;
+                });
+                start = stop;
+            }
+            return result->promise.get_future();
+        }
+
     public:
         typedef Key key_type;
 
@@ -413,7 +484,9 @@ namespace gradylib {
                  std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
         std::future<ReturnValue> parallelForEach(Callable && f,
                                                  PartialInitializer && partialInitializer = PartialInitializer{},
-                                                 FinalInitializer && finalInitializer = FinalInitializer{}) const {
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0,
+                                                 CancellationToken token = CancellationToken()) const {
             if (!gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL) {
                 std::lock_guard lg(gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL_MUTEX);
                 if (!gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL) {
@@ -423,9 +496,12 @@ namespace gradylib {
             return parallelForEach(*gradylib_helpers::GRADY_LIB_DEFAULT_THREADPOOL,
                                    std::forward<Callable>(f),
                                    std::forward<PartialInitializer>(partialInitializer),
-                                   std::forward<FinalInitializer>(finalInitializer));
+                                   std::forward<FinalInitializer>(finalInitializer),
+                                   numThreads,
+                                   std::move(token));
         }
 
+        // If token is cancelled, partitions stop at their next check, their partials are dropped, and the future holds Cancelled
         template<gradylib_helpers::Mergeable ReturnValue = OpenHashSet<Key, HashFunction>,
                 typename Callable,
                 typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
@@ -437,44 +513,40 @@ namespace gradylib {
         std::future<ReturnValue> parallelForEach(ThreadPool & tp,
                                                  Callable && f,
                                                  PartialInitializer && partialInitializer = PartialInitializer{},
-                                                 FinalInitializer && finalInitializer = PartialInitializer{},
-                                                 size_t numThreads = 0) const {
-            if (numThreads == 0) {
-                numThreads = tp.size();
-            }
-            numThreads = std::min(numThreads, size());
-            struct Result {
-                ReturnValue final;
-                std::mutex finalMutex;
-                std::promise<ReturnValue> promise;
-                size_t remainingThreads;
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0,
+                                                 CancellationToken token = CancellationToken()) const {
+            return startParallelForEach<ReturnValue>(tp,
+                                                     std::promise<ReturnValue>(),
+                                                     std::forward<Callable>(f),
+                                                     std::forward<PartialInitializer>(partialInitializer),
+                                                     std::forward<FinalInitializer>(finalInitializer),
+                                                     numThreads,
+                                                     std::move(token));
+        }
 
-                Result(ReturnValue && final, size_t remainingThreads)
-                        : final(std::move(final)), remainingThreads(remainingThreads)
-                {
-                }
-            };
-            std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), numThreads);
-            size_t start = 0;
-            for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
-                size_t stop = start + keys.size() / numThreads + (threadIdx < keys.size() % numThreads ? 1 : 0);
-                tp.add([threadIdx, numThreads, start, stop, f, result, this, &partialInitializer]() {
-                    ReturnValue partial = partialInitializer(threadIdx, numThreads);
-                    for (size_t j = start; j < stop; ++j) {
-                        if (setFlags.isFirstSet(j)) {
-                            f(partial, keys[j]);
-                        }
-                    }
-                    std::lock_guard lg(result->finalMutex);
-                    mergePartials(result->final, partial);
-                    if (result->remainingThreads == 1) {
-                        result->promise.set_value(std::move(result->final));
-                    }
-                    --result->remainingThreads;
-                });
-                start = stop;
-            }
-            return result->promise.get_future();
+        // parallelForEach for coroutines, completing an AsyncFuture instead of a std::future.  See Coroutines.hpp.
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashSet<Key, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, Key const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        AsyncFuture<ReturnValue> parallelForEachAsync(ThreadPool & tp,
+                                                      Callable && f,
+                                                      PartialInitializer && partialInitializer = PartialInitializer{},
+                                                      FinalInitializer && finalInitializer = FinalInitializer{},
+                                                      size_t numThreads = 0,
+                                                      CancellationToken token = CancellationToken()) const {
+            return startParallelForEach<ReturnValue>(tp,
+                                                     AsyncPromise<ReturnValue>(tp),
+                                                     std::forward<Callable>(f),
+                                                     std::forward<PartialInitializer>(partialInitializer),
+                                                     std::forward<FinalInitializer>(finalInitializer),
+                                                     numThreads,
+                                                     std::move(token));
         }
 
         template<template<typename> typename HashFunc>
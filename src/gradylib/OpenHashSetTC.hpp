@@ -27,15 +27,17 @@ SOFTWARE.
  * copyable if we implement the set as an open address hash set and use memcpy to do the work.  A set of
  * 100 million ints is 30x faster to copy and deletion is 150x faster.
  *
- * The 'write' method writes to disk in a format amenable to memory mapped loading.  Any write operations
- * on a set that's been loaded from disk will cause a copy. If read-only operations are used exclusively,
- * then no copy is ever created.
+ * The 'write' method writes to disk in a format amenable to memory mapped loading.  A set loaded from disk is
+ * read only.  Loading with MappingMode::CopyOnWrite makes it mutable: pages are copied by the kernel only as
+ * they're written, and a rehash moves the set to the heap.  If read-only operations are used exclusively, then no
+ * copy is ever created.
  *
  * TODO: byte ordering on disk IO
  *
  * Interface:
  * ---------
  * OpenHashSetTC(filename)
+ * OpenHashSetTC(filename, MappingMode)
  * insert
  * contains
  * erase
@@ -60,7 +62,10 @@ SOFTWARE.
 #include<vector>
 
 #include"AltIntHash.hpp"
+#include"AsyncFileWriter.hpp"
 #include"BitPairSet.hpp"
+#include"MappedFile.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -74,26 +79,44 @@ namespace gradylib {
         double growthFactor = 1.2;
         size_t keySize = 0;
         size_t setSize = 0;
-        int fd = -1;
-        size_t mappingSize = 0;
-        void *memoryMapping = nullptr;
+        MappedFile mappedFile;
         bool readOnly = false;
+        // keys point into a mapping rather than the heap.  With a copy on write mapping the set is modified in place
+        // until the first rehash, which moves it to the heap and drops the mapping.
+        bool mappedKeys = false;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
         void freeResources() {
-            if (memoryMapping) {
-                munmap(memoryMapping, mappingSize);
-                close(fd);
-                memoryMapping = nullptr;
-                fd = -1;
-            } else {
+            if (!mappedKeys) {
                 delete[] keys;
-                keys = nullptr;
             }
+            keys = nullptr;
+            mappedKeys = false;
+            mappedFile = MappedFile();
         }
 
-        void rehash(size_t size = 0) {
+        void setFromMemoryMapping(void const * startPtr, bool copyOnWrite = false) {
+            std::byte const *ptr = static_cast<std::byte const *>(startPtr);
+            std::byte const *base = ptr;
+            setSize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            keySize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            loadFactor = *static_cast<double const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            growthFactor = *static_cast<double const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            size_t bitPairSetOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            ptr += 8;
+            keys = static_cast<Key *>(const_cast<void *>(static_cast<void const *>(ptr)));
+            readOnly = !copyOnWrite;
+            mappedKeys = true;
+            setFlags = BitPairSet(static_cast<void const *>(base + bitPairSetOffset), readOnly);
+        }
+
+        // With a pool the new array is first touched on the nodes that will scan it
+        void rehash(size_t size = 0, ThreadPool * tp = nullptr) {
             size_t newSize;
             if (size > 0) {
                 if (size < setSize) {
@@ -103,7 +126,7 @@ namespace gradylib {
             } else {
                 newSize = std::max<size_t>(keySize + 1, std::max<size_t>(1, keySize) * growthFactor);
             }
-            Key *newKeys = new Key[newSize];
+            Key *newKeys = tp ? gradylib_helpers::allocateFirstTouched<Key>(*tp, newSize) : new Key[newSize];
             BitPairSet newSetFlags(newSize);
             for (size_t i = 0; i < keySize; ++i) {
                 if (!setFlags.isFirstSet(i)) {
@@ -119,10 +142,16 @@ namespace gradylib {
                 newSetFlags.setBoth(idx);
                 newKeys[idx] = k;
             }
-            delete[] keys;
+            if (!mappedKeys) {
+                delete[] keys;
+            }
             keys = newKeys;
             keySize = newSize;
             std::swap(setFlags, newSetFlags);
+            if (mappedKeys) {
+                mappedKeys = false;
+                mappedFile = MappedFile();
+            }
         }
 
     public:
@@ -139,40 +168,47 @@ namespace gradylib {
 
         OpenHashSetTC(OpenHashSetTC &&s)
                 : keys(s.keys), keySize(s.keySize), setFlags(std::move(s.setFlags)), loadFactor(s.loadFactor),
-                  growthFactor(s.growthFactor), setSize(s.setSize) {
+                  growthFactor(s.growthFactor), setSize(s.setSize), mappedFile(std::move(s.mappedFile)),
+                  readOnly(s.readOnly), mappedKeys(s.mappedKeys) {
             s.keys = nullptr;
             s.keySize = 0;
             s.setSize = 0;
+            s.readOnly = false;
+            s.mappedKeys = false;
         }
 
-        explicit OpenHashSetTC(std::string filename) {
-            fd = open(filename.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::ostringstream sstr;
-                sstr << "Error opening file " << filename;
-                throw gradylibMakeException(sstr.str());
-            }
-            mappingSize = std::filesystem::file_size(filename);
-            memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
-            if (memoryMapping == MAP_FAILED) {
-                std::ostringstream sstr;
-                sstr << "memory map failed: " << strerror(errno);
-                throw gradylibMakeException(sstr.str());
-            }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            setSize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            loadFactor = *static_cast<double *>(static_cast<void *>(ptr));
-            ptr += 8;
-            growthFactor = *static_cast<double *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keys = static_cast<Key *>(static_cast<void *>(ptr));
-            setFlags = BitPairSet(static_cast<void *>(bitPairSetOffset + static_cast<std::byte *>(memoryMapping)));
-            readOnly = true;
+        explicit OpenHashSetTC(std::string filename)
+            : mappedFile(filename, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data());
+        }
+
+        explicit OpenHashSetTC(char const * filename)
+            : OpenHashSetTC(std::string(filename))
+        {
+        }
+
+        /*
+         * MappingMode::CopyOnWrite gives a mutable set that starts out sharing the file's pages.  Inserts and erases
+         * touch only the pages they land on; the file itself is never modified.  Growing past the load factor (or
+         * reserve) rehashes onto the heap.
+         */
+        OpenHashSetTC(std::filesystem::path const & filename, MappingMode mode)
+            : mappedFile(filename, mode, mmapFunc)
+        {
+            setFromMemoryMapping(mappedFile.data(), mappedFile.isCopyOnWrite());
+        }
+
+        // Load from a region of memory holding the output of write.  The region is not copied or owned.
+        explicit OpenHashSetTC(void const * startPtr) {
+            setFromMemoryMapping(startPtr);
+        }
+
+        // Take ownership of a mapping, e.g. from attachSharedMemory or MappedFile(memfd)
+        explicit OpenHashSetTC(MappedFile && mappedFile)
+            : mappedFile(std::move(mappedFile))
+        {
+            setFromMemoryMapping(this->mappedFile.data(), this->mappedFile.isCopyOnWrite());
         }
 
         explicit OpenHashSetTC(std::ifstream & ifs) {
@@ -202,6 +238,7 @@ namespace gradylib {
                 return *this;
             }
             freeResources();
+            readOnly = false;
             keys = new Key[s.keySize];
             memcpy(keys, s.keys, sizeof(Key) * s.keySize);
             keySize = s.keySize;
@@ -213,23 +250,25 @@ namespace gradylib {
         }
 
         OpenHashSetTC &operator=(OpenHashSetTC &&s) noexcept {
+            if (this == &s) {
+                return *this;
+            }
+            freeResources();
             keys = s.keys;
             keySize = s.keySize;
-            setFlags = s.setFlags;
+            setFlags = std::move(s.setFlags);
             loadFactor = s.loadFactor;
             growthFactor = s.growthFactor;
             setSize = s.setSize;
             readOnly = s.readOnly;
-            fd = s.fd;
-            memoryMapping = s.memoryMapping;
-            mappingSize = s.mappingSize;
+            mappedKeys = s.mappedKeys;
+            mappedFile = std::move(s.mappedFile);
 
             s.keys = nullptr;
             s.keySize = 0;
             s.setSize = 0;
-            s.fd = -1;
-            s.memoryMapping = nullptr;
-            s.mappingSize = 0;
+            s.readOnly = false;
+            s.mappedKeys = false;
             return *this;
         }
 
@@ -342,6 +381,17 @@ namespace gradylib {
             rehash(size);
         }
 
+        // For large sets on a NUMA pool: the new array's pages are placed on the nodes that parallelFor and
+        // allocateOverThreads will hand its ranges to
+        void reserve(size_t size, ThreadPool & tp) {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify set";
+                throw gradylibMakeException(sstr.str());
+            }
+            rehash(size, &tp);
+        }
+
         class const_iterator {
             size_t idx;
             OpenHashSetTC const * container;
@@ -417,12 +467,17 @@ namespace gradylib {
          */
         void write(std::filesystem::path filename, int alignment = alignof(void*)) {
             std::ofstream ofs(filename, std::ios::binary);
+            write(ofs, alignment);
+        }
+
+        void write(std::ostream & ofs, int alignment = alignof(void*)) {
+            size_t startFileOffset = ofs.tellp();
             ofs.write((char *) &setSize, 8);
             ofs.write((char *) &keySize, 8);
             ofs.write((char *) &loadFactor, 8);
             ofs.write((char *) &growthFactor, 8);
             size_t keyArraySize = sizeof(Key) * keySize;
-            size_t bitPairSetOffset = ofs.tellp();
+            size_t bitPairSetOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
             int padLength = 0;
             if (keyArraySize % 8 == 0) {
                 bitPairSetOffset += 8 + keyArraySize;
@@ -441,6 +496,13 @@ namespace gradylib {
             setFlags.write(ofs);
         }
 
+        // Writes on tp (the default pool if null) overlapping serialization with I/O.  See AsyncFileWriter.hpp.
+        std::future<void> writeAsync(std::filesystem::path filename, int alignment = alignof(void*), ThreadPool * tp = nullptr) {
+            return writeFileAsync(std::move(filename), [this, alignment](std::ostream & os) {
+                write(os, alignment);
+            }, tp);
+        }
+
         template<typename, template<typename> typename>
         friend void GRADY_LIB_MOCK_OpenHashSetTC_MMAP();
 
@@ -0,0 +1,327 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * OverlayMap puts a small mutable delta in front of a large read only memory mapped map.
+ *
+ *     OverlayMap<MMapS2IOpenHashMap<int>> vocab("vocab.bin", 100000);
+ *     vocab.put("new token", 12345);
+ *     vocab.erase("old token");
+ *     std::optional<int> idx = vocab.get("token");
+ *
+ * The delta is an OpenHashMap of upserts and delete markers.  Lookups check the delta and then the base, so writes
+ * are visible immediately and the base stays zero copy.  compact() freezes the current delta, starts a fresh one
+ * for new writes, and writes base + frozen delta to a new file on a ThreadPool.  The new file is renamed over the
+ * old one and swapped in.  Readers that still have the old base mapped are unaffected by the rename.  If
+ * compactionThreshold is nonzero a compaction is started whenever the delta grows to that size.
+ *
+ * The base can be an MMapS2IOpenHashMap or an OpenHashMapTC.  All methods are thread safe.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<filesystem>
+#include<fstream>
+#include<future>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include<shared_mutex>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<vector>
+
+#include"MMapS2IOpenHashMap.hpp"
+#include"OpenHashMap.hpp"
+#include"OpenHashMapTC.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    template<typename BaseMap>
+    struct OverlayBaseTraits;
+
+    template<typename IndexType, template<typename> typename HashFunction>
+    struct OverlayBaseTraits<gradylib::MMapS2IOpenHashMap<IndexType, HashFunction>> {
+        using Key = std::string;
+        using LookupKey = std::string_view;
+        using Value = IndexType;
+
+        static std::optional<Value> get(gradylib::MMapS2IOpenHashMap<IndexType, HashFunction> const & base, std::string_view key) {
+            IndexType const * value = base.find(key);
+            if (!value) {
+                return std::nullopt;
+            }
+            return *value;
+        }
+
+        template<typename Delta>
+        static void writeMerged(std::filesystem::path const & path,
+                                gradylib::MMapS2IOpenHashMap<IndexType, HashFunction> const & base,
+                                Delta const & delta) {
+            // Keys are views into the base's mapping or the delta, so no strings are copied out of the base
+            size_t mergedSize = base.size();
+            for (auto const & [key, value] : delta) {
+                bool inBase = base.contains(key);
+                if (value.has_value() && !inBase) {
+                    ++mergedSize;
+                } else if (!value.has_value() && inBase) {
+                    --mergedSize;
+                }
+            }
+            size_t keySize = std::max<size_t>(mergedSize + 1, mergedSize / 0.8);
+            std::vector<std::string_view> keys(keySize);
+            std::vector<IndexType> values(keySize);
+            gradylib::BitPairSet setFlags(keySize);
+            // Every key is distinct, so each goes in the first free slot of its probe sequence
+            auto place = [&](std::string_view key, IndexType const & value) {
+                size_t idx = base.hashKey(key) % keySize;
+                while (setFlags.isFirstSet(idx)) {
+                    idx = idx + 1 == keySize ? 0 : idx + 1;
+                }
+                keys[idx] = key;
+                values[idx] = value;
+                setFlags.setBoth(idx);
+            };
+            base.forEachInSlots(0, base.numSlots(), [&](std::string_view key, IndexType const & value) {
+                if (!delta.contains(key)) {
+                    place(key, value);
+                }
+            });
+            for (auto const & [key, value] : delta) {
+                if (value.has_value()) {
+                    place(key, *value);
+                }
+            }
+            std::ofstream ofs(path);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open file " << path << " in OverlayMap compaction.";
+                throw gradylibMakeException(sstr.str());
+            }
+            gradylib_helpers::writeMappableS2I(ofs, mergedSize, keySize,
+                                               hashFingerprint<std::string_view>(HashFunction<std::string_view>{}),
+                                               [&keys](size_t i) { return keys[i]; }, values.data(), setFlags);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, template<typename> typename HashFunction>
+    struct OverlayBaseTraits<gradylib::OpenHashMapTC<KeyType, ValueType, HashFunction>> {
+        using Key = KeyType;
+        using LookupKey = KeyType;
+        using Value = ValueType;
+
+        static std::optional<Value> get(gradylib::OpenHashMapTC<KeyType, ValueType, HashFunction> const & base, Key const & key) {
+            Value const * value = base.find(key);
+            if (!value) {
+                return std::nullopt;
+            }
+            return *value;
+        }
+
+        template<typename Delta>
+        static void writeMerged(std::filesystem::path const & path,
+                                gradylib::OpenHashMapTC<KeyType, ValueType, HashFunction> const & base,
+                                Delta const & delta) {
+            gradylib::OpenHashMapTC<KeyType, ValueType, HashFunction> merged(base);
+            for (auto const & [key, value] : delta) {
+                if (value.has_value()) {
+                    merged[key] = *value;
+                } else {
+                    merged.erase(key);
+                }
+            }
+            merged.write(path);
+        }
+    };
+}
+
+namespace gradylib {
+
+    template<typename BaseMap>
+    class OverlayMap {
+        using Traits = gradylib_helpers::OverlayBaseTraits<BaseMap>;
+        using Key = typename Traits::Key;
+        using LookupKey = typename Traits::LookupKey;
+        using Value = typename Traits::Value;
+        // An empty optional is a delete marker
+        using Delta = OpenHashMap<Key, std::optional<Value>>;
+
+        std::filesystem::path basePath;
+        size_t compactionThreshold;
+        ThreadPool * threadPool;
+
+        std::shared_mutex mutable mutex;
+        std::shared_ptr<BaseMap const> base;
+        Delta delta;
+        // The delta being merged into the next base.  Only set while a compaction is running.
+        std::shared_ptr<Delta const> frozen;
+        std::shared_future<void> compaction;
+
+        ThreadPool & getThreadPool() {
+            if (threadPool) {
+                return *threadPool;
+            }
+            return gradylib_helpers::getDefaultThreadPool();
+        }
+
+        // Called with mutex held exclusively
+        std::shared_future<void> startCompaction(ThreadPool & tp) {
+            if (frozen) {
+                return compaction;
+            }
+            if (delta.size() == 0) {
+                std::promise<void> done;
+                done.set_value();
+                return done.get_future().share();
+            }
+            frozen = std::make_shared<Delta const>(std::move(delta));
+            delta = Delta();
+            auto promise = std::make_shared<std::promise<void>>();
+            compaction = promise->get_future().share();
+            tp.add([this, promise, oldBase = base, merging = frozen]() {
+                try {
+                    std::filesystem::path tmpPath = basePath;
+                    tmpPath += ".compact";
+                    Traits::writeMerged(tmpPath, *oldBase, *merging);
+                    auto newBase = std::make_shared<BaseMap const>(tmpPath);
+                    std::filesystem::rename(tmpPath, basePath);
+                    std::unique_lock lock(mutex);
+                    base = std::move(newBase);
+                    frozen.reset();
+                } catch (...) {
+                    {
+                        // Put the frozen entries back, letting anything written since take precedence
+                        std::unique_lock lock(mutex);
+                        for (auto const & [key, value] : *merging) {
+                            if (!delta.contains(key)) {
+                                delta[key] = value;
+                            }
+                        }
+                        frozen.reset();
+                    }
+                    // Not under the lock: the destructor may be waiting on this future and then destroy mutex
+                    promise->set_exception(std::current_exception());
+                    return;
+                }
+                promise->set_value();
+            });
+            return compaction;
+        }
+
+        void maybeCompact() {
+            if (compactionThreshold > 0 && !frozen && delta.size() >= compactionThreshold) {
+                startCompaction(getThreadPool());
+            }
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        // threadPool defaults to the library's default pool
+        explicit OverlayMap(std::filesystem::path basePath, size_t compactionThreshold = 0, ThreadPool * threadPool = nullptr)
+            : basePath(basePath), compactionThreshold(compactionThreshold), threadPool(threadPool),
+              base(std::make_shared<BaseMap const>(basePath))
+        {
+        }
+
+        OverlayMap(OverlayMap const &) = delete;
+
+        OverlayMap & operator=(OverlayMap const &) = delete;
+
+        ~OverlayMap() {
+            std::shared_future<void> pending;
+            {
+                std::shared_lock lock(mutex);
+                pending = compaction;
+            }
+            if (pending.valid()) {
+                pending.wait();
+            }
+        }
+
+        std::optional<Value> get(LookupKey const & key) const {
+            std::shared_lock lock(mutex);
+            auto lookup = delta.get(key);
+            if (lookup.has_value()) {
+                return lookup.value();
+            }
+            if (frozen) {
+                lookup = frozen->get(key);
+                if (lookup.has_value()) {
+                    return lookup.value();
+                }
+            }
+            return Traits::get(*base, key);
+        }
+
+        bool contains(LookupKey const & key) const {
+            return get(key).has_value();
+        }
+
+        Value at(LookupKey const & key) const {
+            std::optional<Value> value = get(key);
+            if (!value.has_value()) {
+                throw gradylibMakeException("OverlayMap doesn't contain key");
+            }
+            return *value;
+        }
+
+        void put(LookupKey const & key, Value const & value) {
+            std::unique_lock lock(mutex);
+            delta[key] = value;
+            maybeCompact();
+        }
+
+        void erase(LookupKey const & key) {
+            std::unique_lock lock(mutex);
+            delta[key] = std::nullopt;
+            maybeCompact();
+        }
+
+        // Number of upserts and delete markers not yet merged into the base
+        size_t deltaSize() const {
+            std::shared_lock lock(mutex);
+            return delta.size() + (frozen ? frozen->size() : 0);
+        }
+
+        /*
+         * Start merging the delta into a new base file.  If a compaction is already running its future is returned
+         * instead.  The future holds any exception from writing or loading the new file; on failure the delta is
+         * kept so nothing is lost.
+         */
+        std::shared_future<void> compact() {
+            std::unique_lock lock(mutex);
+            return startCompaction(getThreadPool());
+        }
+
+        std::shared_future<void> compact(ThreadPool & tp) {
+            std::unique_lock lock(mutex);
+            return startCompaction(tp);
+        }
+    };
+}
@@ -22,14 +22,79 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+/*
+ * Parallel algorithms on a ThreadPool, plus the initializer helpers used by parallelForEach.
+ *
+ *     parallelFor(tp, 0, n, [&](size_t i) { ... });
+ *     parallelFor(tp, 0, n, [&](size_t start, size_t stop) { ... });    // whole chunks
+ *     long total = parallelReduce(tp, v.begin(), v.end(), 0L, std::plus<>{});
+ *     parallelTransform(tp, in.begin(), in.end(), out.begin(), f);
+ *     parallelSort(tp, v.begin(), v.end());
+ *     parallelExclusivePrefixSum(tp, sizes.begin(), sizes.end(), offsets.begin(), size_t(0));
+ *     auto mid = parallelPartition(tp, v.begin(), v.end(), pred);
+ *
+ * Each has an overload without the ThreadPool argument that uses the default pool.  They all block until done.
+ * Their tasks go in a TaskGroup, so they can be called from inside a task running on the same pool.
+ *
+ * Work is split into chunks of at least grain elements (0 picks a size giving a few chunks per thread).  Chunks that
+ * write an output sequence are rounded to a whole number of cache lines of the output element, so two tasks never
+ * write the same line.  The functions passed in must not throw.
+ */
+
 #pragma once
 
+#include<algorithm>
 #include<concepts>
+#include<cstddef>
+#include<functional>
 #include<future>
+#include<iterator>
+#include<numeric>
+#include<optional>
+#include<type_traits>
+#include<utility>
 #include<vector>
 
+#include"ThreadPool.hpp"
+
 namespace gradylib_helpers {
 
+    inline constexpr size_t cacheLineSize = 64;
+
+    // Chunk length for n elements of elementSize bytes (0 if unknown) on numThreads threads
+    inline size_t chunkLength(size_t n, size_t numThreads, size_t grain, size_t elementSize) {
+        size_t chunk = grain;
+        if (chunk == 0) {
+            // A few chunks per thread so stealing can even out uneven work
+            chunk = (n + 4 * numThreads - 1) / (4 * numThreads);
+        }
+        if (elementSize > 0 && elementSize < cacheLineSize) {
+            size_t perLine = cacheLineSize / elementSize;
+            chunk = (chunk + perLine - 1) / perLine * perLine;
+        }
+        return std::max<size_t>(chunk, 1);
+    }
+
+    /*
+     * Returns how many of the first k elements of the stable merge of a[0, na) and b[0, nb) come from a.  Ties are
+     * taken from a first, as std::merge does.
+     */
+    template<typename ItA, typename ItB, typename Compare>
+    size_t mergeSplit(ItA a, size_t na, ItB b, size_t nb, size_t k, Compare & comp) {
+        size_t lo = k > nb ? k - nb : 0;
+        size_t hi = std::min(k, na);
+        while (lo < hi) {
+            size_t i = lo + (hi - lo) / 2;
+            size_t j = k - i;
+            if (j > 0 && !comp(b[j - 1], a[i])) {
+                lo = i + 1;
+            } else {
+                hi = i;
+            }
+        }
+        return lo;
+    }
+
     template<typename T>
     struct PartialDefaultConstructor {
         T operator()(int threadIdx, int numThreads) {
@@ -45,3 +110,298 @@ namespace gradylib_helpers {
     };
 
 }
+
+namespace gradylib {
+
+    /*
+     * Calls f(i) for each i in [begin, end), or f(start, stop) for each chunk if f takes two indices.
+     */
+    template<std::integral Index, typename Function>
+    requires std::invocable<Function &, Index> || std::invocable<Function &, Index, Index>
+    void parallelFor(ThreadPool & tp, Index begin, Index end, Function && f, size_t grain = 0) {
+        if (end <= begin) {
+            return;
+        }
+        size_t n = end - begin;
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, 0);
+        size_t numChunks = (n + chunk - 1) / chunk;
+        TaskGroup group(tp);
+        for (size_t c = 0; c < numChunks; ++c) {
+            Index chunkBegin = begin + c * chunk;
+            Index chunkEnd = begin + std::min(n, (c + 1) * chunk);
+            // On a NUMA pool consecutive chunks go to the nodes in order, as with firstTouch
+            group.addOnNode(tp.nodeForPart(c, numChunks), [&f, chunkBegin, chunkEnd]() {
+                if constexpr (std::invocable<Function &, Index, Index>) {
+                    f(chunkBegin, chunkEnd);
+                } else {
+                    for (Index i = chunkBegin; i < chunkEnd; ++i) {
+                        f(i);
+                    }
+                }
+            });
+        }
+        group.wait();
+    }
+
+    template<std::integral Index, typename Function>
+    requires std::invocable<Function &, Index> || std::invocable<Function &, Index, Index>
+    void parallelFor(Index begin, Index end, Function && f, size_t grain = 0) {
+        parallelFor(gradylib_helpers::getDefaultThreadPool(), begin, end, std::forward<Function>(f), grain);
+    }
+
+    /*
+     * Folds [first, last) with op, which must be associative.  Chunks are combined in order, so op need not be
+     * commutative.  init is combined once, on the left.
+     */
+    template<std::random_access_iterator It, typename T, typename BinaryOp = std::plus<>>
+    T parallelReduce(ThreadPool & tp, It first, It last, T init, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        size_t n = last - first;
+        if (n == 0) {
+            return init;
+        }
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, 0);
+        size_t numChunks = (n + chunk - 1) / chunk;
+        std::vector<std::optional<T>> partials(numChunks);
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            It it = first + c * chunk;
+            It stop = first + std::min(n, (c + 1) * chunk);
+            T acc = *it;
+            for (++it; it != stop; ++it) {
+                acc = op(std::move(acc), *it);
+            }
+            partials[c] = std::move(acc);
+        }, 1);
+        for (auto & partial : partials) {
+            init = op(std::move(init), std::move(*partial));
+        }
+        return init;
+    }
+
+    template<std::random_access_iterator It, typename T, typename BinaryOp = std::plus<>>
+    T parallelReduce(It first, It last, T init, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        return parallelReduce(gradylib_helpers::getDefaultThreadPool(), first, last, std::move(init), op, grain);
+    }
+
+    // out[i] = f(first[i]).  out may equal first.  Returns the end of the output.
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename Function>
+    OutIt parallelTransform(ThreadPool & tp, InIt first, InIt last, OutIt out, Function f, size_t grain = 0) {
+        size_t n = last - first;
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, sizeof(std::iter_value_t<OutIt>));
+        parallelFor(tp, size_t(0), n, [&](size_t start, size_t stop) {
+            std::transform(first + start, first + stop, out + start, f);
+        }, chunk);
+        return out + n;
+    }
+
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename Function>
+    OutIt parallelTransform(InIt first, InIt last, OutIt out, Function f, size_t grain = 0) {
+        return parallelTransform(gradylib_helpers::getDefaultThreadPool(), first, last, out, std::move(f), grain);
+    }
+
+    /*
+     * Merge sort: chunks are sorted in parallel with std::sort and then merged pairwise, each merge itself split
+     * into chunk sized pieces, through a buffer of the same length.  The value type must be default constructible and
+     * move assignable.  Not stable.
+     */
+    template<std::random_access_iterator It, typename Compare = std::less<>>
+    void parallelSort(ThreadPool & tp, It first, It last, Compare comp = Compare{}, size_t grain = 0) {
+        using T = std::iter_value_t<It>;
+        size_t n = last - first;
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, sizeof(T));
+        if (grain == 0) {
+            // Below a few thousand elements per chunk the merge rounds cost more than they save
+            chunk = std::max<size_t>(chunk, 4096);
+        }
+        if (n <= chunk) {
+            std::sort(first, last, comp);
+            return;
+        }
+        size_t numChunks = (n + chunk - 1) / chunk;
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            std::sort(first + c * chunk, first + std::min(n, (c + 1) * chunk), comp);
+        }, 1);
+
+        std::vector<T> buffer(n);
+        // Where each chunk of the output of a merge round starts in the left run of its pair
+        std::vector<size_t> splits(numChunks);
+        auto mergeRound = [&](auto src, auto dst, size_t width) {
+            auto pairOf = [&](size_t c, size_t & left, size_t & mid, size_t & na, size_t & nb) {
+                left = c * chunk / (2 * width) * (2 * width);
+                mid = std::min(n, left + width);
+                na = mid - left;
+                nb = std::min(n, left + 2 * width) - mid;
+            };
+            // Split points are all found before anything is moved out of src
+            parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+                size_t left, mid, na, nb;
+                pairOf(c, left, mid, na, nb);
+                splits[c] = gradylib_helpers::mergeSplit(src + left, na, src + mid, nb, c * chunk - left, comp);
+            }, 16);
+            parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+                size_t left, mid, na, nb;
+                pairOf(c, left, mid, na, nb);
+                size_t k = c * chunk - left;
+                size_t kEnd = std::min(na + nb, k + chunk);
+                size_t i0 = splits[c];
+                size_t i1 = kEnd == na + nb ? na : splits[c + 1];
+                std::merge(std::make_move_iterator(src + left + i0), std::make_move_iterator(src + left + i1),
+                           std::make_move_iterator(src + mid + (k - i0)), std::make_move_iterator(src + mid + (kEnd - i1)),
+                           dst + left + k, comp);
+            }, 1);
+        };
+        bool inBuffer = false;
+        for (size_t width = chunk; width < n; width *= 2) {
+            if (inBuffer) {
+                mergeRound(buffer.begin(), first, width);
+            } else {
+                mergeRound(first, buffer.begin(), width);
+            }
+            inBuffer = !inBuffer;
+        }
+        if (inBuffer) {
+            parallelFor(tp, size_t(0), n, [&](size_t start, size_t stop) {
+                std::move(buffer.begin() + start, buffer.begin() + stop, first + start);
+            }, chunk);
+        }
+    }
+
+    template<std::random_access_iterator It, typename Compare = std::less<>>
+    void parallelSort(It first, It last, Compare comp = Compare{}, size_t grain = 0) {
+        parallelSort(gradylib_helpers::getDefaultThreadPool(), first, last, std::move(comp), grain);
+    }
+
+    /*
+     * Inclusive scan: out[i] = first[0] op ... op first[i].  op must be associative.  out may equal first.  Returns
+     * the end of the output.
+     */
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename BinaryOp = std::plus<>>
+    OutIt parallelPrefixSum(ThreadPool & tp, InIt first, InIt last, OutIt out, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        using T = std::iter_value_t<InIt>;
+        size_t n = last - first;
+        if (n == 0) {
+            return out;
+        }
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, sizeof(std::iter_value_t<OutIt>));
+        size_t numChunks = (n + chunk - 1) / chunk;
+        // First pass: the total of each chunk.  The last chunk's total isn't needed.
+        std::vector<std::optional<T>> offsets(numChunks);
+        parallelFor(tp, size_t(0), numChunks - 1, [&](size_t c) {
+            T acc = first[c * chunk];
+            for (size_t i = c * chunk + 1; i < (c + 1) * chunk; ++i) {
+                acc = op(std::move(acc), first[i]);
+            }
+            offsets[c + 1] = std::move(acc);
+        }, 1);
+        for (size_t c = 2; c < numChunks; ++c) {
+            offsets[c] = op(*offsets[c - 1], std::move(*offsets[c]));
+        }
+        // Second pass: scan each chunk starting from the total of the chunks before it
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            size_t start = c * chunk;
+            size_t stop = std::min(n, start + chunk);
+            T acc = offsets[c] ? op(*offsets[c], first[start]) : T(first[start]);
+            for (size_t i = start + 1; i < stop; ++i) {
+                T next = op(acc, first[i]);
+                out[i - 1] = std::move(acc);
+                acc = std::move(next);
+            }
+            out[stop - 1] = std::move(acc);
+        }, 1);
+        return out + n;
+    }
+
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename BinaryOp = std::plus<>>
+    OutIt parallelPrefixSum(InIt first, InIt last, OutIt out, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        return parallelPrefixSum(gradylib_helpers::getDefaultThreadPool(), first, last, out, std::move(op), grain);
+    }
+
+    /*
+     * Exclusive scan: out[0] = init, out[i] = init op first[0] op ... op first[i-1].  The usual way to turn record
+     * sizes into file offsets.  out may equal first.  Returns init op the whole sequence, i.e. the total.
+     */
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename T, typename BinaryOp = std::plus<>>
+    T parallelExclusivePrefixSum(ThreadPool & tp, InIt first, InIt last, OutIt out, T init, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        size_t n = last - first;
+        if (n == 0) {
+            return init;
+        }
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, sizeof(std::iter_value_t<OutIt>));
+        size_t numChunks = (n + chunk - 1) / chunk;
+        std::vector<std::optional<T>> offsets(numChunks + 1);
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            size_t start = c * chunk;
+            size_t stop = std::min(n, start + chunk);
+            T acc = first[start];
+            for (size_t i = start + 1; i < stop; ++i) {
+                acc = op(std::move(acc), first[i]);
+            }
+            offsets[c + 1] = std::move(acc);
+        }, 1);
+        offsets[0] = std::move(init);
+        for (size_t c = 1; c <= numChunks; ++c) {
+            offsets[c] = op(*offsets[c - 1], std::move(*offsets[c]));
+        }
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            size_t start = c * chunk;
+            size_t stop = std::min(n, start + chunk);
+            T acc = *offsets[c];
+            for (size_t i = start; i < stop; ++i) {
+                T next = op(acc, first[i]);
+                out[i] = std::move(acc);
+                acc = std::move(next);
+            }
+        }, 1);
+        return std::move(*offsets[numChunks]);
+    }
+
+    template<std::random_access_iterator InIt, std::random_access_iterator OutIt, typename T, typename BinaryOp = std::plus<>>
+    T parallelExclusivePrefixSum(InIt first, InIt last, OutIt out, T init, BinaryOp op = BinaryOp{}, size_t grain = 0) {
+        return parallelExclusivePrefixSum(gradylib_helpers::getDefaultThreadPool(), first, last, out, std::move(init), std::move(op), grain);
+    }
+
+    /*
+     * Stable partition: elements satisfying pred move to the front, keeping their relative order, as do the rest.
+     * Returns the first element not satisfying pred.  pred is called twice per element.  The value type must be
+     * default constructible and move assignable.
+     */
+    template<std::random_access_iterator It, typename Predicate>
+    It parallelPartition(ThreadPool & tp, It first, It last, Predicate pred, size_t grain = 0) {
+        using T = std::iter_value_t<It>;
+        size_t n = last - first;
+        if (n == 0) {
+            return first;
+        }
+        size_t chunk = gradylib_helpers::chunkLength(n, tp.size(), grain, sizeof(T));
+        size_t numChunks = (n + chunk - 1) / chunk;
+        std::vector<size_t> trueCounts(numChunks + 1, 0);
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            trueCounts[c + 1] = std::count_if(first + c * chunk, first + std::min(n, (c + 1) * chunk), pred);
+        }, 1);
+        std::partial_sum(trueCounts.begin(), trueCounts.end(), trueCounts.begin());
+        size_t numTrue = trueCounts[numChunks];
+        std::vector<T> buffer(n);
+        parallelFor(tp, size_t(0), numChunks, [&](size_t c) {
+            size_t start = c * chunk;
+            size_t stop = std::min(n, start + chunk);
+            size_t trueOut = trueCounts[c];
+            // Elements before this chunk that didn't satisfy pred
+            size_t falseOut = numTrue + start - trueCounts[c];
+            for (size_t i = start; i < stop; ++i) {
+                if (pred(first[i])) {
+                    buffer[trueOut++] = std::move(first[i]);
+                } else {
+                    buffer[falseOut++] = std::move(first[i]);
+                }
+            }
+        }, 1);
+        parallelFor(tp, size_t(0), n, [&](size_t start, size_t stop) {
+            std::move(buffer.begin() + start, buffer.begin() + stop, first + start);
+        }, chunk);
+        return first + numTrue;
+    }
+
+    template<std::random_access_iterator It, typename Predicate>
+    It parallelPartition(It first, It last, Predicate pred, size_t grain = 0) {
+        return parallelPartition(gradylib_helpers::getDefaultThreadPool(), first, last, std::move(pred), grain);
+    }
+}
@@ -0,0 +1,496 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A pipeline of stages running concurrently on a ThreadPool, connected by bounded queues.
+ *
+ *     std::ifstream in("words.txt");
+ *     OpenHashMap<std::string, int> counts;
+ *     std::future<void> done = makePipeline(tp, [&]() -> std::optional<std::string> {
+ *                 std::string line;
+ *                 if (!std::getline(in, line)) return std::nullopt;
+ *                 return line;
+ *             })
+ *             .then([](std::string && line) { return normalize(line); }, 8)   // 8 tasks at once
+ *             .then([](std::string && word) -> std::optional<std::string> {   // nullopt drops the item
+ *                 if (word.empty()) return std::nullopt;
+ *                 return word;
+ *             }, 8)
+ *             .sink([&](std::string && word) { ++counts[word]; });           // one task at a time
+ *     done.get();
+ *
+ * The source is called until it returns nullopt.  Items move between stages in batches of
+ * PipelineOptions::batchSize, through a lock free MPMCQueue per stage holding at most queueCapacity batches.  A stage
+ * only takes a batch from its input once it has reserved room in its output, so a slow stage holds back the stages
+ * before it.  The most that is ever in flight is about (stages * queueCapacity + the stages' parallelism) batches,
+ * not the whole data set.
+ *
+ * Nothing blocks a worker.  A stage has up to `parallelism` tasks queued or running on the pool.  A task processes
+ * batches until its input is empty or its output is full, then ends, and a new one is started when an upstream
+ * stage pushes a batch or a downstream stage frees room.  So a pipeline keeps running on a pool with a single worker.
+ * The source and any stage with parallelism 1 see items in order; stages with more parallelism may reorder
+ * batches.
+ *
+ * If any function throws, the source stops, the remaining items are dropped, and the future returned by sink holds
+ * the first exception.  Functions called from several tasks at once (parallelism > 1) must be thread safe.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<cstddef>
+#include<exception>
+#include<future>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"Exception.hpp"
+#include"MPMCQueue.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    struct PipelineOptions {
+        // Items per batch passed between stages
+        size_t batchSize = 1024;
+        // Batches each queue between stages can hold
+        size_t queueCapacity = 4;
+    };
+}
+
+namespace gradylib_helpers {
+
+    template<typename T>
+    struct IsOptional : std::false_type {
+    };
+
+    template<typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {
+    };
+
+    // The item type a stage function returning R produces.  Returning an optional filters.
+    template<typename R>
+    struct StageOutput {
+        using type = R;
+    };
+
+    template<typename T>
+    struct StageOutput<std::optional<T>> {
+        using type = T;
+    };
+
+    // The queue between two stages
+    template<typename T>
+    class Channel {
+        gradylib::MPMCQueue<std::vector<T>> queue;
+        size_t capacity;
+        // Batches in the queue or about to be pushed by a producer that has reserved room
+        std::atomic<size_t> reserved{0};
+        // Batches in the queue
+        std::atomic<size_t> queued{0};
+        std::atomic<bool> closed{false};
+
+    public:
+        explicit Channel(size_t capacity)
+            : queue(capacity), capacity(capacity)
+        {
+        }
+
+        bool tryReserve() {
+            if (reserved.fetch_add(1) >= capacity) {
+                reserved.fetch_sub(1);
+                return false;
+            }
+            return true;
+        }
+
+        void unreserve() {
+            reserved.fetch_sub(1);
+        }
+
+        bool hasRoom() const {
+            return reserved.load() < capacity;
+        }
+
+        // Needs a reservation, so it always succeeds
+        void push(std::vector<T> && batch) {
+            queue.tryPush(std::move(batch));
+            queued.fetch_add(1);
+        }
+
+        bool tryPop(std::vector<T> & batch) {
+            if (!queue.tryPop(batch)) {
+                return false;
+            }
+            queued.fetch_sub(1);
+            reserved.fetch_sub(1);
+            return true;
+        }
+
+        bool hasBatches() const {
+            return queued.load() > 0;
+        }
+
+        void close() {
+            closed.store(true);
+        }
+
+        // Closed and drained: nothing more will arrive
+        bool isDone() const {
+            return closed.load() && queued.load() == 0;
+        }
+    };
+
+    class StageBase;
+
+    struct PipelineState : std::enable_shared_from_this<PipelineState> {
+        gradylib::ThreadPool & tp;
+        gradylib::PipelineOptions options;
+        std::vector<std::unique_ptr<StageBase>> stages;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::promise<void> done;
+
+        PipelineState(gradylib::ThreadPool & tp, gradylib::PipelineOptions options)
+            : tp(tp), options(options)
+        {
+            if (options.batchSize == 0 || options.queueCapacity == 0) {
+                throw gradylibMakeException("Pipeline batchSize and queueCapacity must be positive");
+            }
+        }
+
+        void fail(std::exception_ptr e) {
+            if (!failed.exchange(true)) {
+                error = std::move(e);
+            }
+        }
+
+        // Called once, by the sink when its input is done
+        void finish() {
+            if (failed.load()) {
+                done.set_exception(error);
+            } else {
+                done.set_value();
+            }
+        }
+    };
+
+    /*
+     * Runs a stage's tasks.  active counts the stage's tasks queued or running.  wake() is called whenever the
+     * stage might have work: an upstream pushed or closed, a downstream popped, or one of the stage's own tasks
+     * ended.  The queue counters and active are all sequentially consistent, so either a task that is about to end
+     * sees new work or the thread that made the work sees that the task has ended and starts another.
+     */
+    class StageBase {
+        std::atomic<size_t> active{0};
+        std::atomic<bool> finished{false};
+
+        void run() {
+            runBatches();
+            active.fetch_sub(1);
+            wake();
+        }
+
+    protected:
+        PipelineState * state;
+        size_t parallelism;
+
+        // Input is available and there is room for output
+        virtual bool hasWork() const = 0;
+
+        // No more input will arrive
+        virtual bool inputDone() const = 0;
+
+        // Process batches while there is work
+        virtual void runBatches() = 0;
+
+        // Called once, after inputDone() and the last task has ended
+        virtual void finish() = 0;
+
+    public:
+        StageBase(PipelineState * state, size_t parallelism)
+            : state(state), parallelism(parallelism)
+        {
+            if (parallelism == 0) {
+                throw gradylibMakeException("Pipeline stage parallelism must be positive");
+            }
+        }
+
+        virtual ~StageBase() = default;
+
+        void wake() {
+            size_t running = active.load();
+            while (running < parallelism && hasWork()) {
+                if (active.compare_exchange_weak(running, running + 1)) {
+                    state->tp.add([this, keepAlive = state->shared_from_this()]() {
+                        run();
+                    });
+                    return;
+                }
+            }
+            if (running == 0 && inputDone() && active.load() == 0 && !finished.exchange(true)) {
+                finish();
+            }
+        }
+    };
+
+    // A stage with an output queue
+    template<typename T>
+    class OutputStage : public StageBase {
+    public:
+        Channel<T> output;
+        StageBase * downstream = nullptr;
+
+        OutputStage(PipelineState * state, size_t parallelism)
+            : StageBase(state, parallelism), output(state->options.queueCapacity)
+        {
+        }
+
+    protected:
+        void emit(std::vector<T> && batch) {
+            if (batch.empty()) {
+                output.unreserve();
+                return;
+            }
+            output.push(std::move(batch));
+            downstream->wake();
+        }
+
+        void finish() override {
+            output.close();
+            downstream->wake();
+        }
+    };
+
+    template<typename T, typename Source>
+    class SourceStage : public OutputStage<T> {
+        Source source;
+        std::atomic<bool> exhausted{false};
+
+    protected:
+        bool hasWork() const override {
+            return !exhausted.load() && this->output.hasRoom();
+        }
+
+        bool inputDone() const override {
+            return exhausted.load();
+        }
+
+        void runBatches() override {
+            while (!exhausted.load() && this->output.tryReserve()) {
+                std::vector<T> batch;
+                batch.reserve(this->state->options.batchSize);
+                try {
+                    while (batch.size() < this->state->options.batchSize && !this->state->failed.load()) {
+                        std::optional<T> item = source();
+                        if (!item) {
+                            break;
+                        }
+                        batch.push_back(std::move(*item));
+                    }
+                } catch (...) {
+                    this->state->fail(std::current_exception());
+                }
+                if (batch.size() < this->state->options.batchSize) {
+                    exhausted.store(true);
+                }
+                this->emit(std::move(batch));
+            }
+        }
+
+    public:
+        SourceStage(PipelineState * state, Source && source)
+            : OutputStage<T>(state, 1), source(std::move(source))
+        {
+        }
+    };
+
+    template<typename In, typename Out, typename F>
+    class MapStage : public OutputStage<Out> {
+        OutputStage<In> * upstream;
+        F f;
+
+    protected:
+        bool hasWork() const override {
+            return upstream->output.hasBatches() && this->output.hasRoom();
+        }
+
+        bool inputDone() const override {
+            return upstream->output.isDone();
+        }
+
+        void runBatches() override {
+            while (this->output.tryReserve()) {
+                std::vector<In> batch;
+                if (!upstream->output.tryPop(batch)) {
+                    this->output.unreserve();
+                    break;
+                }
+                upstream->wake();
+                std::vector<Out> out;
+                if (!this->state->failed.load()) {
+                    try {
+                        out.reserve(batch.size());
+                        for (In & item : batch) {
+                            if constexpr (IsOptional<std::invoke_result_t<F &, In &&>>::value) {
+                                auto result = f(std::move(item));
+                                if (result) {
+                                    out.push_back(std::move(*result));
+                                }
+                            } else {
+                                out.push_back(f(std::move(item)));
+                            }
+                        }
+                    } catch (...) {
+                        this->state->fail(std::current_exception());
+                        out.clear();
+                    }
+                }
+                this->emit(std::move(out));
+            }
+        }
+
+    public:
+        MapStage(PipelineState * state, OutputStage<In> * upstream, F && f, size_t parallelism)
+            : OutputStage<Out>(state, parallelism), upstream(upstream), f(std::move(f))
+        {
+        }
+    };
+
+    template<typename In, typename F>
+    class SinkStage : public StageBase {
+        OutputStage<In> * upstream;
+        F f;
+
+    protected:
+        bool hasWork() const override {
+            return upstream->output.hasBatches();
+        }
+
+        bool inputDone() const override {
+            return upstream->output.isDone();
+        }
+
+        void runBatches() override {
+            std::vector<In> batch;
+            while (upstream->output.tryPop(batch)) {
+                upstream->wake();
+                if (this->state->failed.load()) {
+                    continue;
+                }
+                try {
+                    for (In & item : batch) {
+                        f(std::move(item));
+                    }
+                } catch (...) {
+                    this->state->fail(std::current_exception());
+                }
+            }
+        }
+
+        void finish() override {
+            state->finish();
+        }
+
+    public:
+        SinkStage(PipelineState * state, OutputStage<In> * upstream, F && f, size_t parallelism)
+            : StageBase(state, parallelism), upstream(upstream), f(std::move(f))
+        {
+        }
+    };
+}
+
+namespace gradylib {
+
+    // A pipeline under construction whose last stage produces T.  Nothing runs until sink is called.
+    template<typename T>
+    class Pipeline {
+        std::shared_ptr<gradylib_helpers::PipelineState> state;
+        gradylib_helpers::OutputStage<T> * last;
+
+        template<typename U>
+        friend class Pipeline;
+
+        template<typename Source>
+        friend auto makePipeline(ThreadPool & tp, Source && source, PipelineOptions options);
+
+        Pipeline(std::shared_ptr<gradylib_helpers::PipelineState> state, gradylib_helpers::OutputStage<T> * last)
+            : state(std::move(state)), last(last)
+        {
+        }
+
+    public:
+        // f(T &&) returns the next stage's item, or an optional of it where nullopt drops the item
+        template<typename F>
+        requires std::is_invocable_v<std::decay_t<F> &, T &&>
+        auto then(F && f, size_t parallelism = 1) && {
+            using Result = std::invoke_result_t<std::decay_t<F> &, T &&>;
+            static_assert(!std::is_void_v<Result>, "A pipeline stage must return a value; use sink for the last stage");
+            using Out = typename gradylib_helpers::StageOutput<Result>::type;
+            auto stage = std::make_unique<gradylib_helpers::MapStage<T, Out, std::decay_t<F>>>(
+                    state.get(), last, std::decay_t<F>(std::forward<F>(f)), parallelism);
+            last->downstream = stage.get();
+            gradylib_helpers::OutputStage<Out> * newLast = stage.get();
+            state->stages.push_back(std::move(stage));
+            return Pipeline<Out>(std::move(state), newLast);
+        }
+
+        // Adds the last stage and starts the pipeline.  The future is ready when every item has been through f.
+        template<typename F>
+        requires std::is_invocable_v<std::decay_t<F> &, T &&>
+        std::future<void> sink(F && f, size_t parallelism = 1) && {
+            auto stage = std::make_unique<gradylib_helpers::SinkStage<T, std::decay_t<F>>>(
+                    state.get(), last, std::decay_t<F>(std::forward<F>(f)), parallelism);
+            last->downstream = stage.get();
+            state->stages.push_back(std::move(stage));
+            std::future<void> ret = state->done.get_future();
+            state->stages.front()->wake();
+            state.reset();
+            return ret;
+        }
+    };
+
+    // source() returns std::optional<T>, nullopt once there are no more items.  It is never called concurrently.
+    template<typename Source>
+    auto makePipeline(ThreadPool & tp, Source && source, PipelineOptions options = {}) {
+        using Item = std::invoke_result_t<std::decay_t<Source> &>;
+        static_assert(gradylib_helpers::IsOptional<Item>::value, "A pipeline source must return a std::optional");
+        using T = typename Item::value_type;
+        auto state = std::make_shared<gradylib_helpers::PipelineState>(tp, options);
+        auto stage = std::make_unique<gradylib_helpers::SourceStage<T, std::decay_t<Source>>>(
+                state.get(), std::decay_t<Source>(std::forward<Source>(source)));
+        gradylib_helpers::OutputStage<T> * last = stage.get();
+        state->stages.push_back(std::move(stage));
+        return Pipeline<T>(std::move(state), last);
+    }
+
+    template<typename Source>
+    auto makePipeline(Source && source, PipelineOptions options = {}) {
+        return makePipeline(gradylib_helpers::getDefaultThreadPool(), std::forward<Source>(source), options);
+    }
+}
@@ -0,0 +1,402 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Publish a serialized container into shared memory so many processes can map one physical copy.
+ *
+ * The publish functions take a callable that writes the container to a std::ostream, e.g.
+ *
+ *     publishSharedMemory("/vocab", [&](std::ostream & os) { writeMappable(os, vocab); });
+ *     MMapS2IOpenHashMap<int> m(attachSharedMemory("/vocab"));
+ *
+ * The bytes go straight into a shared mapping of the object; nothing is staged on disk or in a heap buffer.
+ *
+ * publishHugePageFile does the same for a file on a hugetlbfs mount.  hugetlbfs doesn't support write(2), which is
+ * why everything here writes through a mapping.  The file is written under a temporary name and renamed into place,
+ * so readers never see a partial file.
+ *
+ * A shm object can't be renamed, so publishSharedMemory unlinks any old object and writes the new one in place.  A
+ * reader can open it while it's still being written.  To catch that, the object starts with a small header whose
+ * completion flag is set only after the data is written, and attachSharedMemory throws if the flag isn't set yet;
+ * a reader racing a publish should retry.  Processes that already attached keep the old copy until they unmap it.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<atomic>
+#include<concepts>
+#include<cstdint>
+#include<cstring>
+#include<filesystem>
+#include<limits>
+#include<ostream>
+#include<sstream>
+#include<streambuf>
+#include<string>
+
+#include"Exception.hpp"
+#include"MappedFile.hpp"
+
+namespace gradylib_helpers {
+
+    /*
+     * The start of a published shm object.  The container's bytes follow at sharedMemoryHeaderSize, which keeps them
+     * as aligned as the mapping up to 64 bytes.
+     */
+    struct SharedMemoryHeader {
+        // sharedMemoryComplete once size and the data are written
+        uint64_t complete;
+        uint64_t size;
+    };
+
+    inline constexpr size_t sharedMemoryHeaderSize = 64;
+    inline constexpr uint64_t sharedMemoryComplete = 0x677261647973686dULL;
+
+    /*
+     * A streambuf that writes into a MAP_SHARED mapping of fd, growing the file as the writer advances.
+     * Growth happens in multiples of st_blksize, which is the huge page size on hugetlbfs.  The first headerSize
+     * bytes of the file are skipped; stream positions are relative to the end of them.
+     */
+    class SharedMemoryStreamBuf : public std::streambuf {
+        int fd;
+        size_t headerSize;
+        char * mapping = nullptr;
+        // Size of the mapping, header included
+        size_t capacity = 0;
+        size_t highWater = 0;
+        size_t granularity = 4096;
+
+        size_t position() const {
+            return pptr() - pbase();
+        }
+
+        void setPosition(size_t pos) {
+            setp(mapping + headerSize, mapping + capacity);
+            // pbump takes an int
+            while (pos > 0) {
+                int step = static_cast<int>(std::min<size_t>(pos, std::numeric_limits<int>::max()));
+                pbump(step);
+                pos -= step;
+            }
+        }
+
+        void grow(size_t needed) {
+            size_t pos = position();
+            highWater = std::max(highWater, pos);
+            size_t newCapacity = std::max(headerSize + needed, capacity * 2);
+            newCapacity = (newCapacity + granularity - 1) / granularity * granularity;
+            if (ftruncate(fd, newCapacity) != 0) {
+                std::ostringstream sstr;
+                sstr << "ftruncate failed growing shared memory: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            void * newMapping = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (newMapping == MAP_FAILED) {
+                std::ostringstream sstr;
+                sstr << "memory map failed growing shared memory: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            if (mapping) {
+                munmap(mapping, capacity);
+            }
+            mapping = static_cast<char *>(newMapping);
+            capacity = newCapacity;
+            setPosition(pos);
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            if (traits_type::eq_int_type(ch, traits_type::eof())) {
+                return traits_type::not_eof(ch);
+            }
+            grow(position() + 1);
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+            return ch;
+        }
+
+        std::streamsize xsputn(char const * s, std::streamsize n) override {
+            size_t pos = position();
+            if (headerSize + pos + n > capacity) {
+                grow(pos + n);
+            }
+            memcpy(pptr(), s, n);
+            setPosition(pos + n);
+            return n;
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+            highWater = std::max(highWater, position());
+            off_type base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? position() : highWater;
+            return seekpos(pos_type(base + off), which);
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            off_type p = off_type(pos);
+            if (!(which & std::ios_base::out) || p < 0) {
+                return pos_type(off_type(-1));
+            }
+            highWater = std::max(highWater, position());
+            if (headerSize + p > capacity) {
+                grow(p);
+            }
+            setPosition(p);
+            return pos;
+        }
+
+    public:
+        explicit SharedMemoryStreamBuf(int fd, size_t headerSize = 0)
+            : fd(fd), headerSize(headerSize)
+        {
+            struct stat statBuf;
+            if (fstat(fd, &statBuf) == 0 && statBuf.st_blksize > 0) {
+                granularity = statBuf.st_blksize;
+            }
+        }
+
+        SharedMemoryStreamBuf(SharedMemoryStreamBuf const &) = delete;
+
+        SharedMemoryStreamBuf & operator=(SharedMemoryStreamBuf const &) = delete;
+
+        ~SharedMemoryStreamBuf() {
+            if (mapping) {
+                munmap(mapping, capacity);
+            }
+        }
+
+        // Trim the object to the bytes written, unmap it, and return the size, not counting the header.  Huge page
+        // backed objects can only be sized in whole huge pages so they keep the rounded up size.
+        size_t finish() {
+            highWater = std::max(highWater, position());
+            if (!mapping && headerSize > 0) {
+                // Nothing was written, but the header still needs space
+                grow(0);
+            }
+            if (mapping) {
+                munmap(mapping, capacity);
+                mapping = nullptr;
+            }
+            setp(nullptr, nullptr);
+            if (granularity <= static_cast<size_t>(sysconf(_SC_PAGESIZE)) && headerSize + highWater < capacity) {
+                if (ftruncate(fd, headerSize + highWater) != 0) {
+                    std::ostringstream sstr;
+                    sstr << "ftruncate failed trimming shared memory: " << strerror(errno);
+                    throw gradylibMakeException(sstr.str());
+                }
+            }
+            capacity = 0;
+            return highWater;
+        }
+    };
+
+    // Writes after the first headerSize bytes of fd and returns the number of bytes written
+    template<typename WriteFunction>
+    requires std::invocable<WriteFunction, std::ostream &>
+    size_t writeToDescriptor(int fd, WriteFunction && writeFunction, size_t headerSize = 0) {
+#ifdef __APPLE__
+        // A macOS shm object can only be sized once, so it can't grow as it's written.  Stage the bytes instead.
+        std::ostringstream staging;
+        writeFunction(static_cast<std::ostream &>(staging));
+        std::string bytes = std::move(staging).str();
+        size_t size = headerSize + bytes.size();
+        if (ftruncate(fd, size) != 0) {
+            std::ostringstream sstr;
+            sstr << "ftruncate failed sizing shared memory: " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::ostringstream sstr;
+            sstr << "memory map failed: " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        memcpy(static_cast<char *>(mapping) + headerSize, bytes.data(), bytes.size());
+        munmap(mapping, size);
+        return bytes.size();
+#else
+        SharedMemoryStreamBuf buf(fd, headerSize);
+        std::ostream os(&buf);
+        writeFunction(os);
+        if (os.fail()) {
+            throw gradylibMakeException("Writing to shared memory failed");
+        }
+        return buf.finish();
+#endif
+    }
+
+    // Fills in the header of a published shm object, setting the completion flag last
+    inline void markSharedMemoryComplete(int fd, size_t size) {
+        void * mapping = mmap(nullptr, sharedMemoryHeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::ostringstream sstr;
+            sstr << "memory map failed: " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        SharedMemoryHeader * header = static_cast<SharedMemoryHeader *>(mapping);
+        header->size = size;
+        std::atomic_ref<uint64_t>(header->complete).store(sharedMemoryComplete, std::memory_order_release);
+        munmap(mapping, sharedMemoryHeaderSize);
+    }
+}
+
+namespace gradylib {
+
+    /*
+     * Write a container into the POSIX shared memory object 'name' (shm_open naming, e.g. "/vocab").  An existing
+     * object of the same name is unlinked first.  The object is marked complete once the container is written.
+     */
+    template<typename WriteFunction>
+    requires std::invocable<WriteFunction, std::ostream &>
+    void publishSharedMemory(std::string const & name, WriteFunction && writeFunction) {
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "shm_open failed for " << name << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            size_t size = gradylib_helpers::writeToDescriptor(fd, std::forward<WriteFunction>(writeFunction),
+                                                              gradylib_helpers::sharedMemoryHeaderSize);
+            gradylib_helpers::markSharedMemoryComplete(fd, size);
+        } catch (...) {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw;
+        }
+        close(fd);
+    }
+
+    /*
+     * Map a published shared memory object read only.  Pass the result to a container's MappedFile constructor.
+     * Throws if the object doesn't exist or hasn't been completely published yet.
+     */
+    inline MappedFile attachSharedMemory(std::string const & name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "shm_open failed for " << name << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            using gradylib_helpers::SharedMemoryHeader;
+            using gradylib_helpers::sharedMemoryHeaderSize;
+            struct stat statBuf;
+            if (fstat(fd, &statBuf) != 0 || static_cast<size_t>(statBuf.st_size) < sharedMemoryHeaderSize) {
+                throw gradylibMakeException("Shared memory object " + name + " hasn't been completely published");
+            }
+            MappedFile ret(fd, sharedMemoryHeaderSize);
+            auto header = static_cast<SharedMemoryHeader const *>(static_cast<void const *>(
+                    static_cast<std::byte const *>(ret.data()) - sharedMemoryHeaderSize));
+            uint64_t complete = std::atomic_ref<uint64_t>(const_cast<uint64_t &>(header->complete)).load(std::memory_order_acquire);
+            if (complete != gradylib_helpers::sharedMemoryComplete) {
+                throw gradylibMakeException("Shared memory object " + name + " hasn't been completely published");
+            }
+            if (ret.size() < header->size) {
+                // Mapped while the object was still growing; its size is final now
+                ret = MappedFile(fd, sharedMemoryHeaderSize);
+            }
+            close(fd);
+            return ret;
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+    inline void removeSharedMemory(std::string const & name) {
+        shm_unlink(name.c_str());
+    }
+
+    /*
+     * Write a container to a file on a hugetlbfs mount (or any other filesystem).  Readers load it with the
+     * container's path constructor as usual.
+     */
+    template<typename WriteFunction>
+    requires std::invocable<WriteFunction, std::ostream &>
+    void publishHugePageFile(std::filesystem::path const & path, WriteFunction && writeFunction) {
+        std::filesystem::path tmpPath = path;
+        tmpPath += ".tmp";
+        int fd = open(tmpPath.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "Error opening file " << tmpPath << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            gradylib_helpers::writeToDescriptor(fd, std::forward<WriteFunction>(writeFunction));
+        } catch (...) {
+            close(fd);
+            unlink(tmpPath.c_str());
+            throw;
+        }
+        close(fd);
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            std::ostringstream sstr;
+            sstr << "Couldn't rename " << tmpPath << " to " << path << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+    }
+
+#ifdef __linux__
+    /*
+     * Write a container into an anonymous memfd and return the descriptor.  The memfd is sealed against further
+     * modification so it's safe to hand to other processes (e.g. over a unix socket); they map it with
+     * MappedFile(fd).  With hugePages the memfd is backed by the default huge page size.
+     */
+    template<typename WriteFunction>
+    requires std::invocable<WriteFunction, std::ostream &>
+    int publishMemfd(std::string const & name, WriteFunction && writeFunction, bool hugePages = false) {
+        unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING | (hugePages ? MFD_HUGETLB : 0);
+        int fd = memfd_create(name.c_str(), flags);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "memfd_create failed for " << name << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            gradylib_helpers::writeToDescriptor(fd, std::forward<WriteFunction>(writeFunction));
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+        if (fcntl(fd, F_ADD_SEALS, seals) != 0) {
+            close(fd);
+            std::ostringstream sstr;
+            sstr << "Couldn't seal memfd " << name << ": " << strerror(errno);
+            throw gradylibMakeException(sstr.str());
+        }
+        return fd;
+    }
+#endif
+}
@@ -0,0 +1,154 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Allocation for ThreadPool tasks without a trip to malloc in the steady state.
+ *
+ * NodeCache<T> recycles objects of type T.  Each thread keeps up to 2 * batchSize free objects; a thread that frees
+ * more than that (a worker running tasks added from outside the pool) hands a batch to a shared depot, and a thread
+ * that runs out (the thread adding those tasks) takes a batch back.  Only the batch handoff takes a lock.  Objects
+ * are reused as they are, so get() returns an object in whatever state put() left it.
+ *
+ * CachingAllocator<T> is a std allocator that takes single objects from a NodeCache of raw storage of T's size,
+ * for use with std::allocate_shared.
+ */
+
+#pragma once
+
+#include<cstddef>
+#include<mutex>
+#include<new>
+#include<vector>
+
+namespace gradylib_helpers {
+
+    template<typename T, size_t batchSize = 256, size_t maxDepotBatches = 64>
+    class NodeCache {
+        struct Depot {
+            std::mutex mutex;
+            std::vector<std::vector<T *>> batches;
+        };
+
+        struct Local {
+            std::vector<T *> nodes;
+
+            Local() {
+                nodes.reserve(2 * batchSize);
+            }
+
+            ~Local() {
+                for (T * node : nodes) {
+                    delete node;
+                }
+            }
+        };
+
+        // Never destroyed, so threads that exit during static destruction can still return batches
+        static Depot & depot() {
+            static Depot * d = new Depot;
+            return *d;
+        }
+
+        static Local & local() {
+            thread_local Local l;
+            return l;
+        }
+
+    public:
+        static T * get() {
+            Local & l = local();
+            if (l.nodes.empty()) {
+                Depot & d = depot();
+                std::lock_guard lg(d.mutex);
+                if (!d.batches.empty()) {
+                    l.nodes.insert(l.nodes.end(), d.batches.back().begin(), d.batches.back().end());
+                    d.batches.pop_back();
+                }
+            }
+            if (l.nodes.empty()) {
+                return new T;
+            }
+            T * node = l.nodes.back();
+            l.nodes.pop_back();
+            return node;
+        }
+
+        static void put(T * node) {
+            Local & l = local();
+            l.nodes.push_back(node);
+            if (l.nodes.size() < 2 * batchSize) {
+                return;
+            }
+            std::vector<T *> batch(l.nodes.end() - batchSize, l.nodes.end());
+            l.nodes.resize(l.nodes.size() - batchSize);
+            Depot & d = depot();
+            {
+                std::lock_guard lg(d.mutex);
+                if (d.batches.size() < maxDepotBatches) {
+                    d.batches.push_back(std::move(batch));
+                    return;
+                }
+            }
+            for (T * n : batch) {
+                delete n;
+            }
+        }
+    };
+
+    template<size_t size, size_t alignment>
+    struct alignas(alignment) RawStorage {
+        std::byte bytes[size];
+    };
+
+    template<typename T>
+    struct CachingAllocator {
+        using value_type = T;
+
+        CachingAllocator() = default;
+
+        template<typename U>
+        CachingAllocator(CachingAllocator<U> const &) {
+        }
+
+        T * allocate(size_t n) {
+            if (n == 1) {
+                return static_cast<T *>(static_cast<void *>(NodeCache<RawStorage<sizeof(T), alignof(T)>>::get()));
+            }
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+
+        void deallocate(T * p, size_t n) {
+            if (n == 1) {
+                NodeCache<RawStorage<sizeof(T), alignof(T)>>::put(static_cast<RawStorage<sizeof(T), alignof(T)> *>(static_cast<void *>(p)));
+                return;
+            }
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+
+        template<typename U>
+        bool operator==(CachingAllocator<U> const &) const {
+            return true;
+        }
+    };
+}
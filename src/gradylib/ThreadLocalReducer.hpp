@@ -0,0 +1,155 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * ThreadLocalReducer keeps one partial result per ThreadPool worker for code that accumulates from many tasks.
+ *
+ *     ThreadLocalReducer<OpenHashMap<std::string, long>> counts(tp);
+ *     parallelFor(tp, 0, lines.size(), [&](size_t i) {
+ *         ++counts.local()[lines[i]];
+ *     });
+ *     OpenHashMap<std::string, long> total = counts.reduceParallel();
+ *
+ * Each worker's slot is padded to its own cache line and found by the worker's index, so updates take no lock
+ * and don't share lines with other workers.  Threads that aren't workers of the pool share one extra slot behind a
+ * mutex, through update().  local() throws on those threads.
+ *
+ * Partials are combined with mergePartials(T &, T const &) when T is Mergeable (see Common.hpp), with += otherwise,
+ * or with a given combine function.  reduce() merges the slots serially in slot order; reduceParallel() merges them
+ * pairwise as a tree of tasks on the pool, which pays off when merging a partial is itself expensive, e.g. large
+ * hash maps.  Both move the partials out and reset every slot to the identity, so the reducer can be reused.  Don't
+ * reduce while tasks are still updating.
+ */
+
+#pragma once
+
+#include<concepts>
+#include<cstddef>
+#include<functional>
+#include<mutex>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    struct DefaultCombine {
+        template<typename T>
+        void operator()(T & a, T const & b) const {
+            if constexpr (Mergeable<T>) {
+                mergePartials(a, b);
+            } else {
+                a += b;
+            }
+        }
+    };
+}
+
+namespace gradylib {
+
+    template<typename T, typename Combine = gradylib_helpers::DefaultCombine>
+    requires std::is_copy_constructible_v<T> && std::is_invocable_v<Combine const &, T &, T const &>
+    class ThreadLocalReducer {
+        struct alignas(64) Slot {
+            T value;
+        };
+
+        ThreadPool & tp;
+        T identity;
+        Combine combine;
+        // One per worker, then the slot shared by other threads
+        std::vector<Slot> slots;
+        std::mutex outsideMutex;
+
+        T takeSlot(size_t i) {
+            T ret = std::move(slots[i].value);
+            slots[i].value = identity;
+            return ret;
+        }
+
+    public:
+        explicit ThreadLocalReducer(ThreadPool & tp, T identity = T{}, Combine combine = Combine{})
+            : tp(tp), identity(std::move(identity)), combine(std::move(combine)),
+              slots(tp.size() + 1, Slot{this->identity})
+        {
+        }
+
+        ThreadLocalReducer(ThreadLocalReducer const &) = delete;
+
+        ThreadLocalReducer & operator=(ThreadLocalReducer const &) = delete;
+
+        // The calling worker's partial
+        T & local() {
+            int worker = tp.workerIndex();
+            if (worker < 0) {
+                throw gradylibMakeException("ThreadLocalReducer::local called from a thread that isn't a worker of its pool");
+            }
+            return slots[worker].value;
+        }
+
+        // Calls f(T &) on the calling thread's partial.  Works on any thread.
+        template<typename F>
+        requires std::invocable<F &, T &>
+        void update(F && f) {
+            int worker = tp.workerIndex();
+            if (worker >= 0) {
+                f(slots[worker].value);
+                return;
+            }
+            std::lock_guard lg(outsideMutex);
+            f(slots.back().value);
+        }
+
+        T reduce() {
+            T result = takeSlot(0);
+            for (size_t i = 1; i < slots.size(); ++i) {
+                combine(result, slots[i].value);
+                slots[i].value = identity;
+            }
+            return result;
+        }
+
+        T reduceParallel() {
+            for (size_t stride = 1; stride < slots.size(); stride *= 2) {
+                TaskGroup group(tp);
+                for (size_t i = 0; i + stride < slots.size(); i += 2 * stride) {
+                    group.add([this, i, stride]() {
+                        combine(slots[i].value, slots[i + stride].value);
+                        slots[i + stride].value = identity;
+                    });
+                }
+                group.wait();
+            }
+            return takeSlot(0);
+        }
+
+        size_t numSlots() const {
+            return slots.size();
+        }
+    };
+}
@@ -22,118 +22,859 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+/*
+ * ThreadPool is a work stealing executor.  Each worker owns a Chase-Lev deque (see WorkStealingDeque.hpp); tasks
+ * added from inside a worker go on that worker's deque, tasks added from any other thread go on a shared injection
+ * queue.  A worker looking for work pops its own deque newest first, then takes from the injection queue, then
+ * steals the oldest task of randomly chosen other workers.  Workers that find nothing spin briefly and then park on
+ * a condition variable until a task is added.
+ *
+ * Nested parallelism, e.g. a parallelForEach running inside a task, stays mostly on the adding worker's deque and
+ * only touches shared state when another worker steals from it.
+ *
+ * Nothing polls.  The pool counts tasks that have been added and not finished; wait() sleeps until the worker that
+ * finishes the last one notifies it.  Adding a batch of tasks (allocateOverThreads) wakes all parked workers at once.
+ *
+ * add and allocateOverThreads return a TaskGroup, whose wait() waits only for those tasks rather than for the whole
+ * pool.  A worker waiting on a TaskGroup runs queued tasks while it waits.
+ *
+ * Constructed from a NumaTopology the pool spreads its workers over the nodes, optionally pins each to a cpu of its
+ * node, and keeps one injection queue per node.  Workers look for work on their own node (their deque, the node's
+ * queue, then stealing from the node's other workers) before trying other nodes.  addOnNode queues a task on a given
+ * node, and allocateOverThreads and parallelForEach hand contiguous ranges to the nodes in order, using the same
+ * split as firstTouch so that each node mostly scans memory it placed.  The default constructor is a single node pool
+ * with unpinned threads.
+ *
+ * Tasks are move only and don't allocate once the pool is warm.  A task is its own queue node, with small callables
+ * stored inside it, and nodes and group states are recycled through per-thread caches (see TaskAllocation.hpp).
+ *
+ * A TaskGroup can carry a CancellationToken (see Cancellation.hpp); once it's cancelled the group's tasks that haven't
+ * started are discarded instead of run.
+ *
+ * enableMetrics() turns on collection of queue depth, wait and run time histograms, per-worker busy, idle and steal
+ * counts, and wakeup latency; metrics() returns a snapshot (see ThreadPoolMetrics.hpp).
+ */
+
 #pragma once
 
+#include<algorithm>
+#include<atomic>
 #include<concepts>
 #include<condition_variable>
+#include<coroutine>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
 #include<functional>
+#include<future>
 #include<iostream>
+#include<memory>
 #include<mutex>
-#include<queue>
+#include<new>
 #include<thread>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"Cancellation.hpp"
+#include"NumaTopology.hpp"
+#include"TaskAllocation.hpp"
+#include"ThreadPoolMetrics.hpp"
+#include"WorkStealingDeque.hpp"
 
 namespace gradylib {
 
+    class ThreadPool;
+
+    /*
+     * A set of tasks in a ThreadPool that can be waited on independently of everything else in the pool.  When
+     * wait() is called from one of the pool's workers, e.g. by a task waiting on subtasks it added, the worker keeps
+     * running queued tasks until the group is done.  Nested waits therefore neither deadlock nor idle a worker.
+     *
+     * Copies refer to the same group.  The pool must outlive the group's tasks.  Tasks of a group with a cancelled
+     * token are discarded without running when they come off the queue; wait() still waits for them to be discarded.
+     */
+    class TaskGroup {
+        struct State {
+            ThreadPool * pool;
+            CancellationToken token;
+            std::atomic<int64_t> pending{0};
+            // Workers helping inside wait(), which need a wakeup on the pool's worker condition variable
+            std::atomic<int> helpers{0};
+            std::mutex mutex;
+            std::condition_variable done;
+
+            State(ThreadPool * pool, CancellationToken token)
+                : pool(pool), token(std::move(token))
+            {
+            }
+        };
+
+        std::shared_ptr<State> state;
+
+        friend class ThreadPool;
+
+    public:
+        explicit TaskGroup(ThreadPool & pool, CancellationToken token = CancellationToken())
+            : state(std::allocate_shared<State>(gradylib_helpers::CachingAllocator<State>{}, &pool, std::move(token)))
+        {
+        }
+
+        template<std::invocable Invocable>
+        void add(Invocable && f);
+
+        template<std::invocable Invocable>
+        void addOnNode(int node, Invocable && f);
+
+        template<std::invocable<size_t,size_t> Invocable>
+        void allocateOverThreads(size_t count, Invocable && f);
+
+        bool isDone() const {
+            return state->pending.load(std::memory_order_acquire) == 0;
+        }
+
+        CancellationToken const & token() const {
+            return state->token;
+        }
+
+        void wait();
+    };
+
     class ThreadPool {
-        std::queue<std::function<void()>> work;
+        /*
+         * A task and its queue node in one.  Callables of up to inlineSize bytes are stored in place, larger ones on
+         * the heap.  Nodes are recycled through a NodeCache.
+         */
+        struct Task {
+            static constexpr size_t inlineSize = 48;
+
+            alignas(std::max_align_t) std::byte storage[inlineSize];
+            // Runs the callable if run is true, then destroys it
+            void (*invoke)(Task &, bool run) = nullptr;
+            std::shared_ptr<TaskGroup::State> group;
+            // Link in an injection queue or a batch being pushed
+            Task * next = nullptr;
+            // When the task was queued, or 0 if metrics are off
+            uint64_t enqueueTime = 0;
+
+            template<typename Invocable>
+            void set(Invocable && f) {
+                using F = std::decay_t<Invocable>;
+                if constexpr (sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t)) {
+                    new (storage) F(std::forward<Invocable>(f));
+                    invoke = [](Task & task, bool run) {
+                        F & fn = *std::launder(static_cast<F *>(static_cast<void *>(task.storage)));
+                        if (run) {
+                            fn();
+                        }
+                        fn.~F();
+                    };
+                } else {
+                    new (storage) F *(new F(std::forward<Invocable>(f)));
+                    invoke = [](Task & task, bool run) {
+                        F * fn = *std::launder(static_cast<F **>(static_cast<void *>(task.storage)));
+                        if (run) {
+                            (*fn)();
+                        }
+                        delete fn;
+                    };
+                }
+            }
+        };
+
+        template<typename Invocable>
+        static Task * makeTask(Invocable && f, std::shared_ptr<TaskGroup::State> group) {
+            Task * task = gradylib_helpers::NodeCache<Task>::get();
+            task->set(std::forward<Invocable>(f));
+            task->group = std::move(group);
+            task->next = nullptr;
+            return task;
+        }
+
+        // For tasks that never ran
+        static void discard(Task * task) {
+            task->invoke(*task, false);
+            delete task;
+        }
+
+        struct InjectionQueue {
+            std::mutex mutex;
+            Task * head = nullptr;
+            Task * tail = nullptr;
+
+            // Appends the list first ... last
+            void append(Task * first, Task * last) {
+                last->next = nullptr;
+                if (tail) {
+                    tail->next = first;
+                } else {
+                    head = first;
+                }
+                tail = last;
+            }
+
+            Task * take() {
+                Task * task = head;
+                if (task) {
+                    head = task->next;
+                    if (!head) {
+                        tail = nullptr;
+                    }
+                }
+                return task;
+            }
+        };
+
+        std::vector<std::unique_ptr<gradylib_helpers::WorkStealingDeque<Task *>>> deques;
         std::vector<std::thread> threads;
-        std::mutex mutable workMutex;
+
+        NumaTopology numaTopology;
+        // The node of each worker and the workers of each node.  Workers are numbered node by node.
+        std::vector<int> workerNodes;
+        std::vector<std::vector<size_t>> nodeWorkers;
+        // One per node
+        std::vector<std::unique_ptr<InjectionQueue>> injection;
+        std::atomic<size_t> nextInjection{0};
+
+        // Tasks sitting in a deque or the injection queue.  Incremented before a task is pushed, so it never
+        // undercounts.
+        alignas(64) std::atomic<int64_t> queued{0};
+        // Tasks added and not yet finished
+        alignas(64) std::atomic<int64_t> pending{0};
+
+        std::mutex parkMutex;
         std::condition_variable workerConditionVariable;
+        std::atomic<int> sleepers{0};
+
+        std::mutex waitMutex;
         std::condition_variable waiterConditionVariable;
-        std::atomic<int> freeThreads{0};
+
         std::atomic<bool> stop{false};
-        int workerSleepMillis;
 
-    public:
+        std::atomic<bool> collectMetrics{false};
+        std::unique_ptr<gradylib_helpers::WorkerMetrics[]> workerMetrics;
+        std::atomic<uint64_t> metricsStart{0};
+        std::atomic<uint64_t> metricsStop{0};
+        std::atomic<uint64_t> lastNotify{0};
+        alignas(64) std::atomic<int64_t> maxQueued{0};
+        gradylib_helpers::QueueDepthSampler mutable depthSampler;
 
-        int size() const {
-            return threads.size();
+        static constexpr int spinIterations = 64;
+
+        static inline thread_local ThreadPool * currentPool = nullptr;
+        static inline thread_local size_t currentWorker = 0;
+        static inline thread_local uint64_t randomState = 0;
+
+        friend class TaskGroup;
+
+        static uint64_t nextRandom() {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 7;
+            randomState ^= randomState << 17;
+            return randomState;
         }
 
-        ThreadPool(int numThreads = std::thread::hardware_concurrency(), int workerSleepMillis = 500)
-            : freeThreads(numThreads), workerSleepMillis(workerSleepMillis)
-        {
-            for (int i = 0; i < numThreads; ++i) {
-                threads.emplace_back([this, i]() {
-                    while (true) {
-                        std::unique_lock lock(workMutex);
-                        workerConditionVariable.wait_for(lock, std::chrono::milliseconds(ThreadPool::workerSleepMillis), [this]{
-                            return !work.empty() || stop.load(std::memory_order_relaxed);
-                        });
-                        if (stop.load(std::memory_order_relaxed)) {
-                            return;
-                        }
-                        if (!work.empty()) {
-                            //auto f = std::move(work.front());
-                            auto f{std::move(work.front())};
-                            work.pop();
-                            freeThreads.fetch_sub(1, std::memory_order_relaxed);
-                            lock.unlock();
-                            f();
-                            freeThreads.fetch_add(1, std::memory_order_relaxed);
-                            waiterConditionVariable.notify_one();
-                        }
+        // node < 0 means any node
+        void inject(Task * task, int node) {
+            if (node < 0) {
+                node = injection.size() == 1 ? 0 : nextInjection.fetch_add(1, std::memory_order_relaxed) % injection.size();
+            }
+            InjectionQueue & q = *injection[node];
+            std::lock_guard lg(q.mutex);
+            q.append(task, task);
+        }
+
+        // With metrics on, records when task was queued and returns the time, otherwise returns 0
+        uint64_t stamp(Task * task) {
+            task->enqueueTime = collectMetrics.load(std::memory_order_relaxed) ? gradylib_helpers::metricsNow() : 0;
+            return task->enqueueTime;
+        }
+
+        void noteQueued(uint64_t now, int64_t depth) {
+            int64_t max = maxQueued.load(std::memory_order_relaxed);
+            while (depth > max && !maxQueued.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {
+            }
+            depthSampler.maybeSample(now, depth);
+        }
+
+        void push(Task * task, int node = -1) {
+            uint64_t now = stamp(task);
+            pending.fetch_add(1, std::memory_order_relaxed);
+            int64_t depth = queued.fetch_add(1, std::memory_order_seq_cst) + 1;
+            if (now) {
+                noteQueued(now, depth);
+            }
+            if (currentPool == this && (node < 0 || node == workerNodes[currentWorker])) {
+                deques[currentWorker]->push(task);
+            } else {
+                inject(task, node);
+            }
+            wakeWorkers(1);
+        }
+
+        // Always goes through an injection queue, behind whatever is queued there, on the caller's node if it has one
+        void pushBack(Task * task) {
+            uint64_t now = stamp(task);
+            pending.fetch_add(1, std::memory_order_relaxed);
+            int64_t depth = queued.fetch_add(1, std::memory_order_seq_cst) + 1;
+            if (now) {
+                noteQueued(now, depth);
+            }
+            inject(task, currentNode());
+            wakeWorkers(1);
+        }
+
+        // Pushes the count tasks linked from first.  Task i goes to nodeForPart(i, count).
+        void push(Task * first, size_t count) {
+            uint64_t now = 0;
+            for (Task * task = first; task; task = task->next) {
+                now = stamp(task);
+            }
+            pending.fetch_add(count, std::memory_order_relaxed);
+            int64_t depth = queued.fetch_add(count, std::memory_order_seq_cst) + count;
+            if (now) {
+                noteQueued(now, depth);
+            }
+            if (injection.size() > 1) {
+                Task * task = first;
+                for (size_t i = 0; i < count; ++i) {
+                    Task * next = task->next;
+                    inject(task, nodeForPart(i, count));
+                    task = next;
+                }
+            } else if (currentPool == this) {
+                // Once pushed a task can be stolen, run and recycled, so read next first
+                Task * task = first;
+                while (task) {
+                    Task * next = task->next;
+                    deques[currentWorker]->push(task);
+                    task = next;
+                }
+            } else {
+                Task * last = first;
+                while (last->next) {
+                    last = last->next;
+                }
+                std::lock_guard lg(injection[0]->mutex);
+                injection[0]->append(first, last);
+            }
+            wakeWorkers(count);
+        }
+
+        void wakeWorkers(size_t numTasks) {
+            if (sleepers.load(std::memory_order_seq_cst) > 0) {
+                // Taking the lock orders this notify after a parking worker's check of queued
+                std::lock_guard lg(parkMutex);
+                if (collectMetrics.load(std::memory_order_relaxed)) {
+                    lastNotify.store(gradylib_helpers::metricsNow(), std::memory_order_relaxed);
+                }
+                if (numTasks == 1) {
+                    workerConditionVariable.notify_one();
+                } else {
+                    workerConditionVariable.notify_all();
+                }
+            }
+        }
+
+        Task * takeInjected(size_t node) {
+            InjectionQueue & q = *injection[node];
+            std::lock_guard lg(q.mutex);
+            return q.take();
+        }
+
+        Task * stealFrom(size_t node, size_t self) {
+            std::vector<size_t> const & victims = nodeWorkers[node];
+            size_t n = victims.size();
+            if (n == 0) {
+                return nullptr;
+            }
+            size_t start = nextRandom() % n;
+            for (size_t i = 0; i < n; ++i) {
+                size_t victim = victims[(start + i) % n];
+                if (victim != self) {
+                    if (Task * task = deques[victim]->steal()) {
+                        return task;
                     }
-                });
+                }
             }
+            return nullptr;
         }
 
-        bool isEmpty() const {
-            std::unique_lock lock(workMutex);
-            return work.empty();
+        // Own deque, then own node's queue and workers, then the other nodes' in turn
+        Task * findTask(size_t self) {
+            Task * task = deques[self]->pop();
+            size_t home = workerNodes[self];
+            size_t numNodes = injection.size();
+            for (size_t i = 0; i < numNodes && !task; ++i) {
+                size_t node = (home + i) % numNodes;
+                task = takeInjected(node);
+                if (task) {
+                    if (collectMetrics.load(std::memory_order_relaxed)) {
+                        workerMetrics[self].count(workerMetrics[self].injected);
+                    }
+                    break;
+                }
+                task = stealFrom(node, self);
+                if (task && collectMetrics.load(std::memory_order_relaxed)) {
+                    workerMetrics[self].count(workerMetrics[self].steals);
+                }
+            }
+            if (task) {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+            }
+            return task;
         }
 
-        template<std::invocable Invocable>
-        void add(Invocable && f) {
-            workMutex.lock();
-            work.push(std::forward<Invocable>(f));
-            workMutex.unlock();
-            workerConditionVariable.notify_one();
+        void run(Task * task) {
+            uint64_t start = 0;
+            if (collectMetrics.load(std::memory_order_relaxed)) {
+                start = gradylib_helpers::metricsNow();
+                if (task->enqueueTime != 0) {
+                    workerMetrics[currentWorker].waitTime.record(start > task->enqueueTime ? start - task->enqueueTime : 0);
+                }
+            }
+            // Tasks of a cancelled group are destroyed without running
+            task->invoke(*task, !task->group || !task->group->token.isCancelled());
+            if (start != 0) {
+                gradylib_helpers::WorkerMetrics & m = workerMetrics[currentWorker];
+                uint64_t ns = gradylib_helpers::metricsNow() - start;
+                m.runTime.record(ns);
+                m.count(m.busy, ns);
+                m.count(m.tasksRun);
+            }
+            if (task->group) {
+                finishGroupTask(*task->group);
+                task->group.reset();
+            }
+            gradylib_helpers::NodeCache<Task>::put(task);
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard lg(waitMutex);
+                waiterConditionVariable.notify_all();
+            }
         }
 
-        template<std::invocable<size_t,size_t> Invocable>
-        void allocateOverThreads(size_t count, Invocable && f) {
-            workMutex.lock();
-            size_t start = 0;
-            size_t stop = 0;
-            for (int i = 0; i < threads.size(); ++i) {
-                stop = start + count / threads.size() + (i < count % threads.size() ? 1 : 0);
-                work.push([start, stop, f]() {
-                    f(start, stop);
+        void finishGroupTask(TaskGroup::State & group) {
+            if (group.pending.fetch_sub(1, std::memory_order_seq_cst) == 1) {
+                {
+                    std::lock_guard lg(group.mutex);
+                    group.done.notify_all();
+                }
+                if (group.helpers.load(std::memory_order_seq_cst) > 0) {
+                    std::lock_guard lg(parkMutex);
+                    workerConditionVariable.notify_all();
+                }
+            }
+        }
+
+        // Called by a worker waiting on a TaskGroup
+        void helpUntilDone(TaskGroup::State & group) {
+            group.helpers.fetch_add(1, std::memory_order_seq_cst);
+            while (group.pending.load(std::memory_order_seq_cst) != 0 && !stop.load(std::memory_order_relaxed)) {
+                if (Task * task = findTask(currentWorker)) {
+                    run(task);
+                    continue;
+                }
+                std::unique_lock lock(parkMutex);
+                sleepers.fetch_add(1, std::memory_order_seq_cst);
+                uint64_t parkedAt = collectMetrics.load(std::memory_order_relaxed) ? gradylib_helpers::metricsNow() : 0;
+                workerConditionVariable.wait(lock, [this, &group] {
+                    return queued.load(std::memory_order_seq_cst) > 0 ||
+                           group.pending.load(std::memory_order_seq_cst) == 0 ||
+                           stop.load(std::memory_order_relaxed);
                 });
-                start = stop;
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+                recordPark(parkedAt);
             }
-            workMutex.unlock();
-            workerConditionVariable.notify_one();
+            group.helpers.fetch_sub(1, std::memory_order_relaxed);
         }
 
-        void wait() {
-            std::unique_lock lock(workMutex);
-            if (work.empty() && freeThreads.load(std::memory_order_relaxed) == threads.size()) {
+        // parkedAt is 0 if metrics were off when the worker parked
+        void recordPark(uint64_t parkedAt) {
+            if (parkedAt == 0) {
                 return;
             }
-            while (true) {
-                waiterConditionVariable.wait_for(lock, std::chrono::milliseconds(workerSleepMillis), [this]{
-                    return work.empty() && freeThreads.load(std::memory_order_relaxed) == threads.size();
-                });
-                if (work.empty() && freeThreads.load(std::memory_order_relaxed) == threads.size()) {
-                    return;
+            gradylib_helpers::WorkerMetrics & m = workerMetrics[currentWorker];
+            uint64_t now = gradylib_helpers::metricsNow();
+            m.count(m.parks);
+            m.count(m.idle, now - parkedAt);
+            uint64_t notified = lastNotify.load(std::memory_order_relaxed);
+            if (notified >= parkedAt && notified <= now) {
+                m.wakeupLatency.record(now - notified);
+            }
+        }
+
+        void park() {
+            std::unique_lock lock(parkMutex);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            uint64_t parkedAt = collectMetrics.load(std::memory_order_relaxed) ? gradylib_helpers::metricsNow() : 0;
+            workerConditionVariable.wait(lock, [this] {
+                return queued.load(std::memory_order_seq_cst) > 0 || stop.load(std::memory_order_relaxed);
+            });
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            recordPark(parkedAt);
+        }
+
+        void workerLoop(size_t index, int cpu) {
+            if (cpu >= 0) {
+                gradylib_helpers::pinCurrentThread(cpu);
+            }
+            currentPool = this;
+            currentWorker = index;
+            randomState = 0x9e3779b97f4a7c15ULL * (index + 1);
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (Task * task = findTask(index)) {
+                    run(task);
+                    continue;
                 }
+                bool sawWork = false;
+                for (int i = 0; i < spinIterations && !sawWork; ++i) {
+                    std::this_thread::yield();
+                    sawWork = queued.load(std::memory_order_relaxed) > 0 || stop.load(std::memory_order_relaxed);
+                }
+                if (!sawWork) {
+                    park();
+                }
+            }
+        }
+
+        void start(int numThreads, bool pinThreads) {
+            numThreads = std::max(numThreads, 1);
+            size_t numNodes = numaTopology.size();
+            // Workers are split over the nodes in proportion to their cpus
+            std::vector<size_t> cumulativeWeight;
+            size_t totalWeight = 0;
+            for (auto const & node : numaTopology.nodes()) {
+                totalWeight += std::max<size_t>(1, node.cpus.size());
+                cumulativeWeight.push_back(totalWeight);
+            }
+            nodeWorkers.resize(numNodes);
+            std::vector<int> cpus;
+            for (int i = 0; i < numThreads; ++i) {
+                size_t target = static_cast<size_t>(i) * totalWeight / numThreads;
+                size_t node = std::upper_bound(cumulativeWeight.begin(), cumulativeWeight.end(), target) - cumulativeWeight.begin();
+                std::vector<int> const & nodeCpus = numaTopology[node].cpus;
+                cpus.push_back(pinThreads && !nodeCpus.empty() ? nodeCpus[nodeWorkers[node].size() % nodeCpus.size()] : -1);
+                workerNodes.push_back(node);
+                nodeWorkers[node].push_back(i);
+                deques.push_back(std::make_unique<gradylib_helpers::WorkStealingDeque<Task *>>());
+            }
+            for (size_t node = 0; node < numNodes; ++node) {
+                injection.push_back(std::make_unique<InjectionQueue>());
+            }
+            workerMetrics = std::make_unique<gradylib_helpers::WorkerMetrics[]>(numThreads);
+            for (int i = 0; i < numThreads; ++i) {
+                threads.emplace_back([this, i, cpu = cpus[i]]() {
+                    workerLoop(i, cpu);
+                });
+            }
+        }
+
+    public:
+
+        int size() const {
+            return threads.size();
+        }
+
+        // The second argument is ignored.  It was a polling interval and is kept so existing callers compile.
+        ThreadPool(int numThreads = std::thread::hardware_concurrency(), int = 500) {
+            start(numThreads, false);
+        }
+
+        /*
+         * A pool spread over the nodes of topology, e.g. NumaTopology::discover().  numThreads 0 means one worker per
+         * cpu.  With pinThreads each worker is pinned to a cpu of its node.
+         */
+        explicit ThreadPool(NumaTopology topology, int numThreads = 0, bool pinThreads = true)
+            : numaTopology(std::move(topology))
+        {
+            start(numThreads > 0 ? numThreads : numaTopology.numCpus(), pinThreads);
+        }
+
+        ThreadPool(ThreadPool const &) = delete;
+
+        ThreadPool & operator=(ThreadPool const &) = delete;
+
+        bool isEmpty() const {
+            return queued.load(std::memory_order_relaxed) == 0;
+        }
+
+        NumaTopology const & topology() const {
+            return numaTopology;
+        }
+
+        int numNodes() const {
+            return injection.size();
+        }
+
+        int workerNode(size_t worker) const {
+            return workerNodes[worker];
+        }
+
+        // The index, in [0, size()), of the calling thread if it is one of this pool's workers, otherwise -1
+        int workerIndex() const {
+            return currentPool == this ? static_cast<int>(currentWorker) : -1;
+        }
+
+        // The node of the calling thread if it is one of this pool's workers, otherwise -1
+        int currentNode() const {
+            return currentPool == this ? workerNodes[currentWorker] : -1;
+        }
+
+        /*
+         * The node that should process part `part` of a range split into numParts equal contiguous parts.  Parts are
+         * laid over the workers in order, so the first parts go to node 0, the next to node 1, and so on.
+         */
+        int nodeForPart(size_t part, size_t numParts) const {
+            return workerNodes[part * workerNodes.size() / numParts];
+        }
+
+        /*
+         * Starts collecting metrics (see ThreadPoolMetrics.hpp), resetting any collected before.  Queue depth is
+         * sampled at most once per queueDepthInterval.
+         */
+        void enableMetrics(std::chrono::nanoseconds queueDepthInterval = std::chrono::milliseconds(1)) {
+            depthSampler.interval.store(queueDepthInterval.count(), std::memory_order_relaxed);
+            resetMetrics();
+            collectMetrics.store(true, std::memory_order_relaxed);
+        }
+
+        void disableMetrics() {
+            collectMetrics.store(false, std::memory_order_relaxed);
+            metricsStop.store(gradylib_helpers::metricsNow(), std::memory_order_relaxed);
+        }
+
+        // Counts updated by tasks running during a reset may be partly lost
+        void resetMetrics() {
+            for (size_t i = 0; i < threads.size(); ++i) {
+                workerMetrics[i].reset();
             }
+            maxQueued.store(queued.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            depthSampler.reset();
+            uint64_t now = gradylib_helpers::metricsNow();
+            metricsStart.store(now, std::memory_order_relaxed);
+            metricsStop.store(now, std::memory_order_relaxed);
+        }
+
+        ThreadPoolMetrics metrics() const {
+            ThreadPoolMetrics m;
+            uint64_t end = collectMetrics.load(std::memory_order_relaxed) ? gradylib_helpers::metricsNow() : metricsStop.load(std::memory_order_relaxed);
+            m.elapsed = std::chrono::nanoseconds(end - metricsStart.load(std::memory_order_relaxed));
+            m.queued = queued.load(std::memory_order_relaxed);
+            m.pending = pending.load(std::memory_order_relaxed);
+            m.maxQueued = maxQueued.load(std::memory_order_relaxed);
+            m.workers.resize(threads.size());
+            for (size_t i = 0; i < threads.size(); ++i) {
+                m.workers[i].node = workerNodes[i];
+                workerMetrics[i].read(m, m.workers[i]);
+            }
+            m.queueDepth = depthSampler.read();
+            return m;
+        }
+
+        // Returns a group holding just this task.  If token is cancelled before the task starts it is discarded.
+        template<std::invocable Invocable>
+        TaskGroup add(Invocable && f, CancellationToken token = CancellationToken()) {
+            TaskGroup group(*this, std::move(token));
+            group.add(std::forward<Invocable>(f));
+            return group;
+        }
+
+        // Like add, but the task is queued on node, where it runs unless that node's workers are all busy
+        template<std::invocable Invocable>
+        TaskGroup addOnNode(int node, Invocable && f) {
+            TaskGroup group(*this);
+            group.addOnNode(node, std::forward<Invocable>(f));
+            return group;
+        }
+
+        /*
+         * Like add, with the result or exception of f delivered through the returned future.  If token is cancelled
+         * before f starts the future holds Cancelled.
+         */
+        template<std::invocable Invocable>
+        std::future<std::invoke_result_t<std::decay_t<Invocable>>> submit(Invocable && f, CancellationToken token = CancellationToken()) {
+            using Result = std::invoke_result_t<std::decay_t<Invocable>>;
+            std::promise<Result> promise(std::allocator_arg, gradylib_helpers::CachingAllocator<Result>{});
+            std::future<Result> ret = promise.get_future();
+            push(makeTask([promise = std::move(promise), f = std::forward<Invocable>(f), token = std::move(token)]() mutable {
+                try {
+                    token.throwIfCancelled();
+                    if constexpr (std::is_void_v<Result>) {
+                        f();
+                        promise.set_value();
+                    } else {
+                        promise.set_value(f());
+                    }
+                } catch (...) {
+                    promise.set_exception(std::current_exception());
+                }
+            }, nullptr));
+            return ret;
+        }
+
+        /*
+         * co_await tp.schedule() suspends the calling coroutine and resumes it on a worker (see Coroutines.hpp).  It
+         * is queued behind the tasks already waiting, so from a worker it also yields to them.
+         */
+        auto schedule() noexcept {
+            struct ScheduleAwaiter {
+                ThreadPool * pool;
+
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<> h) {
+                    pool->pushBack(makeTask([h]() {
+                        h.resume();
+                    }, nullptr));
+                }
+
+                void await_resume() const noexcept {
+                }
+            };
+            return ScheduleAwaiter{this};
+        }
+
+        /*
+         * Returns a group holding the tasks, one per thread.  Ranges whose task hasn't started when token is cancelled
+         * are skipped; f can check the token itself to stop partway through its range.
+         */
+        template<std::invocable<size_t,size_t> Invocable>
+        TaskGroup allocateOverThreads(size_t count, Invocable && f, CancellationToken token = CancellationToken()) {
+            TaskGroup group(*this, std::move(token));
+            group.allocateOverThreads(count, std::forward<Invocable>(f));
+            return group;
+        }
+
+        /*
+         * Wait until every task added so far, and every task those tasks added, has finished.  From inside a task this
+         * would wait for the task itself; wait on a TaskGroup instead.
+         */
+        void wait() {
+            std::unique_lock lock(waitMutex);
+            waiterConditionVariable.wait(lock, [this]{
+                return pending.load(std::memory_order_acquire) == 0;
+            });
         }
 
         ~ThreadPool() {
             stop.store(true, std::memory_order_relaxed);
-            workerConditionVariable.notify_all();
+            {
+                std::lock_guard lg(parkMutex);
+                workerConditionVariable.notify_all();
+            }
             for (auto & t : threads) {
                 t.join();
             }
+            // Tasks that never ran
+            for (auto & d : deques) {
+                while (Task * task = d->pop()) {
+                    discard(task);
+                }
+            }
+            for (auto & q : injection) {
+                while (Task * task = q->take()) {
+                    discard(task);
+                }
+            }
         }
     };
 }
 
+namespace gradylib {
+
+    template<std::invocable Invocable>
+    void TaskGroup::add(Invocable && f) {
+        state->pending.fetch_add(1, std::memory_order_relaxed);
+        state->pool->push(ThreadPool::makeTask(std::forward<Invocable>(f), state));
+    }
+
+    template<std::invocable Invocable>
+    void TaskGroup::addOnNode(int node, Invocable && f) {
+        state->pending.fetch_add(1, std::memory_order_relaxed);
+        state->pool->push(ThreadPool::makeTask(std::forward<Invocable>(f), state), node);
+    }
+
+    template<std::invocable<size_t,size_t> Invocable>
+    void TaskGroup::allocateOverThreads(size_t count, Invocable && f) {
+        using F = std::decay_t<Invocable>;
+        size_t numThreads = state->pool->threads.size();
+        // One copy of f shared by all the tasks
+        std::shared_ptr<F> shared = std::allocate_shared<F>(gradylib_helpers::CachingAllocator<F>{}, std::forward<Invocable>(f));
+        ThreadPool::Task * first = nullptr;
+        ThreadPool::Task ** link = &first;
+        size_t start = 0;
+        size_t stop = 0;
+        for (size_t i = 0; i < numThreads; ++i) {
+            stop = start + count / numThreads + (i < count % numThreads ? 1 : 0);
+            *link = ThreadPool::makeTask([start, stop, shared]() {
+                std::as_const(*shared)(start, stop);
+            }, state);
+            link = &(*link)->next;
+            start = stop;
+        }
+        state->pending.fetch_add(numThreads, std::memory_order_relaxed);
+        state->pool->push(first, numThreads);
+    }
+
+    inline void TaskGroup::wait() {
+        if (ThreadPool::currentPool == state->pool) {
+            state->pool->helpUntilDone(*state);
+            return;
+        }
+        std::unique_lock lock(state->mutex);
+        state->done.wait(lock, [this] {
+            return state->pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+}
+
 namespace gradylib_helpers {
     inline std::unique_ptr<gradylib::ThreadPool> GRADY_LIB_DEFAULT_THREADPOOL;
     inline std::mutex GRADY_LIB_DEFAULT_THREADPOOL_MUTEX;
-}
 
+    // The default thread pool, created on first use
+    inline gradylib::ThreadPool & getDefaultThreadPool() {
+        if (!GRADY_LIB_DEFAULT_THREADPOOL) {
+            std::lock_guard lg(GRADY_LIB_DEFAULT_THREADPOOL_MUTEX);
+            if (!GRADY_LIB_DEFAULT_THREADPOOL) {
+                GRADY_LIB_DEFAULT_THREADPOOL = std::make_unique<gradylib::ThreadPool>();
+            }
+        }
+        return *GRADY_LIB_DEFAULT_THREADPOOL;
+    }
+
+    /*
+     * Zeroes bytes [ptr, ptr + size) from tasks placed with nodeForPart, so that under the kernel's first touch
+     * policy each page of a fresh allocation lands on the node that parallelForEach will later give it to.
+     */
+    inline void firstTouch(gradylib::ThreadPool & tp, void * ptr, size_t size) {
+        size_t numParts = tp.size();
+        std::byte * bytes = static_cast<std::byte *>(ptr);
+        gradylib::TaskGroup group(tp);
+        for (size_t part = 0; part < numParts; ++part) {
+            size_t start = part * size / numParts;
+            size_t stop = (part + 1) * size / numParts;
+            if (start == stop) {
+                continue;
+            }
+            group.addOnNode(tp.nodeForPart(part, numParts), [bytes, start, stop]() {
+                memset(bytes + start, 0, stop - start);
+            });
+        }
+        group.wait();
+    }
+
+    // new T[n]{}, with the zeroing done by firstTouch when T allows it
+    template<typename T>
+    T * allocateFirstTouched(gradylib::ThreadPool & tp, size_t n) {
+        if constexpr (std::is_trivially_default_constructible_v<T>) {
+            T * p = new T[n];
+            firstTouch(tp, p, n * sizeof(T));
+            return p;
+        } else {
+            return new T[n]{};
+        }
+    }
+}
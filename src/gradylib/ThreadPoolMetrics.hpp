@@ -0,0 +1,269 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Runtime metrics for ThreadPool, collected once tp.enableMetrics() has been called and read with tp.metrics().
+ *
+ *     tp.enableMetrics();
+ *     ... run the workload ...
+ *     ThreadPoolMetrics m = tp.metrics();
+ *     m.waitTime.percentile(0.99);    // time from add to start, ns
+ *     m.utilization();                // fraction of worker time spent running tasks
+ *
+ * Histograms have power of two buckets: counts[i] counts durations in [2^i, 2^(i+1)) nanoseconds, with 0 in the
+ * first bucket.  Each worker records into its own cache line and with plain loads and stores, so collection costs a
+ * few clock reads per task and no shared writes apart from the queue depth high water mark.  With metrics disabled
+ * it costs one relaxed load per task.
+ *
+ * Wakeup latency is measured from a notify of parked workers to a parked worker returning from its wait.  Idle time
+ * is time spent parked; time spent spinning before parking counts as neither busy nor idle.  Queue depth is sampled
+ * when tasks are added, at most once per sampling interval, and the latest samples are kept.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<array>
+#include<atomic>
+#include<bit>
+#include<chrono>
+#include<cstddef>
+#include<cstdint>
+#include<mutex>
+#include<vector>
+
+namespace gradylib {
+
+    struct ThreadPoolMetrics {
+        struct Histogram {
+            static constexpr size_t numBuckets = 40;
+
+            std::array<uint64_t, numBuckets> counts{};
+            uint64_t totalNanoseconds = 0;
+
+            uint64_t count() const {
+                uint64_t n = 0;
+                for (uint64_t c : counts) {
+                    n += c;
+                }
+                return n;
+            }
+
+            double meanNanoseconds() const {
+                uint64_t n = count();
+                return n == 0 ? 0.0 : static_cast<double>(totalNanoseconds) / n;
+            }
+
+            // An upper bound, the end of the bucket holding the p'th fraction of samples
+            uint64_t percentile(double p) const {
+                uint64_t n = count();
+                if (n == 0) {
+                    return 0;
+                }
+                uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(p * n + 0.5));
+                uint64_t seen = 0;
+                for (size_t i = 0; i < numBuckets; ++i) {
+                    seen += counts[i];
+                    if (seen >= target) {
+                        return uint64_t{2} << i;
+                    }
+                }
+                return uint64_t{2} << (numBuckets - 1);
+            }
+
+            Histogram & operator+=(Histogram const & h) {
+                for (size_t i = 0; i < numBuckets; ++i) {
+                    counts[i] += h.counts[i];
+                }
+                totalNanoseconds += h.totalNanoseconds;
+                return *this;
+            }
+        };
+
+        struct Worker {
+            int node = 0;
+            uint64_t tasksRun = 0;
+            // Tasks taken from another worker's deque
+            uint64_t steals = 0;
+            // Tasks taken from an injection queue
+            uint64_t injected = 0;
+            uint64_t parks = 0;
+            std::chrono::nanoseconds busy{0};
+            std::chrono::nanoseconds idle{0};
+        };
+
+        struct QueueDepthSample {
+            std::chrono::steady_clock::time_point time;
+            int64_t queued;
+        };
+
+        // Since metrics were enabled or last reset
+        std::chrono::nanoseconds elapsed{0};
+        int64_t queued = 0;
+        int64_t pending = 0;
+        int64_t maxQueued = 0;
+        Histogram waitTime;
+        Histogram runTime;
+        Histogram wakeupLatency;
+        std::vector<Worker> workers;
+        std::vector<QueueDepthSample> queueDepth;
+
+        // Busy time over elapsed time, summed over the workers
+        double utilization() const {
+            if (elapsed.count() == 0 || workers.empty()) {
+                return 0.0;
+            }
+            std::chrono::nanoseconds busy{0};
+            for (auto const & w : workers) {
+                busy += w.busy;
+            }
+            return static_cast<double>(busy.count()) / (static_cast<double>(elapsed.count()) * workers.size());
+        }
+    };
+}
+
+namespace gradylib_helpers {
+
+    inline uint64_t metricsNow() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Written only by its own worker, read by metrics()
+    class alignas(64) WorkerMetrics {
+        using Histogram = gradylib::ThreadPoolMetrics::Histogram;
+
+        struct Counts {
+            std::array<std::atomic<uint64_t>, Histogram::numBuckets> counts{};
+            std::atomic<uint64_t> total{0};
+
+            void record(uint64_t ns) {
+                size_t bucket = ns == 0 ? 0 : std::min<size_t>(std::bit_width(ns) - 1, Histogram::numBuckets - 1);
+                bump(counts[bucket], 1);
+                bump(total, ns);
+            }
+
+            Histogram read() const {
+                Histogram h;
+                for (size_t i = 0; i < Histogram::numBuckets; ++i) {
+                    h.counts[i] = counts[i].load(std::memory_order_relaxed);
+                }
+                h.totalNanoseconds = total.load(std::memory_order_relaxed);
+                return h;
+            }
+
+            void reset() {
+                for (auto & c : counts) {
+                    c.store(0, std::memory_order_relaxed);
+                }
+                total.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        static void bump(std::atomic<uint64_t> & a, uint64_t v) {
+            a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+        }
+
+    public:
+        std::atomic<uint64_t> tasksRun{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> injected{0};
+        std::atomic<uint64_t> parks{0};
+        std::atomic<uint64_t> busy{0};
+        std::atomic<uint64_t> idle{0};
+        Counts waitTime;
+        Counts runTime;
+        Counts wakeupLatency;
+
+        void count(std::atomic<uint64_t> & a, uint64_t v = 1) {
+            bump(a, v);
+        }
+
+        void reset() {
+            for (auto * a : {&tasksRun, &steals, &injected, &parks, &busy, &idle}) {
+                a->store(0, std::memory_order_relaxed);
+            }
+            waitTime.reset();
+            runTime.reset();
+            wakeupLatency.reset();
+        }
+
+        void read(gradylib::ThreadPoolMetrics & m, gradylib::ThreadPoolMetrics::Worker & w) const {
+            w.tasksRun = tasksRun.load(std::memory_order_relaxed);
+            w.steals = steals.load(std::memory_order_relaxed);
+            w.injected = injected.load(std::memory_order_relaxed);
+            w.parks = parks.load(std::memory_order_relaxed);
+            w.busy = std::chrono::nanoseconds(busy.load(std::memory_order_relaxed));
+            w.idle = std::chrono::nanoseconds(idle.load(std::memory_order_relaxed));
+            m.waitTime += waitTime.read();
+            m.runTime += runTime.read();
+            m.wakeupLatency += wakeupLatency.read();
+        }
+    };
+
+    // The latest queue depth samples, in a ring
+    class QueueDepthSampler {
+        static constexpr size_t maxSamples = 4096;
+
+        std::atomic<uint64_t> lastSample{0};
+        std::mutex mutex;
+        std::vector<gradylib::ThreadPoolMetrics::QueueDepthSample> samples;
+        size_t next = 0;
+
+    public:
+        std::atomic<uint64_t> interval{1000000};
+
+        void maybeSample(uint64_t now, int64_t queued) {
+            uint64_t last = lastSample.load(std::memory_order_relaxed);
+            if (now - last < interval.load(std::memory_order_relaxed) ||
+                !lastSample.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+                return;
+            }
+            auto time = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(now)));
+            std::lock_guard lg(mutex);
+            if (samples.size() < maxSamples) {
+                samples.push_back({time, queued});
+            } else {
+                samples[next] = {time, queued};
+            }
+            next = (next + 1) % maxSamples;
+        }
+
+        std::vector<gradylib::ThreadPoolMetrics::QueueDepthSample> read() {
+            std::lock_guard lg(mutex);
+            if (samples.size() < maxSamples) {
+                return samples;
+            }
+            std::vector<gradylib::ThreadPoolMetrics::QueueDepthSample> ret(samples.begin() + next, samples.end());
+            ret.insert(ret.end(), samples.begin(), samples.begin() + next);
+            return ret;
+        }
+
+        void reset() {
+            std::lock_guard lg(mutex);
+            samples.clear();
+            next = 0;
+            lastSample.store(0, std::memory_order_relaxed);
+        }
+    };
+}
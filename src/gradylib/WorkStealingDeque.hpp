@@ -0,0 +1,149 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A Chase-Lev work stealing deque (Chase & Lev 2005, with the C11 memory orderings of Lê et al. 2013).
+ *
+ * One owner thread pushes and pops at the bottom; any number of thieves steal from the top.  Owner operations are
+ * wait free except when the buffer grows, and a steal is a single CAS.  T must be trivially copyable, in practice a
+ * pointer; pop and steal return T{} when there is nothing to take.
+ *
+ * Buffers replaced by a grow are kept until the deque is destroyed because a thief may still be reading one.  Their
+ * total size is bounded by the size of the current buffer.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<cstdint>
+#include<memory>
+#include<type_traits>
+#include<vector>
+
+namespace gradylib_helpers {
+
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    class WorkStealingDeque {
+        struct Buffer {
+            int64_t capacity;
+            int64_t mask;
+            std::unique_ptr<std::atomic<T>[]> slots;
+
+            explicit Buffer(int64_t capacity)
+                : capacity(capacity), mask(capacity - 1), slots(new std::atomic<T>[capacity])
+            {
+            }
+
+            T get(int64_t i) const {
+                return slots[i & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t i, T t) {
+                slots[i & mask].store(t, std::memory_order_relaxed);
+            }
+        };
+
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<Buffer *> buffer;
+        // Owner only
+        std::vector<std::unique_ptr<Buffer>> buffers;
+
+        Buffer * grow(Buffer * old, int64_t b, int64_t t) {
+            auto bigger = std::make_unique<Buffer>(old->capacity * 2);
+            for (int64_t i = t; i < b; ++i) {
+                bigger->put(i, old->get(i));
+            }
+            Buffer * ret = bigger.get();
+            buffers.push_back(std::move(bigger));
+            buffer.store(ret, std::memory_order_release);
+            return ret;
+        }
+
+    public:
+        // capacity must be a power of 2
+        explicit WorkStealingDeque(int64_t capacity = 256) {
+            buffers.push_back(std::make_unique<Buffer>(capacity));
+            buffer.store(buffers.back().get(), std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(WorkStealingDeque const &) = delete;
+
+        WorkStealingDeque & operator=(WorkStealingDeque const &) = delete;
+
+        // Owner only
+        void push(T t) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t tp = top.load(std::memory_order_acquire);
+            Buffer * a = buffer.load(std::memory_order_relaxed);
+            if (b - tp > a->capacity - 1) {
+                a = grow(a, b, tp);
+            }
+            a->put(b, t);
+            bottom.store(b + 1, std::memory_order_release);
+        }
+
+        // Owner only.  Takes the most recently pushed element.
+        T pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Buffer * a = buffer.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_seq_cst);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return T{};
+            }
+            T ret = a->get(b);
+            if (t == b) {
+                // Last element, race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    ret = T{};
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        // Any thread.  Takes the oldest element; also returns T{} if another thread won the race for it.
+        T steal() {
+            int64_t t = top.load(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_seq_cst);
+            if (t >= b) {
+                return T{};
+            }
+            Buffer * a = buffer.load(std::memory_order_acquire);
+            T ret = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return T{};
+            }
+            return ret;
+        }
+
+        // A snapshot, exact only when no other thread is using the deque
+        bool empty() const {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+    };
+}
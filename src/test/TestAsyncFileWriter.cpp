@@ -0,0 +1,131 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<iterator>
+#include<string>
+#include<vector>
+
+#include<gradylib/AsyncFileWriter.hpp>
+#include<gradylib/MMapI2HRSOpenHashMap.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/MMapViewableOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashMapTC.hpp>
+#include<gradylib/OpenHashSetTC.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    string readFile(fs::path const & path) {
+        ifstream ifs(path, ios::binary);
+        return string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    }
+
+    struct Blob {
+        string s;
+
+        void serialize(ostream & os) const {
+            size_t n = s.size();
+            os.write(static_cast<char*>(static_cast<void*>(&n)), sizeof(n));
+            os.write(s.data(), n);
+        }
+
+        static string_view makeView(std::byte const * ptr) {
+            size_t n = *static_cast<size_t const *>(static_cast<void const *>(ptr));
+            return string_view(static_cast<char const *>(static_cast<void const *>(ptr + sizeof(size_t))), n);
+        }
+    };
+}
+
+TEST_CASE("writeAsync matches write") {
+    ThreadPool tp(2);
+    fs::path dir = fs::temp_directory_path();
+    fs::path syncFile = dir / "async_write_sync.bin";
+    fs::path asyncFile = dir / "async_write_async.bin";
+
+    OpenHashMapTC<int, double> tc;
+    OpenHashSetTC<int> set;
+    OpenHashMap<string, int> s2i;
+    for (int i = 0; i < 50000; ++i) {
+        tc[i] = i * 0.25;
+        set.insert(i * 3);
+        s2i[to_string(i)] = i;
+    }
+
+    tc.write(syncFile.string());
+    tc.writeAsync(asyncFile, alignof(void*), &tp).get();
+    REQUIRE(readFile(syncFile) == readFile(asyncFile));
+    OpenHashMapTC<int, double> tcLoaded(asyncFile);
+    REQUIRE(tcLoaded.at(49999) == 49999 * 0.25);
+
+    set.write(syncFile);
+    set.writeAsync(asyncFile).get();
+    REQUIRE(readFile(syncFile) == readFile(asyncFile));
+
+    writeMappable(syncFile.string(), s2i);
+    writeMappableAsync(asyncFile, s2i, &tp).get();
+    REQUIRE(readFile(syncFile) == readFile(asyncFile));
+    MMapS2IOpenHashMap<int> s2iLoaded(asyncFile);
+    REQUIRE(s2iLoaded["1234"] == 1234);
+
+    writeMappableCompressed(syncFile.string(), s2i);
+    writeMappableCompressedAsync(asyncFile, s2i, &tp).get();
+    REQUIRE(readFile(syncFile) == readFile(asyncFile));
+
+    MMapI2HRSOpenHashMap<int>::Builder hrs;
+    for (int i = 0; i < 1000; ++i) {
+        hrs.put(i, "s" + to_string(i % 10));
+    }
+    hrs.writeAsync(asyncFile, alignof(void*), &tp).get();
+    MMapI2HRSOpenHashMap<int> hrsLoaded(asyncFile);
+    REQUIRE(hrsLoaded.at(123) == "s3");
+
+    MMapViewableOpenHashMap<int, Blob>::Builder viewable;
+    viewable.put(7, Blob{"seven"});
+    viewable.writeAsync(asyncFile, alignof(void*), &tp).get();
+    MMapViewableOpenHashMap<int, Blob> viewableLoaded(asyncFile);
+    REQUIRE(viewableLoaded.at(7) == "seven");
+
+    fs::remove(syncFile);
+    fs::remove(asyncFile);
+}
+
+TEST_CASE("writeFileAsync with buffers smaller than the file") {
+    ThreadPool tp(2);
+    fs::path file = fs::temp_directory_path() / "async_write_small_buffers.bin";
+    OpenHashMapTC<int64_t, int64_t> m;
+    for (int64_t i = 0; i < 10000; ++i) {
+        m[i] = -i;
+    }
+    // Many hand offs, and seeks back into data already handed to the I/O thread
+    writeFileAsync(file, [&m](ostream & os) {
+        m.write(os);
+    }, &tp, 100).get();
+    OpenHashMapTC<int64_t, int64_t> loaded(file);
+    REQUIRE(loaded.size() == m.size());
+    for (int64_t i = 0; i < 10000; i += 7) {
+        REQUIRE(loaded.at(i) == -i);
+    }
+    fs::remove(file);
+}
+
+TEST_CASE("writeAsync errors arrive through the future") {
+    OpenHashMapTC<int, int> m;
+    m[1] = 2;
+    auto done = m.writeAsync("/nonexistent_directory/async.bin");
+    REQUIRE_THROWS(done.get());
+
+    auto failing = writeFileAsync(fs::temp_directory_path() / "async_write_throws.bin", [](ostream &) {
+        throw gradylibMakeException("serializer failed");
+    });
+    REQUIRE_THROWS(failing.get());
+    fs::remove(fs::temp_directory_path() / "async_write_throws.bin");
+}
@@ -0,0 +1,104 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<chrono>
+#include<future>
+#include<thread>
+
+#include<gradylib/Cancellation.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashSet.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+
+TEST_CASE("CancellationToken cancel and deadline") {
+    CancellationToken none;
+    REQUIRE(!none.isCancelled());
+    REQUIRE_THROWS(none.cancel());
+
+    CancellationToken token = CancellationToken::create();
+    CancellationToken copy = token;
+    REQUIRE(!copy.isCancelled());
+    token.cancel();
+    REQUIRE(copy.isCancelled());
+    REQUIRE_THROWS(copy.throwIfCancelled());
+
+    CancellationToken timed = CancellationToken::withTimeout(chrono::milliseconds(20));
+    REQUIRE(!timed.isCancelled());
+    this_thread::sleep_for(chrono::milliseconds(40));
+    REQUIRE(timed.isCancelled());
+}
+
+TEST_CASE("Cancelled pool tasks are discarded") {
+    ThreadPool tp(1);
+    // Hold the only worker so the other tasks stay queued
+    promise<void> release;
+    shared_future<void> released = release.get_future().share();
+    TaskGroup blocker = tp.add([released]() {
+        released.wait();
+    });
+
+    CancellationToken token = CancellationToken::create();
+    atomic<int> ran{0};
+    TaskGroup group = tp.add([&ran]() {
+        ++ran;
+    }, token);
+    TaskGroup ranges = tp.allocateOverThreads(100, [&ran](size_t, size_t) {
+        ++ran;
+    }, token);
+    auto submitted = tp.submit([]() {
+        return 1;
+    }, token);
+    auto kept = tp.submit([]() {
+        return 2;
+    });
+    token.cancel();
+    release.set_value();
+    group.wait();
+    ranges.wait();
+    REQUIRE(ran.load() == 0);
+    REQUIRE_THROWS(submitted.get());
+    REQUIRE(kept.get() == 2);
+    tp.wait();
+}
+
+TEST_CASE("parallelForEach stops when cancelled") {
+    ThreadPool tp(4);
+    OpenHashMap<int, int> m;
+    OpenHashSet<int> s;
+    for (int i = 0; i < 1000000; ++i) {
+        m[i] = i;
+        s.insert(i);
+    }
+    CancellationToken token = CancellationToken::create();
+    atomic<long> visited{0};
+    auto counting = m.parallelForEach<OpenHashMap<int, int>>(tp, [&](OpenHashMap<int, int> & out, int key, int value) {
+        if (visited.fetch_add(1) == 1000) {
+            token.cancel();
+        }
+    }, gradylib_helpers::PartialDefaultConstructor<OpenHashMap<int, int>>{},
+       gradylib_helpers::FinalDefaultConstructor<OpenHashMap<int, int>>{}, 0, token);
+    REQUIRE_THROWS(counting.get());
+    // Each partition stops within a check interval of the cancel
+    REQUIRE(visited.load() < 1001 + 4 * long(gradylib_helpers::cancellationCheckInterval));
+
+    CancellationToken expired = CancellationToken::withDeadline(chrono::steady_clock::now());
+    auto keys = s.parallelForEach<OpenHashSet<int>>(tp, [](OpenHashSet<int> & out, int key) {
+        out.insert(key);
+    }, gradylib_helpers::PartialDefaultConstructor<OpenHashSet<int>>{},
+       gradylib_helpers::FinalDefaultConstructor<OpenHashSet<int>>{}, 0, expired);
+    REQUIRE_THROWS(keys.get());
+
+    // An uncancelled token changes nothing
+    auto all = m.parallelForEach<OpenHashMap<int, int>>(tp, [](OpenHashMap<int, int> & out, int key, int value) {
+        out[key] = value;
+    }, gradylib_helpers::PartialDefaultConstructor<OpenHashMap<int, int>>{},
+       gradylib_helpers::FinalDefaultConstructor<OpenHashMap<int, int>>{}, 0, CancellationToken::create());
+    REQUIRE(all.get().size() == m.size());
+}
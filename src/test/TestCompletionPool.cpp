@@ -5,6 +5,11 @@
 #include<catch2/catch_test_macros.hpp>
 
 #include<iostream>
+#include<memory>
+#include<span>
+#include<string>
+#include<thread>
+#include<vector>
 
 #include<gradylib/AltIntHash.hpp>
 #include<gradylib/CompletionPool.hpp>
@@ -74,3 +79,83 @@ TEST_CASE("Completion Pool Heavy"){
     readerThread.join();
     REQUIRE(numFinished == numCompletions);
 }
+
+TEST_CASE("Completion Pool FIFO per thread and partial drain") {
+    CompletionPool<string> completionPool;
+    int const numThreads = 4;
+    int const perThread = 20000;
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([t, &completionPool]() {
+            // Alternate runs of single adds and batches of 100
+            vector<string> batch;
+            for (int i = 0; i < perThread; ++i) {
+                string s = to_string(t) + " " + to_string(i);
+                if ((i / 100) % 2 == 0) {
+                    completionPool.add(std::move(s));
+                } else {
+                    batch.push_back(std::move(s));
+                    if (batch.size() == 100) {
+                        completionPool.addBatch(span<string const>(batch));
+                        batch.clear();
+                    }
+                }
+            }
+        });
+    }
+    vector<int> next(numThreads, 0);
+    size_t total = 0;
+    bool ordered = true;
+    auto check = [&](string && s) {
+        int t = stoi(s.substr(0, s.find(' ')));
+        int i = stoi(s.substr(s.find(' ') + 1));
+        if (next[t] != i) {
+            ordered = false;
+        }
+        next[t] = i + 1;
+        ++total;
+    };
+    while (total < static_cast<size_t>(numThreads * perThread)) {
+        size_t n = completionPool.drain(check, 37);
+        REQUIRE(n <= 37);
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    REQUIRE(ordered);
+    REQUIRE(completionPool.drain(check) == 0);
+    for (int t = 0; t < numThreads; ++t) {
+        REQUIRE(next[t] == perThread);
+    }
+}
+
+TEST_CASE("Completion Pool drain takes turns and leftovers are destroyed") {
+    auto counter = make_shared<int>(0);
+    {
+        CompletionPool<shared_ptr<int>> completionPool;
+        vector<thread> threads;
+        for (int t = 0; t < 3; ++t) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < 1000; ++i) {
+                    completionPool.add(shared_ptr<int>(counter));
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join();
+        }
+        REQUIRE(counter.use_count() == 3001);
+        // A partial drain leaves the rest in the pool, and successive drains move on to the other threads' items
+        REQUIRE(completionPool.drain([](shared_ptr<int> &&) {}, 1000) == 1000);
+        REQUIRE(counter.use_count() == 2001);
+        size_t count = 0;
+        for (auto & p : completionPool) {
+            REQUIRE(p == counter);
+            if (++count == 500) {
+                break;
+            }
+        }
+        REQUIRE(counter.use_count() == 1502);
+    }
+    REQUIRE(counter.use_count() == 1);
+}
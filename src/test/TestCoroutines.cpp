@@ -0,0 +1,176 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<chrono>
+#include<future>
+#include<memory>
+#include<optional>
+#include<stdexcept>
+#include<string>
+#include<thread>
+#include<tuple>
+#include<vector>
+
+#include<gradylib/Coroutines.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+
+namespace {
+    Task<int> square(ThreadPool & tp, int x) {
+        co_await tp.schedule();
+        co_return x * x;
+    }
+
+    Task<> failing(ThreadPool & tp) {
+        co_await tp.schedule();
+        throw runtime_error("task failed");
+    }
+
+    Task<> hop(ThreadPool & tp) {
+        co_await tp.schedule();
+    }
+
+    Task<thread::id> workerId(ThreadPool & tp) {
+        co_await tp.schedule();
+        co_return this_thread::get_id();
+    }
+}
+
+TEST_CASE("Task runs lazily and returns its value") {
+    ThreadPool tp(2);
+    bool started = false;
+    auto body = [&]() -> Task<string> {
+        started = true;
+        co_return "done";
+    };
+    Task<string> t = body();
+    REQUIRE(!started);
+    REQUIRE(syncWait(std::move(t)) == "done");
+    REQUIRE(started);
+}
+
+TEST_CASE("Task schedule resumes on a worker") {
+    ThreadPool tp(2);
+    REQUIRE(syncWait(workerId(tp)) != this_thread::get_id());
+    REQUIRE(syncWait(square(tp, 7)) == 49);
+}
+
+TEST_CASE("Task nested awaits and exceptions") {
+    ThreadPool tp(2);
+    auto sum = [&]() -> Task<int> {
+        int total = 0;
+        for (int i = 0; i < 100; ++i) {
+            total += co_await square(tp, i);
+        }
+        co_return total;
+    };
+    REQUIRE(syncWait(sum()) == 328350);
+    REQUIRE_THROWS(syncWait(failing(tp)));
+}
+
+TEST_CASE("Task whenAll") {
+    ThreadPool tp(4);
+    auto [a, b, c] = syncWait(whenAll(square(tp, 2), square(tp, 3), hop(tp)));
+    REQUIRE(a == 4);
+    REQUIRE(b == 9);
+    REQUIRE(c == monostate{});
+
+    vector<Task<int>> tasks;
+    for (int i = 0; i < 1000; ++i) {
+        tasks.push_back(square(tp, i));
+    }
+    vector<int> results = syncWait(whenAll(std::move(tasks)));
+    REQUIRE(results.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(results[i] == i * i);
+    }
+
+    REQUIRE(syncWait(whenAll(vector<Task<int>>{})).empty());
+
+    vector<Task<>> withFailure;
+    withFailure.push_back(failing(tp));
+    withFailure.push_back(hop(tp));
+    REQUIRE_THROWS(syncWait(whenAll(std::move(withFailure))));
+}
+
+TEST_CASE("Task parallelForEachAsync interleaves requests on a small pool") {
+    ThreadPool tp(2);
+    OpenHashMap<int, int> m;
+    for (int i = 0; i < 10000; ++i) {
+        m[i] = i;
+    }
+    auto request = [&](int threshold) -> Task<size_t> {
+        co_await tp.schedule();
+        auto matches = m.parallelForEachAsync(tp, [threshold](OpenHashMap<int, int> & out, int const & key, int const & value) {
+            if (value >= threshold) {
+                out[key] = value;
+            }
+        });
+        OpenHashMap<int, int> merged = co_await std::move(matches);
+        co_return merged.size();
+    };
+    // Many more requests than workers, each waiting on its own parallelForEach
+    vector<Task<size_t>> requests;
+    for (int i = 0; i < 50; ++i) {
+        requests.push_back(request(i * 100));
+    }
+    vector<size_t> sizes = syncWait(whenAll(std::move(requests)));
+    for (int i = 0; i < 50; ++i) {
+        REQUIRE(sizes[i] == 10000 - i * 100);
+    }
+
+
+    OpenHashMap<int, int> empty;
+    auto none = empty.parallelForEachAsync(tp, [](OpenHashMap<int, int> &, int const &, int const &) {
+    });
+    REQUIRE(none.get().size() == 0);
+}
+
+TEST_CASE("AsyncPromise resumes the awaiter when completed") {
+    ThreadPool tp(2);
+    AsyncPromise<int> p(tp);
+    auto waiting = [](AsyncFuture<int> f) -> Task<int> {
+        co_return co_await std::move(f) + 1;
+    };
+    thread setter([&]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        p.set_value(5);
+    });
+    REQUIRE(syncWait(waiting(p.get_future())) == 6);
+    setter.join();
+    REQUIRE_THROWS(p.set_value(7));
+
+    AsyncPromise<void> failed(tp);
+    failed.set_exception(make_exception_ptr(runtime_error("failed")));
+    REQUIRE_THROWS(failed.get_future().get());
+
+    optional<AsyncFuture<string>> abandoned;
+    {
+        AsyncPromise<string> dropped(tp);
+        abandoned.emplace(dropped.get_future());
+    }
+    REQUIRE(abandoned->isReady());
+    REQUIRE_THROWS_AS(abandoned->get(), future_error);
+}
+
+TEST_CASE("awaitFuture waits on a std::future") {
+    ThreadPool tp(2);
+    promise<int> p;
+    thread setter([&]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        p.set_value(5);
+    });
+    REQUIRE(syncWait(awaitFuture(tp, p.get_future())) == 5);
+    setter.join();
+
+    promise<void> failed;
+    failed.set_exception(make_exception_ptr(runtime_error("future failed")));
+    REQUIRE_THROWS(syncWait(awaitFuture(tp, failed.get_future())));
+}
@@ -0,0 +1,123 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+
+#include<gradylib/DurableOpenHashMapTC.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    fs::path freshDirectory(string name) {
+        fs::path dir = fs::temp_directory_path() / name;
+        fs::remove_all(dir);
+        return dir;
+    }
+}
+
+TEST_CASE("DurableOpenHashMapTC recovers from the log") {
+    fs::path dir = freshDirectory("durable_log");
+    {
+        DurableOpenHashMapTC<int, double> m(dir);
+        for (int i = 0; i < 10000; ++i) {
+            m.put(i, i);
+        }
+        m.erase(5);
+        m.put(6, -6);
+        m.sync();
+    }
+    REQUIRE(!fs::exists(dir / "checkpoint.bin"));
+    DurableOpenHashMapTC<int, double> m(dir);
+    REQUIRE(m.size() == 9999);
+    REQUIRE(!m.contains(5));
+    REQUIRE(m.at(6) == -6);
+    REQUIRE(m.get(9999) == 9999);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DurableOpenHashMapTC checkpoint then log tail") {
+    fs::path dir = freshDirectory("durable_checkpoint");
+    WalOptions options;
+    options.groupCommitInterval = chrono::milliseconds(0);
+    {
+        DurableOpenHashMapTC<int64_t, int64_t> m(dir, options);
+        for (int64_t i = 0; i < 1000; ++i) {
+            m.put(i, i * 2);
+        }
+        m.checkpoint();
+        REQUIRE(fs::exists(dir / "checkpoint.bin"));
+        REQUIRE(!fs::exists(dir / "wal.0"));
+        for (int64_t i = 1000; i < 1100; ++i) {
+            m.put(i, i * 2);
+        }
+        m.erase(0);
+    }
+    {
+        DurableOpenHashMapTC<int64_t, int64_t> m(dir, options);
+        REQUIRE(m.size() == 1099);
+        REQUIRE(!m.contains(0));
+        REQUIRE(m.at(500) == 1000);
+        REQUIRE(m.at(1099) == 2198);
+        // The checkpoint is mapped copy on write, so modifying it must not touch the file
+        m.put(500, -1);
+        m.checkpoint();
+    }
+    DurableOpenHashMapTC<int64_t, int64_t> m(dir, options);
+    REQUIRE(m.at(500) == -1);
+    REQUIRE(m.size() == 1099);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DurableOpenHashMapTC ignores a torn log tail") {
+    fs::path dir = freshDirectory("durable_torn");
+    {
+        DurableOpenHashMapTC<int, int> m(dir);
+        m.put(1, 1);
+        m.put(2, 2);
+        m.sync();
+    }
+    uintmax_t goodSize = fs::file_size(dir / "wal.0");
+    {
+        ofstream ofs(dir / "wal.0", ios::binary | ios::app);
+        uint64_t header[4] = {gradylib_helpers::walBatchMagic, 1, 1000, 0};
+        ofs.write(reinterpret_cast<char const *>(header), sizeof(header));
+        ofs << "partial";
+    }
+    {
+        DurableOpenHashMapTC<int, int> m(dir);
+        REQUIRE(fs::file_size(dir / "wal.0") == goodSize);
+        REQUIRE(m.size() == 2);
+        m.put(3, 3);
+    }
+    DurableOpenHashMapTC<int, int> m(dir);
+    REQUIRE(m.size() == 3);
+    REQUIRE(m.at(3) == 3);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DurableOpenHashMapTC automatic checkpoint") {
+    fs::path dir = freshDirectory("durable_auto");
+    WalOptions options;
+    options.groupCommitOps = 100;
+    options.groupCommitInterval = chrono::milliseconds(1);
+    options.checkpointOps = 1000;
+    {
+        DurableOpenHashMapTC<int, int> m(dir, options);
+        for (int i = 0; i < 5000; ++i) {
+            m.put(i, i);
+        }
+        for (int tries = 0; tries < 1000 && !fs::exists(dir / "checkpoint.bin"); ++tries) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        REQUIRE(fs::exists(dir / "checkpoint.bin"));
+    }
+    DurableOpenHashMapTC<int, int> m(dir, options);
+    REQUIRE(m.size() == 5000);
+    fs::remove_all(dir);
+}
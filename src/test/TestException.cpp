@@ -0,0 +1,57 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<gradylib/Exception.hpp>
+
+using namespace std;
+
+TEST_CASE("Exception what contains the message") {
+    try {
+        throw gradylibMakeException("key not found");
+    } catch (gradylib::Exception const & e) {
+        string what = e.what();
+        REQUIRE(what.find("key not found") != string::npos);
+        // The message is formatted once and reused
+        REQUIRE(e.what() == e.what());
+    }
+}
+
+TEST_CASE("Exception copies share the formatted message") {
+    gradylib::Exception e = gradylibMakeException("abc");
+    gradylib::Exception copy = e;
+    REQUIRE(string(copy.what()) == string(e.what()));
+}
+
+TEST_CASE("Exception what from several threads") {
+    gradylib::Exception e = gradylibMakeException("abc");
+    vector<thread> threads;
+    vector<string> whats(4);
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&e, &whats, i]() {
+            whats[i] = e.what();
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    for (auto const & w : whats) {
+        REQUIRE(w == whats[0]);
+    }
+}
+
+TEST_CASE("Exception with stack trace capture disabled") {
+    gradylib::Exception::setStackTraceCapture(false);
+    try {
+        throw gradylibMakeException("no trace");
+    } catch (gradylib::Exception const & e) {
+        REQUIRE(string(e.what()).find("no trace") != string::npos);
+    }
+    gradylib::Exception::setStackTraceCapture(true);
+}
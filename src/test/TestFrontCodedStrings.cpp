@@ -0,0 +1,127 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<sstream>
+#include<string>
+#include<vector>
+
+#include<gradylib/FrontCodedStrings.hpp>
+#include<gradylib/MMapI2SCompressedOpenHashMap.hpp>
+#include<gradylib/MMapI2SOpenHashMap.hpp>
+#include<gradylib/MMapS2ICompressedOpenHashMap.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    string url(int i) {
+        return "https://example.com/some/long/shared/path/" + to_string(i / 100) + "/item_" + to_string(i);
+    }
+}
+
+TEST_CASE("FrontCodedStrings get and find") {
+    vector<string> strings;
+    for (int i = 0; i < 1000; ++i) {
+        strings.push_back(url(i));
+    }
+    strings.push_back("");
+    strings.push_back("a");
+    sort(strings.begin(), strings.end());
+    vector<string_view> sorted(strings.begin(), strings.end());
+    ostringstream os;
+    gradylib_helpers::writeFrontCoded(os, sorted);
+    string image = os.str();
+    REQUIRE(image.size() % 8 == 0);
+    vector<uint64_t> aligned(image.size() / 8);
+    memcpy(aligned.data(), image.data(), image.size());
+    gradylib_helpers::FrontCodedStrings dictionary(aligned.data());
+    REQUIRE(dictionary.size() == strings.size());
+    string buffer;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        REQUIRE(dictionary.get(i, buffer) == strings[i]);
+        REQUIRE(dictionary.find(strings[i], buffer) == i);
+    }
+    REQUIRE(!dictionary.find("https://example.com/missing", buffer).has_value());
+    REQUIRE(!dictionary.find("zzz", buffer).has_value());
+}
+
+TEST_CASE("MMapS2ICompressedOpenHashMap") {
+    OpenHashMap<string, int> m;
+    for (int i = 0; i < 10000; ++i) {
+        m[url(i)] = i;
+    }
+    m.erase(url(5));
+    fs::path tmpPath = fs::temp_directory_path();
+    fs::path plainFile = tmpPath / "s2i_plain.bin";
+    fs::path compressedFile = tmpPath / "s2i_compressed.bin";
+    writeMappable(plainFile, m);
+    writeMappableCompressed(compressedFile, m);
+    REQUIRE(fs::file_size(compressedFile) * 2 < fs::file_size(plainFile));
+
+    MMapS2ICompressedOpenHashMap<int> m2(compressedFile);
+    REQUIRE(m2.size() == m.size());
+    for (auto const & [key, value] : m) {
+        REQUIRE(m2.contains(key));
+        REQUIRE(m2[key] == value);
+    }
+    REQUIRE(!m2.contains(url(5)));
+    REQUIRE(!m2.contains("not a key"));
+    REQUIRE_THROWS(m2[url(5)]);
+    REQUIRE(*m2.find(url(6), m2.hashKey(url(6))) == 6);
+    REQUIRE(!m2.find(url(5), m2.hashKey(url(5))));
+    REQUIRE(!m2.find("not a key"));
+    REQUIRE(*m2.find(url(7)) == 7);
+    REQUIRE(m2.clone().size() == m.size());
+    REQUIRE_THROWS(MMapS2ICompressedOpenHashMap<int>(plainFile));
+    fs::remove(plainFile);
+    fs::remove(compressedFile);
+}
+
+TEST_CASE("MMapI2SCompressedOpenHashMap") {
+    OpenHashMap<int, string> m;
+    for (int i = 0; i < 10000; ++i) {
+        m[i] = url(i % 3000);
+    }
+    m.erase(7);
+    fs::path tmpFile = fs::temp_directory_path() / "i2s_compressed.bin";
+    writeMappableCompressed(tmpFile, m);
+    MMapI2SCompressedOpenHashMap<int> m2(tmpFile);
+    REQUIRE(m2.size() == m.size());
+    string buffer;
+    for (auto const & [key, value] : m) {
+        REQUIRE(m2.at(key, buffer) == value);
+        REQUIRE(m2[key] == value);
+    }
+    REQUIRE(!m2.contains(7));
+    REQUIRE_THROWS(m2.at(7));
+    REQUIRE(m2.find(8, m2.hashKey(8), buffer) == url(8));
+    REQUIRE(!m2.find(7, m2.hashKey(7)).has_value());
+    REQUIRE(!m2.find(7).has_value());
+    REQUIRE(m2.find(9, buffer) == url(9));
+    auto cloned = m2.clone();
+    REQUIRE(cloned.size() == m.size());
+    REQUIRE(cloned.at(9999) == url(9999 % 3000));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Compressed maps of empty OpenHashMaps") {
+    fs::path tmpFile = fs::temp_directory_path() / "empty_compressed.bin";
+    OpenHashMap<string, int> s2i;
+    writeMappableCompressed(tmpFile, s2i);
+    MMapS2ICompressedOpenHashMap<int> m1(tmpFile);
+    REQUIRE(m1.size() == 0);
+    REQUIRE(!m1.contains("a"));
+    OpenHashMap<int, string> i2s;
+    writeMappableCompressed(tmpFile, i2s);
+    MMapI2SCompressedOpenHashMap<int> m2(tmpFile);
+    REQUIRE(m2.size() == 0);
+    REQUIRE(!m2.contains(1));
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,70 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<cstdint>
+#include<string>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+#include<gradylib/GroupBy.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashMapTC.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+
+TEST_CASE("GroupBy counts over several windows") {
+    ThreadPool tp(4);
+    vector<pair<int64_t, int>> records;
+    unordered_map<int64_t, int64_t> expected;
+    uint64_t x = 12345;
+    for (int i = 0; i < 200000; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        int64_t key = (x >> 33) % 5000;
+        records.emplace_back(key, i);
+        ++expected[key];
+    }
+    GroupByOptions options;
+    options.windowSize = 30000;
+    GroupBy<OpenHashMapTC<int64_t, int64_t>, void (*)(int64_t &, int)> counts(tp, [](int64_t & count, int) { ++count; }, options);
+    // Added in two pieces, as a stream would be
+    counts.add(records.begin(), records.begin() + 50000);
+    counts.add(records.begin() + 50000, records.end());
+    auto result = std::move(counts).finish();
+    REQUIRE(result.numPartitions() == 16);
+    REQUIRE(result.size() == expected.size());
+    for (auto const & [key, count] : expected) {
+        REQUIRE(result.at(key) == count);
+    }
+    REQUIRE(!result.contains(int64_t(-1)));
+    REQUIRE_THROWS(result.at(int64_t(-1)));
+
+    // The partitions hold disjoint keys and iteration visits each once
+    size_t visited = 0;
+    for (auto const & [key, count] : result) {
+        REQUIRE(expected.at(key) == count);
+        ++visited;
+    }
+    REQUIRE(visited == expected.size());
+}
+
+TEST_CASE("groupBy sums into OpenHashMap") {
+    ThreadPool tp(3);
+    vector<pair<string, double>> records;
+    for (int i = 0; i < 10000; ++i) {
+        records.emplace_back("key" + to_string(i % 7), 0.5);
+    }
+    auto sums = groupBy<OpenHashMap<string, double>>(tp, records, [](double & sum, double v) { sum += v; });
+    REQUIRE(sums.size() == 7);
+    REQUIRE(sums.at(string("key0")) == 0.5 * 1429);
+    REQUIRE(sums.at(string("key6")) == 0.5 * 1428);
+
+    auto empty = groupBy<OpenHashMap<string, double>>(vector<pair<string, double>>{}, [](double & sum, double v) { sum += v; });
+    REQUIRE(empty.size() == 0);
+    REQUIRE(empty.begin() == empty.end());
+}
@@ -0,0 +1,116 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<string>
+#include<string_view>
+
+#include<gradylib/HashJoin.hpp>
+#include<gradylib/MMapI2HRSOpenHashMap.hpp>
+#include<gradylib/MMapI2SCompressedOpenHashMap.hpp>
+#include<gradylib/MMapI2SOpenHashMap.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashMapTC.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+TEST_CASE("hashJoin OpenHashMapTC") {
+    ThreadPool tp(4);
+    OpenHashMapTC<int, int> left;
+    OpenHashMapTC<int, double> right;
+    for (int i = 0; i < 100000; ++i) {
+        left[i] = i;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        right[3 * i] = 0.5 * i;
+    }
+    // right is smaller so it's the side iterated, but the values still arrive left first
+    auto joined = hashJoin<OpenHashMap<int, double>>(tp, left, right, [](OpenHashMap<int, double> & out, int key, int l, double r) {
+        out[key] = l + r;
+    }).get();
+    REQUIRE(joined.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(joined.at(3 * i) == 3 * i + 0.5 * i);
+    }
+
+    OpenHashMapTC<int, double> empty;
+    REQUIRE(hashJoin<OpenHashMap<int, double>>(tp, left, empty, [](OpenHashMap<int, double> & out, int key, int l, double r) {
+        out[key] = r;
+    }).get().size() == 0);
+}
+
+TEST_CASE("hashJoin OpenHashMap with MMapS2IOpenHashMap") {
+    ThreadPool tp(4);
+    OpenHashMap<string, int> vocab;
+    for (int i = 0; i < 20000; ++i) {
+        vocab[to_string(i)] = i;
+    }
+    vocab.erase("5");
+    fs::path tmpFile = fs::temp_directory_path() / "hash_join_s2i.bin";
+    writeMappable(tmpFile, vocab);
+    MMapS2IOpenHashMap<int> mapped(tmpFile);
+
+    OpenHashMap<string, double> weights;
+    for (int i = 0; i < 30; ++i) {
+        weights[to_string(i)] = i * 2.0;
+    }
+    weights["missing"] = 1.0;
+
+    auto joined = hashJoin<OpenHashMap<int, double>>(tp, mapped, weights, [](OpenHashMap<int, double> & out, string_view key, int idx, double weight) {
+        if (key == to_string(idx)) {
+            out[idx] = weight;
+        }
+    }).get();
+    REQUIRE(joined.size() == 29);
+    REQUIRE(!joined.contains(5));
+    REQUIRE(joined.at(29) == 58.0);
+
+    // The other way around, and on the default pool
+    auto reversed = hashJoin<OpenHashMap<int, double>>(weights, mapped, [](OpenHashMap<int, double> & out, auto const & key, double weight, int idx) {
+        out[idx] = weight;
+    }).get();
+    REQUIRE(reversed.size() == 29);
+    REQUIRE(reversed.at(29) == 58.0);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("hashJoin integer to string maps") {
+    ThreadPool tp(4);
+    OpenHashMap<int, string> strings;
+    for (int i = 0; i < 5000; ++i) {
+        strings[i] = "value " + to_string(i % 100);
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "hash_join_i2s.bin";
+    fs::path compressedFile = fs::temp_directory_path() / "hash_join_i2s_compressed.bin";
+    fs::path hrsFile = fs::temp_directory_path() / "hash_join_i2hrs.bin";
+    writeMappable(tmpFile, strings);
+    writeMappableCompressed(compressedFile, strings);
+    MMapI2HRSOpenHashMap<int>::Builder b;
+    for (int i = 0; i < 5000; i += 2) {
+        b.put(i, strings.at(i));
+    }
+    b.write(hrsFile.string());
+    MMapI2SOpenHashMap<int> i2s(tmpFile);
+    MMapI2SCompressedOpenHashMap<int> compressed(compressedFile);
+    MMapI2HRSOpenHashMap<int> hrs(hrsFile);
+
+    auto sameString = [](OpenHashMap<int, int> & out, int key, string_view l, string_view r) {
+        if (l == r) {
+            out[key] = 1;
+        }
+    };
+    // The compressed map can only be probed
+    REQUIRE(hashJoin<OpenHashMap<int, int>>(tp, compressed, i2s, sameString).get().size() == 5000);
+    REQUIRE(hashJoin<OpenHashMap<int, int>>(tp, hrs, compressed, sameString).get().size() == 2500);
+    REQUIRE(hashJoin<OpenHashMap<int, int>>(tp, i2s, hrs, sameString).get().size() == 2500);
+    fs::remove(tmpFile);
+    fs::remove(compressedFile);
+    fs::remove(hrsFile);
+}
@@ -0,0 +1,109 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<filesystem>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<gradylib/HotSwappable.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    struct CountedValue {
+        static inline atomic<int> live{0};
+        int value;
+
+        explicit CountedValue(int value)
+            : value(value)
+        {
+            live.fetch_add(1);
+        }
+
+        ~CountedValue() {
+            live.fetch_sub(1);
+        }
+    };
+}
+
+TEST_CASE("HotSwappable swap destroys the old value") {
+    {
+        HotSwappable<CountedValue> h(1);
+        REQUIRE(h.read()->value == 1);
+        h.swap(2);
+        REQUIRE(h.read()->value == 2);
+        REQUIRE(CountedValue::live.load() == 1);
+    }
+    REQUIRE(CountedValue::live.load() == 0);
+}
+
+TEST_CASE("HotSwappable swap waits for readers of the old value") {
+    HotSwappable<CountedValue> h(1);
+    atomic<bool> swapped{false};
+    thread writer;
+    {
+        auto guard = h.read();
+        writer = thread([&]() {
+            h.swap(2);
+            swapped.store(true);
+        });
+        this_thread::sleep_for(chrono::milliseconds(50));
+        REQUIRE(!swapped.load());
+        REQUIRE(guard->value == 1);
+    }
+    writer.join();
+    REQUIRE(swapped.load());
+    REQUIRE(h.read()->value == 2);
+}
+
+TEST_CASE("HotSwappable MMapS2IOpenHashMap under concurrent readers") {
+    fs::path tmpPath = fs::temp_directory_path();
+    vector<fs::path> files;
+    for (int version = 0; version < 2; ++version) {
+        OpenHashMap<string, int> m;
+        for (int i = 0; i < 1000; ++i) {
+            m[to_string(i)] = version;
+        }
+        files.push_back(tmpPath / ("hot_swap_" + to_string(version) + ".bin"));
+        writeMappable(files.back(), m);
+    }
+
+    HotSwappable<MMapS2IOpenHashMap<int>> h(files[0]);
+    atomic<bool> stop{false};
+    atomic<bool> inconsistent{false};
+    vector<thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&]() {
+            while (!stop.load(memory_order_relaxed)) {
+                auto guard = h.read();
+                int first = (*guard)["0"];
+                for (int i = 1; i < 1000; i += 97) {
+                    if ((*guard)[to_string(i)] != first) {
+                        inconsistent.store(true);
+                    }
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 200; ++i) {
+        h.swap(files[i % 2]);
+    }
+    stop.store(true);
+    for (auto & t : readers) {
+        t.join();
+    }
+    REQUIRE(!inconsistent.load());
+    REQUIRE(h.read()->size() == 1000);
+    for (auto & f : files) {
+        fs::remove(f);
+    }
+}
@@ -116,6 +116,10 @@ TEST_CASE("MMapI2HRSOpenHashMap at throws on missing element") {
     builder.write(tmpFile);
     MMapI2HRSOpenHashMap<int> m(tmpFile);
     REQUIRE_THROWS(m.at(0));
+    REQUIRE(!m.find(0, m.hashKey(0)).has_value());
+    REQUIRE(m.find(1, m.hashKey(1)) == "abc");
+    REQUIRE(!m.find(2).has_value());
+    REQUIRE(m.find(1) == "abc");
     fs::remove(tmpFile);
 }
 
@@ -107,6 +107,12 @@ TEST_CASE("MMapViewableOpenHashMap throws on empty map") {
     builder.write(tmpFile);
     gradylib::MMapViewableOpenHashMap<int, vector<int>> m2(tmpFile);
     REQUIRE_THROWS(m2.at(2));
+    REQUIRE(!m2.find(2, m2.hashKey(2)).has_value());
+    auto view = m2.find(1, m2.hashKey(1));
+    REQUIRE(view.has_value());
+    REQUIRE((*view)[2] == 3);
+    REQUIRE(!m2.find(2).has_value());
+    REQUIRE(m2.find(1).has_value());
     filesystem::remove(tmpFile);
 }
 
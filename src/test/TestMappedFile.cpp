@@ -0,0 +1,187 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<fstream>
+#include<iterator>
+#include<string>
+#include<vector>
+
+#include<gradylib/MappedFile.hpp>
+#include<gradylib/MMapI2HRSOpenHashMap.hpp>
+#include<gradylib/MMapI2SOpenHashMap.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashMapTC.hpp>
+#include<gradylib/OpenHashSetTC.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    vector<char> readFile(fs::path const & path) {
+        ifstream ifs(path, ios::binary);
+        return vector<char>(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    }
+
+    // Copy bytes into 8 byte aligned storage, the way a buffer received from another process would be placed
+    vector<uint64_t> alignedCopy(vector<char> const & bytes) {
+        vector<uint64_t> ret(bytes.size() / 8 + 1);
+        memcpy(ret.data(), bytes.data(), bytes.size());
+        return ret;
+    }
+
+#ifdef __linux__
+    size_t countOpenDescriptors() {
+        return distance(fs::directory_iterator("/proc/self/fd"), fs::directory_iterator());
+    }
+#endif
+}
+
+TEST_CASE("MappedFile maps the whole file") {
+    fs::path tmpFile = fs::temp_directory_path() / "mapped_file.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        ofs << "abcdefg";
+    }
+    MappedFile mf(tmpFile);
+    REQUIRE(mf.size() == 7);
+    REQUIRE(string(static_cast<char const *>(mf.data()), mf.size()) == "abcdefg");
+    MappedFile mf2(std::move(mf));
+    REQUIRE(mf.empty());
+    REQUIRE(mf2.size() == 7);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("MappedFile with a data offset") {
+    fs::path tmpFile = fs::temp_directory_path() / "mapped_file.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        ofs << "headerabcdefg";
+    }
+    int fd = open(tmpFile.c_str(), O_RDONLY);
+    REQUIRE(fd >= 0);
+    MappedFile mf(fd, size_t(6));
+    REQUIRE(mf.size() == 7);
+    REQUIRE(string(static_cast<char const *>(mf.data()), mf.size()) == "abcdefg");
+    MappedFile mf2;
+    mf2 = std::move(mf);
+    REQUIRE(mf.empty());
+    REQUIRE(mf2.size() == 7);
+    REQUIRE(string(static_cast<char const *>(mf2.data()), mf2.size()) == "abcdefg");
+    REQUIRE_THROWS(MappedFile(fd, size_t(14)));
+    close(fd);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("MappedFile throws on nonexistent file") {
+    REQUIRE_THROWS(MappedFile("/__gradylib_nonexistent_dir/map.bin"));
+}
+
+#ifdef __linux__
+TEST_CASE("MappedFile doesn't hold a file descriptor") {
+    fs::path tmpFile = fs::temp_directory_path() / "map.bin";
+    OpenHashMapTC<int, double> m;
+    m[1] = 2.5;
+    m.write(tmpFile);
+    size_t before = countOpenDescriptors();
+    vector<OpenHashMapTC<int, double>> maps;
+    for (int i = 0; i < 100; ++i) {
+        maps.emplace_back(tmpFile);
+    }
+    REQUIRE(countOpenDescriptors() == before);
+    REQUIRE(maps.back().at(1) == 2.5);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("MappedFile from memfd") {
+    MMapI2HRSOpenHashMap<int>::Builder builder;
+    builder.put(1, "abc");
+    builder.put(2, "abc");
+    builder.put(3, "xyz");
+    fs::path tmpFile = fs::temp_directory_path() / "map.bin";
+    builder.write(tmpFile);
+    vector<char> bytes = readFile(tmpFile);
+    fs::remove(tmpFile);
+
+    int fd = memfd_create("gradylib_test", 0);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+    MappedFile mf(fd);
+    close(fd);
+    MMapI2HRSOpenHashMap<int> m(mf.data());
+    REQUIRE(m.size() == 3);
+    REQUIRE(m.at(1) == "abc");
+    REQUIRE(m.at(2) == "abc");
+    REQUIRE(m.at(3) == "xyz");
+}
+#endif
+
+TEST_CASE("MMapS2IOpenHashMap and MMapI2SOpenHashMap from memory") {
+    OpenHashMap<string, int> s2i;
+    OpenHashMap<int, string> i2s;
+    for (int i = 0; i < 1000; ++i) {
+        s2i[to_string(i)] = i;
+        i2s[i] = to_string(i);
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "map.bin";
+    writeMappable(tmpFile, s2i);
+    vector<uint64_t> s2iBuffer = alignedCopy(readFile(tmpFile));
+    writeMappable(tmpFile, i2s);
+    vector<uint64_t> i2sBuffer = alignedCopy(readFile(tmpFile));
+    fs::remove(tmpFile);
+
+    MMapS2IOpenHashMap<int> s2iLoaded(static_cast<void const *>(s2iBuffer.data()));
+    MMapI2SOpenHashMap<int> i2sLoaded(static_cast<void const *>(i2sBuffer.data()));
+    REQUIRE(s2iLoaded.size() == s2i.size());
+    REQUIRE(i2sLoaded.size() == i2s.size());
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(s2iLoaded[to_string(i)] == i);
+        REQUIRE(i2sLoaded[i] == to_string(i));
+    }
+}
+
+TEST_CASE("Load several containers from sections of one mapping") {
+    OpenHashMapTC<int, double> m;
+    OpenHashSetTC<int64_t> s;
+    for (int i = 0; i < 100; ++i) {
+        m[i] = i / 2.0;
+        s.insert(i * 3);
+    }
+    fs::path tmpPath = fs::temp_directory_path();
+    m.write(tmpPath / "map.bin");
+    s.write(tmpPath / "set.bin");
+    vector<char> mapBytes = readFile(tmpPath / "map.bin");
+    vector<char> setBytes = readFile(tmpPath / "set.bin");
+    fs::remove(tmpPath / "map.bin");
+    fs::remove(tmpPath / "set.bin");
+
+    // Bundle layout: both containers, each starting on an 8 byte boundary
+    fs::path bundleFile = tmpPath / "bundle.bin";
+    size_t setStart = mapBytes.size() + gradylib_helpers::getPadLength<8>(mapBytes.size());
+    {
+        ofstream ofs(bundleFile, ios::binary);
+        ofs.write(mapBytes.data(), mapBytes.size());
+        gradylib_helpers::writePad<8>(ofs);
+        ofs.write(setBytes.data(), setBytes.size());
+    }
+    MappedFile bundle(bundleFile);
+    std::byte const * base = static_cast<std::byte const *>(bundle.data());
+    OpenHashMapTC<int, double> m2(static_cast<void const *>(base));
+    OpenHashSetTC<int64_t> s2(static_cast<void const *>(base + setStart));
+    REQUIRE(m2.size() == m.size());
+    REQUIRE(s2.size() == s.size());
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(m2.at(i) == i / 2.0);
+        REQUIRE(s2.contains(i * 3));
+    }
+    fs::remove(bundleFile);
+}
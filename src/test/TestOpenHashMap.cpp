@@ -656,6 +656,30 @@ TEST_CASE("MMapS2IOpenHashMap move assignment") {
     filesystem::remove(tmpFile);
 }
 
+TEST_CASE("MMapS2IOpenHashMap move assignment from a temporary") {
+    fs::path tmpFile = filesystem::temp_directory_path() / "map.bin";
+    gradylib::OpenHashMap<string, int> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[to_string(i)] = i;
+    }
+    gradylib::writeMappable(tmpFile, m);
+    gradylib::MMapS2IOpenHashMap<int> m2;
+    // The temporary is destroyed here, so m2 must own the mapping
+    m2 = gradylib::MMapS2IOpenHashMap<int>(tmpFile);
+    filesystem::remove(tmpFile);
+    REQUIRE(m2.size() == m.size());
+    for (int i = 0; i < 1000; ++i) {
+        int const * value = m2.find(to_string(i));
+        REQUIRE(value);
+        REQUIRE(*value == i);
+        REQUIRE(m2[to_string(i)] == i);
+    }
+    REQUIRE(!m2.find("missing"));
+    gradylib::MMapS2IOpenHashMap<int> & self = m2;
+    m2 = std::move(self);
+    REQUIRE(m2["999"] == 999);
+}
+
 TEST_CASE("MMapS2IOpenHashMap open nonexistent file throws") {
     REQUIRE_THROWS(gradylib::MMapS2IOpenHashMap<int>("non existent file"));
 }
@@ -847,6 +871,120 @@ TEST_CASE("MMapS2IOpenHashMap clone") {
     filesystem::remove(tmpFile);
 }
 
+namespace {
+    template<typename T>
+    struct SaltedStringHash {
+        size_t operator()(T const & s) const noexcept {
+            return std::hash<std::string_view>{}(std::string_view(s)) * 31 + 7;
+        }
+    };
+}
+
+TEST_CASE("MMapS2IOpenHashMap custom hash function") {
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    gradylib::OpenHashMap<string, int, SaltedStringHash> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[to_string(i)] = i;
+    }
+    gradylib::writeMappable(tmpFile, m);
+    gradylib::MMapS2IOpenHashMap<int, SaltedStringHash> m2(tmpFile);
+    REQUIRE(m2.size() == m.size());
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(m2[to_string(i)] == i);
+    }
+    REQUIRE(!m2.contains("1000"));
+    filesystem::remove(tmpFile);
+}
+
+TEST_CASE("MMapS2IOpenHashMap throws on hash function mismatch") {
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    gradylib::OpenHashMap<string, int, SaltedStringHash> m;
+    m["abc"] = 0;
+    gradylib::writeMappable(tmpFile, m);
+    REQUIRE_THROWS(gradylib::MMapS2IOpenHashMap<int>(tmpFile));
+    filesystem::remove(tmpFile);
+}
+
+TEST_CASE("MMapI2SOpenHashMap throws on hash function mismatch") {
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    gradylib::OpenHashMap<int, string, std::hash> m;
+    m[1] = "abc";
+    gradylib::writeMappable(tmpFile, m);
+    REQUIRE_THROWS(gradylib::MMapI2SOpenHashMap<int>(tmpFile));
+    REQUIRE(gradylib::MMapI2SOpenHashMap<int, std::hash>(tmpFile)[1] == "abc");
+    filesystem::remove(tmpFile);
+}
+
+TEST_CASE("MMap maps find with a precomputed hash") {
+    fs::path tmpPath = filesystem::temp_directory_path();
+    vector<fs::path> files;
+    for (int version = 0; version < 3; ++version) {
+        gradylib::OpenHashMap<string, int> m;
+        for (int i = version; i < 100; i += 3) {
+            m[to_string(i)] = i * 10 + version;
+        }
+        files.push_back(tmpPath / ("find_hash_" + to_string(version) + ".bin"));
+        gradylib::writeMappable(files.back(), m);
+    }
+    vector<gradylib::MMapS2IOpenHashMap<int>> maps;
+    for (auto const & f : files) {
+        maps.emplace_back(f);
+    }
+    for (int i = 0; i < 110; ++i) {
+        string key = to_string(i);
+        size_t hash = maps[0].hashKey(key);
+        for (int version = 0; version < 3; ++version) {
+            int const * value = maps[version].find(key, hash);
+            if (i < 100 && i % 3 == version) {
+                REQUIRE(value);
+                REQUIRE(*value == i * 10 + version);
+            } else {
+                REQUIRE(!value);
+            }
+        }
+    }
+
+    gradylib::OpenHashMap<int, string> m;
+    m[5] = "five";
+    gradylib::writeMappable(files[0], m);
+    gradylib::MMapI2SOpenHashMap<int> m2(files[0]);
+    REQUIRE(m2.find(5, m2.hashKey(5)) == "five");
+    REQUIRE(!m2.find(6, m2.hashKey(6)).has_value());
+    for (auto const & f : files) {
+        filesystem::remove(f);
+    }
+}
+
+TEST_CASE("MMapS2IOpenHashMap and MMapI2SOpenHashMap find") {
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    gradylib::OpenHashMap<string, int> m;
+    m["abc"] = 0;
+    m["def"] = 3;
+    m.erase("def");
+    gradylib::writeMappable(tmpFile, m);
+    gradylib::MMapS2IOpenHashMap<int> m2(tmpFile);
+    REQUIRE(*m2.find("abc") == 0);
+    REQUIRE(!m2.find("def"));
+    REQUIRE(!m2.find("ghi"));
+
+    gradylib::OpenHashMap<int, string> m3;
+    gradylib::writeMappable(tmpFile, m3);
+    REQUIRE(!gradylib::MMapI2SOpenHashMap<int>(tmpFile).find(1).has_value());
+    m3[1] = "abc";
+    m3[2] = "def";
+    m3.erase(2);
+    gradylib::writeMappable(tmpFile, m3);
+    gradylib::MMapI2SOpenHashMap<int> m4(tmpFile);
+    REQUIRE(m4.find(1) == "abc");
+    REQUIRE(!m4.find(2).has_value());
+    REQUIRE(!m4.find(3).has_value());
+    filesystem::remove(tmpFile);
+}
+
 TEST_CASE("OpenHashMap write") {
     gradylib::OpenHashMap<string, StringIntFloat> m;
     m["abc"] = StringIntFloat{"ruf3", 3, 0.2345};
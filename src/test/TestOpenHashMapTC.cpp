@@ -377,6 +377,12 @@ TEST_CASE("OpenHashMapTC erase does nothing on nonexistent element") {
     REQUIRE(m.size() == 4);
 }
 
+TEST_CASE("OpenHashMapTC erase on empty map") {
+    gradylib::OpenHashMapTC<int, double> m;
+    m.erase(1);
+    REQUIRE(m.size() == 0);
+}
+
 TEST_CASE("OpenHashMapTC reserve throws when object is readonly") {
     gradylib::OpenHashMapTC<int, double> m;
     m[0] = -3;
@@ -388,6 +394,22 @@ TEST_CASE("OpenHashMapTC reserve throws when object is readonly") {
     filesystem::remove(tmpFile);
 }
 
+TEST_CASE("OpenHashMapTC reserve with a thread pool first touches the arrays") {
+    ThreadPool tp(NumaTopology({{0, {0}}, {1, {1}}}), 4, false);
+    gradylib::OpenHashMapTC<int, double> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[i] = i;
+    }
+    m.reserve(1000000, tp);
+    REQUIRE(m.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(m.at(i) == i);
+    }
+    REQUIRE(!m.contains(1000));
+    m[5000] = 2;
+    REQUIRE(m.at(5000) == 2);
+}
+
 TEST_CASE("OpenHashMapTC iterator") {
     gradylib::OpenHashMapTC<int, double, TrashHash> m;
     m[0] = 1.234;
@@ -501,3 +523,38 @@ TEST_CASE("OpenHashMapTC ifstream constructor") {
     filesystem::remove(tmpFile);
 }
 
+
+TEST_CASE("OpenHashMapTC copy on write mapping") {
+    gradylib::OpenHashMapTC<int, double> m;
+    m.reserve(1000);
+    for (int i = 0; i < 100; ++i) {
+        m[i] = i;
+    }
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    m.write(tmpFile);
+    gradylib::OpenHashMapTC<int, double> m2(tmpFile, MappingMode::CopyOnWrite);
+    m2[0] = -1;
+    m2[1000] = 1000;
+    m2.erase(1);
+    REQUIRE(m2.size() == 100);
+    REQUIRE(m2.at(0) == -1);
+    REQUIRE(m2.at(1000) == 1000);
+    REQUIRE(!m2.contains(1));
+
+    gradylib::OpenHashMapTC<int, double> m3(tmpFile);
+    REQUIRE(m3.size() == 100);
+    REQUIRE(m3.at(0) == 0);
+    REQUIRE(m3.at(1) == 1);
+    REQUIRE(!m3.contains(1000));
+
+    // Growing past the load factor moves the map onto the heap
+    for (int i = 2000; i < 4000; ++i) {
+        m2[i] = i;
+    }
+    REQUIRE(m2.size() == 2100);
+    REQUIRE(m2.at(0) == -1);
+    REQUIRE(m2.at(2) == 2);
+    REQUIRE(m2.at(3999) == 3999);
+    filesystem::remove(tmpFile);
+}
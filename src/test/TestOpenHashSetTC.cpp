@@ -407,3 +407,41 @@ TEST_CASE("OpenHashSetTC ifstream constructor"){
     fs::remove(tmpFile);
 }
 
+
+TEST_CASE("OpenHashSetTC copy on write mapping"){
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    OpenHashSetTC<int> s;
+    s.reserve(1000);
+    for (int i = 0; i < 100; ++i) {
+        s.insert(i);
+    }
+    s.write(tmpFile);
+    OpenHashSetTC<int> s2(tmpFile, MappingMode::CopyOnWrite);
+    s2.insert(1000);
+    s2.erase(1);
+    REQUIRE(s2.size() == 100);
+    REQUIRE(s2.contains(1000));
+    REQUIRE(!s2.contains(1));
+
+    OpenHashSetTC<int> s3(tmpFile);
+    REQUIRE(s3.size() == 100);
+    REQUIRE(s3.contains(1));
+    REQUIRE(!s3.contains(1000));
+
+    for (int i = 2000; i < 4000; ++i) {
+        s2.insert(i);
+    }
+    REQUIRE(s2.size() == 2100);
+    REQUIRE(s2.contains(0));
+    REQUIRE(s2.contains(1000));
+    REQUIRE(s2.contains(3999));
+    REQUIRE(!s2.contains(1));
+
+    OpenHashSetTC<int> s4;
+    s4 = OpenHashSetTC<int>(tmpFile, MappingMode::CopyOnWrite);
+    REQUIRE(s4.size() == 100);
+    s4.insert(5000);
+    REQUIRE(s4.contains(5000));
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,91 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<string>
+
+#include<gradylib/OverlayMap.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+TEST_CASE("OverlayMap over MMapS2IOpenHashMap") {
+    fs::path tmpFile = fs::temp_directory_path() / "overlay_s2i.bin";
+    OpenHashMap<string, int> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[to_string(i)] = i;
+    }
+    writeMappable(tmpFile, m);
+
+    ThreadPool tp(2);
+    OverlayMap<MMapS2IOpenHashMap<int>> overlay(tmpFile, 0, &tp);
+    overlay.put("0", -1);
+    overlay.put("new", 5000);
+    overlay.erase("1");
+    overlay.erase("never in the base");
+    REQUIRE(overlay.get("0") == -1);
+    REQUIRE(overlay.get("new") == 5000);
+    REQUIRE(!overlay.contains("1"));
+    REQUIRE(overlay.at("2") == 2);
+    REQUIRE(!overlay.get("missing").has_value());
+    REQUIRE_THROWS(overlay.at("missing"));
+    REQUIRE(overlay.deltaSize() == 4);
+
+    overlay.compact().get();
+    REQUIRE(overlay.deltaSize() == 0);
+    REQUIRE(overlay.get("0") == -1);
+    REQUIRE(overlay.get("new") == 5000);
+    REQUIRE(!overlay.contains("1"));
+
+    MMapS2IOpenHashMap<int> compacted(tmpFile);
+    REQUIRE(compacted.size() == 1000);
+    REQUIRE(compacted["0"] == -1);
+    REQUIRE(compacted["new"] == 5000);
+    REQUIRE(!compacted.contains("1"));
+    for (int i = 2; i < 1000; ++i) {
+        REQUIRE(compacted[to_string(i)] == i);
+    }
+    size_t count = 0;
+    for (auto && [key, value] : compacted) {
+        REQUIRE(overlay.get(key) == value);
+        ++count;
+    }
+    REQUIRE(count == 1000);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("OverlayMap over OpenHashMapTC compacts at threshold") {
+    fs::path tmpFile = fs::temp_directory_path() / "overlay_tc.bin";
+    OpenHashMapTC<int, double> m;
+    for (int i = 0; i < 100; ++i) {
+        m[i] = i;
+    }
+    m.write(tmpFile);
+
+    ThreadPool tp(2);
+    {
+        OverlayMap<OpenHashMapTC<int, double>> overlay(tmpFile, 50, &tp);
+        for (int i = 100; i < 1000; ++i) {
+            overlay.put(i, i);
+            // Writes are visible immediately, whether or not a compaction is running
+            REQUIRE(overlay.at(i) == i);
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            overlay.erase(i);
+        }
+        overlay.compact().get();
+        overlay.compact().get();
+        REQUIRE(overlay.deltaSize() == 0);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(overlay.contains(i) == (i % 2 == 1));
+        }
+    }
+    OpenHashMapTC<int, double> compacted(tmpFile);
+    REQUIRE(compacted.size() == 500);
+    REQUIRE(compacted.at(999) == 999);
+    fs::remove(tmpFile);
+}
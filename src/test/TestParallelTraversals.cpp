@@ -6,6 +6,15 @@
 
 #include"gradylib/AltIntHash.hpp"
 #include"gradylib/OpenHashMap.hpp"
+#include"gradylib/ParallelTraversals.hpp"
+#include"gradylib/ThreadPool.hpp"
+
+#include<algorithm>
+#include<atomic>
+#include<numeric>
+#include<random>
+#include<string>
+#include<vector>
 
 using namespace gradylib;
 using namespace std;
@@ -37,4 +46,139 @@ TEST_CASE("Parallel traversals") {
     cout << "time: " << chrono::duration_cast<chrono::milliseconds>(endTime - startTime).count() << " ms\n";
     std::cout << r.size() << " " << m.size() << "\n";
     REQUIRE( r.size() == m.size());
-}
\ No newline at end of file
+}
+TEST_CASE("parallelFor and parallelReduce") {
+    ThreadPool tp(4);
+    size_t n = 100003;
+    vector<int> v(n, 0);
+    parallelFor(tp, size_t(0), n, [&](size_t i) {
+        v[i] = i % 7;
+    });
+    atomic<size_t> chunks{0};
+    parallelFor(tp, size_t(0), n, [&](size_t start, size_t stop) {
+        REQUIRE(stop - start <= 1000);
+        chunks.fetch_add(1);
+    }, 1000);
+    REQUIRE(chunks.load() == (n + 999) / 1000);
+    parallelFor(tp, 10, 10, [&](int) { REQUIRE(false); });
+
+    long total = parallelReduce(tp, v.begin(), v.end(), 5L, plus<>{});
+    REQUIRE(total == 5 + accumulate(v.begin(), v.end(), 0L));
+    // Non commutative op: chunks must combine in order
+    vector<string> words;
+    for (int i = 0; i < 5000; ++i) {
+        words.push_back(to_string(i % 10));
+    }
+    string joined = parallelReduce(tp, words.begin(), words.end(), string("x"), plus<>{}, 7);
+    REQUIRE(joined == accumulate(words.begin(), words.end(), string("x")));
+    REQUIRE(parallelReduce(tp, v.begin(), v.begin(), 3L) == 3);
+}
+
+TEST_CASE("parallelTransform") {
+    ThreadPool tp(4);
+    vector<int> in(10007);
+    iota(in.begin(), in.end(), 0);
+    vector<long> out(in.size());
+    auto end = parallelTransform(tp, in.begin(), in.end(), out.begin(), [](int x) { return 2L * x; });
+    REQUIRE(end == out.end());
+    for (size_t i = 0; i < in.size(); ++i) {
+        REQUIRE(out[i] == 2L * i);
+    }
+    parallelTransform(tp, in.begin(), in.end(), in.begin(), [](int x) { return x + 1; });
+    REQUIRE(in.front() == 1);
+    REQUIRE(in.back() == 10007);
+}
+
+TEST_CASE("parallelSort") {
+    ThreadPool tp(4);
+    mt19937 gen(17);
+    for (size_t n : {0, 1, 100, 4097, 50000, 300001}) {
+        vector<int> v(n);
+        for (auto & x : v) {
+            x = gen() % 1000;
+        }
+        vector<int> expected = v;
+        sort(expected.begin(), expected.end());
+        parallelSort(tp, v.begin(), v.end());
+        REQUIRE(v == expected);
+    }
+    vector<string> s(20000);
+    for (auto & x : s) {
+        x = to_string(gen());
+    }
+    vector<string> expected = s;
+    sort(expected.begin(), expected.end(), greater<>{});
+    parallelSort(tp, s.begin(), s.end(), greater<>{}, 100);
+    REQUIRE(s == expected);
+}
+
+TEST_CASE("parallelPrefixSum") {
+    ThreadPool tp(4);
+    vector<size_t> sizes(100001);
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        sizes[i] = i % 13;
+    }
+    vector<size_t> inclusive(sizes.size());
+    partial_sum(sizes.begin(), sizes.end(), inclusive.begin());
+    vector<size_t> out(sizes.size());
+    parallelPrefixSum(tp, sizes.begin(), sizes.end(), out.begin());
+    REQUIRE(out == inclusive);
+
+    vector<size_t> exclusive(sizes.size());
+    size_t expectedTotal = 100 + accumulate(sizes.begin(), sizes.end(), size_t(0));
+    exclusive_scan(sizes.begin(), sizes.end(), exclusive.begin(), size_t(100));
+    vector<size_t> inPlace = sizes;
+    size_t total = parallelExclusivePrefixSum(tp, inPlace.begin(), inPlace.end(), inPlace.begin(), size_t(100));
+    REQUIRE(total == expectedTotal);
+    REQUIRE(inPlace == exclusive);
+
+    inPlace = sizes;
+    parallelPrefixSum(tp, inPlace.begin(), inPlace.end(), inPlace.begin(), plus<>{}, 10);
+    REQUIRE(inPlace == inclusive);
+}
+
+TEST_CASE("parallelPrefixSum of strings") {
+    // Moving from a string empties it, so the chunk totals must not be moved from while they're still needed
+    ThreadPool tp(4);
+    vector<string> letters;
+    for (char c = 'a'; c <= 'z'; ++c) {
+        letters.emplace_back(1, c);
+    }
+    vector<string> expected(letters.size());
+    partial_sum(letters.begin(), letters.end(), expected.begin());
+    vector<string> out(letters.size());
+    parallelPrefixSum(tp, letters.begin(), letters.end(), out.begin(), plus<>{}, 3);
+    REQUIRE(out == expected);
+
+    vector<string> exclusive(letters.size());
+    exclusive_scan(letters.begin(), letters.end(), exclusive.begin(), string(">"));
+    string total = parallelExclusivePrefixSum(tp, letters.begin(), letters.end(), out.begin(), string(">"), plus<>{}, 3);
+    REQUIRE(out == exclusive);
+    REQUIRE(total == ">abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST_CASE("parallelPartition is stable") {
+    ThreadPool tp(4);
+    vector<int> v(100003);
+    iota(v.begin(), v.end(), 0);
+    auto isEven = [](int x) { return x % 2 == 0; };
+    auto mid = parallelPartition(tp, v.begin(), v.end(), isEven);
+    REQUIRE(mid - v.begin() == 50002);
+    REQUIRE(is_sorted(v.begin(), mid));
+    REQUIRE(is_sorted(mid, v.end()));
+    REQUIRE(all_of(v.begin(), mid, isEven));
+    REQUIRE(none_of(mid, v.end(), isEven));
+}
+
+TEST_CASE("Parallel algorithms called from inside a task") {
+    ThreadPool tp(2);
+    auto f = tp.submit([&tp]() {
+        vector<int> v(20000);
+        iota(v.rbegin(), v.rend(), 0);
+        parallelSort(tp, v.begin(), v.end(), less<>{}, 1000);
+        return is_sorted(v.begin(), v.end()) && parallelReduce(tp, v.begin(), v.end(), 0L) == 19999L * 20000 / 2;
+    });
+    REQUIRE(f.get());
+    vector<int> v(1000, 1);
+    REQUIRE(parallelReduce(v.begin(), v.end(), 0) == 1000);
+}
@@ -0,0 +1,203 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<optional>
+#include<stdexcept>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<gradylib/MPMCQueue.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/Pipeline.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+
+TEST_CASE("MPMCQueue single thread") {
+    MPMCQueue<string> q(3);
+    REQUIRE(q.capacity() == 4);
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(q.tryPush(to_string(i)));
+    }
+    REQUIRE(!q.tryPush("full"));
+    REQUIRE(q.sizeApprox() == 4);
+    string s;
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(q.tryPop(s));
+        REQUIRE(s == to_string(i));
+    }
+    REQUIRE(!q.tryPop(s));
+    REQUIRE(q.tryPush("left behind"));
+}
+
+TEST_CASE("MPMCQueue many producers and consumers") {
+    MPMCQueue<int> q(64);
+    int const perProducer = 100000;
+    atomic<long> sum{0};
+    atomic<int> popped{0};
+    vector<thread> threads;
+    for (int p = 0; p < 4; ++p) {
+        threads.emplace_back([&]() {
+            for (int i = 1; i <= perProducer; ++i) {
+                while (!q.tryPush(i)) {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < 4; ++c) {
+        threads.emplace_back([&]() {
+            int v;
+            while (popped.load() < 4 * perProducer) {
+                if (q.tryPop(v)) {
+                    sum.fetch_add(v);
+                    popped.fetch_add(1);
+                } else {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    REQUIRE(sum.load() == 4L * perProducer * (perProducer + 1) / 2);
+}
+
+TEST_CASE("Pipeline stages, filtering and order") {
+    ThreadPool tp(4);
+    int next = 0;
+    OpenHashMap<int, string> m;
+    vector<int> seen;
+    auto done = makePipeline(tp, [&]() -> optional<int> {
+                if (next == 100000) {
+                    return nullopt;
+                }
+                return next++;
+            }, PipelineOptions{.batchSize = 100, .queueCapacity = 2})
+            .then([](int && i) -> optional<int> {
+                if (i % 2) {
+                    return nullopt;
+                }
+                return i;
+            })
+            .then([](int && i) {
+                return to_string(i);
+            }, 4)
+            .then([](string && s) {
+                return stoi(s);
+            })
+            .sink([&](int && i) {
+                m[i] = to_string(i);
+                seen.push_back(i);
+            });
+    done.get();
+    REQUIRE(m.size() == 50000);
+    for (int i = 0; i < 100000; i += 2) {
+        REQUIRE(m.at(i) == to_string(i));
+    }
+    sort(seen.begin(), seen.end());
+    REQUIRE(adjacent_find(seen.begin(), seen.end()) == seen.end());
+
+    // Stages with parallelism 1 keep the source's order
+    vector<int> ordered;
+    next = 0;
+    makePipeline(tp, [&]() -> optional<int> {
+                if (next == 10000) {
+                    return nullopt;
+                }
+                return next++;
+            }, PipelineOptions{.batchSize = 7, .queueCapacity = 3})
+            .then([](int && i) {
+                return i * 2;
+            })
+            .sink([&](int && i) {
+                ordered.push_back(i);
+            }).get();
+    REQUIRE(ordered.size() == 10000);
+    for (int i = 0; i < 10000; ++i) {
+        REQUIRE(ordered[i] == 2 * i);
+    }
+}
+
+TEST_CASE("Pipeline backpressure bounds the items in flight") {
+    ThreadPool tp(4);
+    atomic<long> produced{0};
+    atomic<long> consumed{0};
+    atomic<long> maxInFlight{0};
+    size_t const batchSize = 10;
+    size_t const queueCapacity = 2;
+    makePipeline(tp, [&]() -> optional<long> {
+                long p = produced.fetch_add(1);
+                if (p >= 20000) {
+                    return nullopt;
+                }
+                long inFlight = p - consumed.load();
+                long m = maxInFlight.load();
+                while (inFlight > m && !maxInFlight.compare_exchange_weak(m, inFlight)) {
+                }
+                return p;
+            }, PipelineOptions{.batchSize = batchSize, .queueCapacity = queueCapacity})
+            .then([](long && i) {
+                return i + 1;
+            }, 2)
+            .sink([&](long &&) {
+                if (consumed.fetch_add(1) % 1000 == 0) {
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            }).get();
+    REQUIRE(consumed.load() == 20000);
+    // Two queues of queueCapacity batches, counting the one being filled, plus the batches the map and sink tasks hold
+    REQUIRE(maxInFlight.load() <= static_cast<long>((2 * queueCapacity + 2 + 1) * batchSize));
+}
+
+TEST_CASE("Pipeline on a single worker and with exceptions") {
+    ThreadPool tp(1);
+    int next = 0;
+    long sum = 0;
+    makePipeline(tp, [&]() -> optional<int> {
+                if (next == 1000) {
+                    return nullopt;
+                }
+                return next++;
+            }, PipelineOptions{.batchSize = 3, .queueCapacity = 1})
+            .then([](int && i) {
+                return i + 1;
+            }, 4)
+            .sink([&](int && i) {
+                sum += i;
+            }).get();
+    REQUIRE(sum == 500500);
+
+    next = 0;
+    auto failed = makePipeline(tp, [&]() -> optional<int> {
+                return next++;
+            }, PipelineOptions{.batchSize = 16, .queueCapacity = 2})
+            .then([](int && i) {
+                if (i == 500) {
+                    throw runtime_error("bad item");
+                }
+                return i;
+            })
+            .sink([](int &&) {
+            });
+    REQUIRE_THROWS(failed.get());
+
+    bool called = false;
+    makePipeline(tp, []() -> optional<int> {
+                return nullopt;
+            })
+            .sink([&](int &&) {
+                called = true;
+            }).get();
+    REQUIRE(!called);
+    REQUIRE_THROWS(makePipeline(tp, []() -> optional<int> { return nullopt; }, PipelineOptions{.batchSize = 0}));
+}
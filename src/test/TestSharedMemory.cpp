@@ -0,0 +1,117 @@
+//
+// Created by Grady Schofield on 10/18/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<string>
+
+#include<gradylib/MMapI2HRSOpenHashMap.hpp>
+#include<gradylib/MMapS2IOpenHashMap.hpp>
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/OpenHashMapTC.hpp>
+#include<gradylib/OpenHashSetTC.hpp>
+#include<gradylib/SharedMemory.hpp>
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+TEST_CASE("Publish MMapS2IOpenHashMap to shared memory") {
+    OpenHashMap<string, int> m;
+    for (int i = 0; i < 100000; ++i) {
+        m[to_string(i)] = i;
+    }
+    string name = "/gradylib_test_s2i_" + to_string(getpid());
+    publishSharedMemory(name, [&](ostream & os) {
+        writeMappable(os, m);
+    });
+    MMapS2IOpenHashMap<int> m2(attachSharedMemory(name));
+    removeSharedMemory(name);
+    REQUIRE(m2.size() == m.size());
+    for (auto const & [key, value] : m) {
+        REQUIRE(m2[key] == value);
+    }
+}
+
+TEST_CASE("Republishing shared memory leaves attached readers on the old copy") {
+    string name = "/gradylib_test_tc_" + to_string(getpid());
+    OpenHashMapTC<int, int> m;
+    m[1] = 1;
+    publishSharedMemory(name, [&](ostream & os) {
+        m.write(os);
+    });
+    OpenHashMapTC<int, int> first(attachSharedMemory(name));
+    m[1] = 2;
+    m[2] = 2;
+    publishSharedMemory(name, [&](ostream & os) {
+        m.write(os);
+    });
+    OpenHashMapTC<int, int> second(attachSharedMemory(name));
+    removeSharedMemory(name);
+    REQUIRE(first.size() == 1);
+    REQUIRE(first.at(1) == 1);
+    REQUIRE(second.size() == 2);
+    REQUIRE(second.at(1) == 2);
+    REQUIRE(second.at(2) == 2);
+}
+
+TEST_CASE("attachSharedMemory throws on missing object") {
+    REQUIRE_THROWS(attachSharedMemory("/gradylib_test_nonexistent_shm"));
+}
+
+TEST_CASE("attachSharedMemory throws on an object still being published") {
+    // What a reader sees between publishSharedMemory creating the object and marking it complete
+    string name = "/gradylib_test_partial_" + to_string(getpid());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    REQUIRE(fd >= 0);
+    REQUIRE_THROWS(attachSharedMemory(name));
+    REQUIRE(ftruncate(fd, 1 << 16) == 0);
+    REQUIRE_THROWS(attachSharedMemory(name));
+    close(fd);
+    removeSharedMemory(name);
+}
+
+TEST_CASE("publishHugePageFile writes through a mapping") {
+    // No hugetlbfs mount is assumed, so this exercises the mapping writer and rename on an ordinary filesystem.
+    fs::path tmpFile = fs::temp_directory_path() / "hugepage_map.bin";
+    MMapI2HRSOpenHashMap<int>::Builder builder;
+    for (int i = 0; i < 10000; ++i) {
+        builder.put(i, to_string(i % 10));
+    }
+    publishHugePageFile(tmpFile, [&](ostream & os) {
+        builder.write(os);
+    });
+    REQUIRE(!fs::exists(fs::path(tmpFile).concat(".tmp")));
+    MMapI2HRSOpenHashMap<int> m(tmpFile);
+    REQUIRE(m.size() == 10000);
+    for (int i = 0; i < 10000; ++i) {
+        REQUIRE(m.at(i) == to_string(i % 10));
+    }
+    fs::remove(tmpFile);
+}
+
+#ifdef __linux__
+TEST_CASE("Publish OpenHashSetTC to a sealed memfd") {
+    OpenHashSetTC<int64_t> s;
+    for (int64_t i = 0; i < 1000; ++i) {
+        s.insert(i * 7);
+    }
+    int fd = publishMemfd("gradylib_test_set", [&](ostream & os) {
+        s.write(os);
+    });
+    char c = 0;
+    REQUIRE(write(fd, &c, 1) < 0);
+    OpenHashSetTC<int64_t> s2{MappedFile(fd)};
+    close(fd);
+    REQUIRE(s2.size() == s.size());
+    for (int64_t i = 0; i < 1000; ++i) {
+        REQUIRE(s2.contains(i * 7));
+    }
+}
+#endif
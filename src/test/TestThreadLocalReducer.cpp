@@ -0,0 +1,61 @@
+//
+// Created by Grady Schofield on 10/19/26.
+//
+
+#include<catch2/catch_test_macros.hpp>
+
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<gradylib/OpenHashMap.hpp>
+#include<gradylib/ParallelTraversals.hpp>
+#include<gradylib/ThreadLocalReducer.hpp>
+#include<gradylib/ThreadPool.hpp>
+
+using namespace gradylib;
+using namespace std;
+
+TEST_CASE("ThreadLocalReducer sums") {
+    ThreadPool tp(4);
+    ThreadLocalReducer<long> sum(tp);
+    REQUIRE(sum.numSlots() == 5);
+    parallelFor(tp, 0L, 100000L, [&](long i) {
+        sum.local() += i;
+    });
+    // Updates from outside the pool go to the shared slot
+    thread outside([&]() {
+        sum.update([](long & s) {
+            s += 1;
+        });
+    });
+    outside.join();
+    REQUIRE_THROWS(sum.local());
+    REQUIRE(sum.reduce() == 4999950000L + 1);
+    // reduce resets the slots
+    REQUIRE(sum.reduce() == 0);
+
+    ThreadLocalReducer<long, decltype([](long & a, long b) { a = max(a, b); })> maximum(tp, -1);
+    parallelFor(tp, 0L, 10000L, [&](long i) {
+        maximum.update([i](long & m) {
+            m = max(m, (i * 7919) % 10007);
+        });
+    });
+    REQUIRE(maximum.reduceParallel() == 10006);
+    REQUIRE(maximum.reduce() == -1);
+}
+
+TEST_CASE("ThreadLocalReducer merges Mergeable partials") {
+    ThreadPool tp(3);
+    for (bool parallel : {false, true}) {
+        ThreadLocalReducer<OpenHashMap<int, int>> seen(tp);
+        parallelFor(tp, 0, 20000, [&](int i) {
+            seen.local()[i % 1000] = i % 1000;
+        });
+        OpenHashMap<int, int> merged = parallel ? seen.reduceParallel() : seen.reduce();
+        REQUIRE(merged.size() == 1000);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(merged.at(i) == i);
+        }
+    }
+}
@@ -4,13 +4,24 @@
 
 #include<unistd.h>
 
+#include<algorithm>
+#include<array>
+#include<atomic>
+#include<chrono>
+#include<filesystem>
 #include<fstream>
+#include<memory>
 #include<sstream>
+#include<thread>
 #include<unordered_set>
 
 #include<catch2/catch_test_macros.hpp>
 
+#include"gradylib/NumaTopology.hpp"
+#include"gradylib/TaskAllocation.hpp"
 #include"gradylib/ThreadPool.hpp"
+#include"gradylib/ThreadPoolMetrics.hpp"
+#include"gradylib/WorkStealingDeque.hpp"
 
 using namespace std;
 using namespace gradylib;
@@ -45,4 +56,327 @@ TEST_CASE("Thread pool") {
         unlink("testfile.txt");
         REQUIRE(s.size() == numWork);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("WorkStealingDeque owner and thieves take each element once") {
+    gradylib_helpers::WorkStealingDeque<long *> deque(4);
+    long const n = 100000;
+    vector<long> values(n);
+    for (long i = 0; i < n; ++i) {
+        values[i] = i;
+    }
+    atomic<bool> done{false};
+    atomic<long> stolenSum{0};
+    atomic<long> stolenCount{0};
+    vector<thread> thieves;
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&]() {
+            while (!done.load() || !deque.empty()) {
+                if (long * p = deque.steal()) {
+                    stolenSum += *p;
+                    ++stolenCount;
+                }
+            }
+        });
+    }
+    long ownSum = 0;
+    long ownCount = 0;
+    for (long i = 0; i < n; ++i) {
+        deque.push(&values[i]);
+        if (i % 3 == 0) {
+            if (long * p = deque.pop()) {
+                ownSum += *p;
+                ++ownCount;
+            }
+        }
+    }
+    while (long * p = deque.pop()) {
+        ownSum += *p;
+        ++ownCount;
+    }
+    done.store(true);
+    for (auto & t : thieves) {
+        t.join();
+    }
+    REQUIRE(ownCount + stolenCount.load() == n);
+    REQUIRE(ownSum + stolenSum.load() == n * (n - 1) / 2);
+}
+
+TEST_CASE("Thread pool tasks adding tasks") {
+    ThreadPool tp(4);
+    atomic<long> count{0};
+    for (int i = 0; i < 100; ++i) {
+        tp.add([&tp, &count]() {
+            for (int j = 0; j < 100; ++j) {
+                tp.add([&count]() {
+                    ++count;
+                });
+            }
+        });
+    }
+    tp.wait();
+    REQUIRE(count.load() == 10000);
+    REQUIRE(tp.isEmpty());
+}
+
+TEST_CASE("Thread pool allocateOverThreads") {
+    ThreadPool tp(3);
+    vector<atomic<int>> hits(1000);
+    tp.allocateOverThreads(hits.size(), [&hits](size_t start, size_t stop) {
+        for (size_t i = start; i < stop; ++i) {
+            ++hits[i];
+        }
+    });
+    tp.wait();
+    for (auto & h : hits) {
+        REQUIRE(h.load() == 1);
+    }
+}
+
+TEST_CASE("Thread pool submit") {
+    ThreadPool tp(2);
+    future<int> f = tp.submit([]() {
+        return 42;
+    });
+    future<void> g = tp.submit([]() {
+        throw runtime_error("task failed");
+    });
+    REQUIRE(f.get() == 42);
+    REQUIRE_THROWS(g.get());
+}
+
+TEST_CASE("Thread pool wakes parked workers and waiters without polling") {
+    ThreadPool tp(4);
+    // Let the workers park
+    this_thread::sleep_for(chrono::milliseconds(50));
+    auto startTime = chrono::steady_clock::now();
+    for (int i = 0; i < 20; ++i) {
+        atomic<int> count{0};
+        tp.allocateOverThreads(4, [&count](size_t, size_t) {
+            ++count;
+        });
+        tp.wait();
+        REQUIRE(count.load() == 4);
+    }
+    // Falling back to the 500ms poll would take ~10s.  The bound is loose so a busy machine doesn't fail it.
+    REQUIRE(chrono::steady_clock::now() - startTime < chrono::seconds(5));
+}
+
+TEST_CASE("TaskGroup wait ignores other tasks in the pool") {
+    ThreadPool tp(2);
+    atomic<bool> release{false};
+    tp.add([&release]() {
+        while (!release.load()) {
+            this_thread::yield();
+        }
+    });
+    atomic<int> count{0};
+    TaskGroup group = tp.allocateOverThreads(100, [&count](size_t start, size_t stop) {
+        count += stop - start;
+    });
+    group.add([&count]() {
+        ++count;
+    });
+    group.wait();
+    REQUIRE(group.isDone());
+    REQUIRE(count.load() == 101);
+    release.store(true);
+    tp.wait();
+}
+
+TEST_CASE("TaskGroup nested waits run on a small pool") {
+    ThreadPool tp(2);
+    atomic<long> count{0};
+    TaskGroup outer(tp);
+    for (int i = 0; i < 8; ++i) {
+        outer.add([&tp, &count]() {
+            TaskGroup inner(tp);
+            for (int j = 0; j < 8; ++j) {
+                inner.add([&tp, &count]() {
+                    TaskGroup leaves = tp.allocateOverThreads(10, [&count](size_t start, size_t stop) {
+                        count += stop - start;
+                    });
+                    leaves.wait();
+                });
+            }
+            inner.wait();
+        });
+    }
+    outer.wait();
+    REQUIRE(count.load() == 8 * 8 * 10);
+}
+
+TEST_CASE("NumaTopology parses sysfs node directories") {
+    REQUIRE(gradylib_helpers::parseCpuList("0-3,8,10-11\n") == vector<int>{0, 1, 2, 3, 8, 10, 11});
+    REQUIRE(gradylib_helpers::parseCpuList("").empty());
+    REQUIRE(gradylib_helpers::parseCpuList("x,2") == vector<int>{2});
+
+    filesystem::path dir = filesystem::temp_directory_path() / "gradylib_numa_test";
+    filesystem::remove_all(dir);
+    for (auto [name, cpus] : vector<pair<string, string>>{{"node1", "4-7\n"}, {"node0", "0-3\n"}, {"node2", "\n"}}) {
+        filesystem::create_directories(dir / name);
+        ofstream(dir / name / "cpulist") << cpus;
+    }
+    filesystem::create_directories(dir / "power");
+    NumaTopology topology = NumaTopology::discover(dir);
+    REQUIRE(topology.size() == 2);
+    REQUIRE(topology[0].id == 0);
+    REQUIRE(topology[1].id == 1);
+    REQUIRE(topology[1].cpus == vector<int>{4, 5, 6, 7});
+    REQUIRE(topology.numCpus() == 8);
+    filesystem::remove_all(dir);
+
+    NumaTopology missing = NumaTopology::discover(dir);
+    REQUIRE(missing.size() == 1);
+    REQUIRE(missing.numCpus() >= 1);
+}
+
+TEST_CASE("Thread pool on a NUMA topology") {
+    ThreadPool tp(NumaTopology({{0, {0, 1}}, {1, {2, 3}}}), 6, false);
+    REQUIRE(tp.size() == 6);
+    REQUIRE(tp.numNodes() == 2);
+    REQUIRE(tp.currentNode() == -1);
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(tp.workerNode(i) == 0);
+        REQUIRE(tp.workerNode(i + 3) == 1);
+    }
+    REQUIRE(tp.nodeForPart(0, 2) == 0);
+    REQUIRE(tp.nodeForPart(1, 2) == 1);
+    REQUIRE(tp.nodeForPart(99, 100) == 1);
+
+    atomic<int> ran{0};
+    atomic<bool> badNode{false};
+    for (int i = 0; i < 200; ++i) {
+        tp.addOnNode(i % 2, [&]() {
+            if (tp.currentNode() < 0) {
+                badNode.store(true);
+            }
+            ran.fetch_add(1);
+        });
+    }
+    vector<atomic<long>> sums(6);
+    tp.allocateOverThreads(6000, [&](size_t start, size_t stop) {
+        for (size_t i = start; i < stop; ++i) {
+            sums[start / 1000].fetch_add(i);
+        }
+    }).wait();
+    tp.wait();
+    REQUIRE(ran.load() == 200);
+    REQUIRE(!badNode.load());
+    long total = 0;
+    for (auto & s : sums) {
+        total += s.load();
+    }
+    REQUIRE(total == 5999L * 6000 / 2);
+
+    // Pinning to cpus that may not exist only fails quietly
+    ThreadPool pinned(NumaTopology({{0, {0}}, {1, {100000}}}), 2, true);
+    REQUIRE(pinned.submit([]() { return 7; }).get() == 7);
+}
+
+TEST_CASE("Thread pool tasks may be move only and larger than the inline buffer") {
+    ThreadPool tp(2);
+    auto owned = make_unique<int>(5);
+    atomic<int> sum{0};
+    array<long, 32> big{};
+    big[31] = 7;
+    TaskGroup group(tp);
+    group.add([p = std::move(owned), &sum]() {
+        sum.fetch_add(*p);
+    });
+    group.add([big, &sum]() {
+        sum.fetch_add(big[31]);
+    });
+    group.wait();
+    REQUIRE(sum.load() == 12);
+    auto f = tp.submit([p = make_unique<int>(3)]() {
+        return *p;
+    });
+    REQUIRE(f.get() == 3);
+
+    // Never run, destroyed by the pool's destructor without leaking
+    auto pool = make_unique<ThreadPool>(1);
+    atomic<bool> release{false};
+    pool->add([&release]() {
+        while (!release.load()) {
+            this_thread::yield();
+        }
+    });
+    auto counted = make_shared<int>(0);
+    for (int i = 0; i < 10; ++i) {
+        pool->add([counted, big]() {});
+    }
+    release.store(true);
+    pool.reset();
+    REQUIRE(counted.use_count() == 1);
+}
+
+TEST_CASE("NodeCache recycles nodes") {
+    using Cache = gradylib_helpers::NodeCache<array<char, 40>, 4, 2>;
+    auto * a = Cache::get();
+    Cache::put(a);
+    REQUIRE(Cache::get() == a);
+    vector<array<char, 40> *> nodes;
+    for (int i = 0; i < 20; ++i) {
+        nodes.push_back(Cache::get());
+    }
+    // Overflow goes to the depot, where another thread can pick it up
+    for (auto * node : nodes) {
+        Cache::put(node);
+    }
+    thread([&]() {
+        auto * node = Cache::get();
+        REQUIRE(find(nodes.begin(), nodes.end(), node) != nodes.end());
+        Cache::put(node);
+    }).join();
+    Cache::put(a);
+}
+
+TEST_CASE("ThreadPool metrics") {
+    ThreadPool tp(2);
+    ThreadPoolMetrics before = tp.metrics();
+    REQUIRE(before.runTime.count() == 0);
+    tp.add([]() {}).wait();
+    REQUIRE(tp.metrics().runTime.count() == 0);
+
+    tp.enableMetrics(std::chrono::microseconds(1));
+    // Queue up more tasks than workers so some wait
+    TaskGroup group(tp);
+    for (int i = 0; i < 20; ++i) {
+        group.add([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        });
+    }
+    group.wait();
+    // Let the workers park, then wake one
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    tp.add([]() {}).wait();
+    tp.disableMetrics();
+
+    ThreadPoolMetrics m = tp.metrics();
+    REQUIRE(m.runTime.count() == 21);
+    REQUIRE(m.waitTime.count() == 21);
+    REQUIRE(m.runTime.percentile(0.9) >= 2000000);
+    REQUIRE(m.waitTime.percentile(1.0) >= 2000000);
+    REQUIRE(m.maxQueued >= 10);
+    REQUIRE(!m.queueDepth.empty());
+    REQUIRE(m.workers.size() == 2);
+    uint64_t tasksRun = 0;
+    uint64_t parks = 0;
+    for (auto const & w : m.workers) {
+        tasksRun += w.tasksRun;
+        parks += w.parks;
+    }
+    REQUIRE(tasksRun == 21);
+    REQUIRE(parks > 0);
+    REQUIRE(m.wakeupLatency.count() > 0);
+    REQUIRE(m.utilization() > 0.0);
+    REQUIRE(m.utilization() <= 1.0);
+    REQUIRE(m.elapsed.count() > 0);
+
+    // Nothing is collected while disabled
+    tp.add([]() {}).wait();
+    REQUIRE(tp.metrics().runTime.count() == 21);
+    tp.resetMetrics();
+    REQUIRE(tp.metrics().runTime.count() == 0);
+}